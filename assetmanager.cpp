@@ -7,14 +7,31 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonValue>
+#include <QPainter>
+#include <QSvgRenderer>
 #include <QtGlobal>
 
+namespace {
+// Room for a few hundred distinct symbols at typical plan zoom levels.
+constexpr int kSymbolCacheKiB = 64 * 1024;
+} // namespace
+
 AssetManager *AssetManager::instance()
 {
     static AssetManager instance;
     return &instance;
 }
 
+AssetManager::AssetManager()
+    : m_symbols(kSymbolCacheKiB)
+{
+    if (QCoreApplication *app = QCoreApplication::instance()) {
+        QObject::connect(app, &QCoreApplication::aboutToQuit, app, [this]() {
+            releaseGraphics();
+        });
+    }
+}
+
 QString AssetManager::findAssetsRoot()
 {
     QDir dir(QCoreApplication::applicationDirPath());
@@ -201,6 +218,49 @@ QString AssetManager::assetsRoot() const
     return m_assetsRoot.absolutePath();
 }
 
+void AssetManager::releaseGraphics()
+{
+    m_symbols.clear();
+    m_renderers.clear();
+}
+
+QSvgRenderer *AssetManager::svgRenderer(const QString &svgPath)
+{
+    QSharedPointer<QSvgRenderer> &renderer = m_renderers[svgPath];
+    if (!renderer) {
+        // Invalid files are kept too, so they are not parsed again.
+        renderer.reset(new QSvgRenderer(svgPath));
+    }
+    return renderer.data();
+}
+
+QPixmap AssetManager::symbolPixmap(const QString &svgPath, const QSize &pixelSize)
+{
+    const QString key = QStringLiteral("%1|%2x%3")
+                            .arg(svgPath)
+                            .arg(pixelSize.width())
+                            .arg(pixelSize.height());
+    if (const QPixmap *cached = m_symbols.object(key)) {
+        return *cached;
+    }
+
+    QSvgRenderer *renderer = svgRenderer(svgPath);
+    if (!renderer->isValid() || pixelSize.isEmpty()) {
+        return QPixmap();
+    }
+
+    QPixmap pixmap(pixelSize);
+    pixmap.fill(Qt::transparent);
+    QPainter painter(&pixmap);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    renderer->render(&painter, QRectF(QPointF(0.0, 0.0), QSizeF(pixelSize)));
+    painter.end();
+
+    const int cost = qMax(1, pixelSize.width() * pixelSize.height() * 4 / 1024);
+    m_symbols.insert(key, new QPixmap(pixmap), cost);
+    return pixmap;
+}
+
 QString AssetManager::resolvePath(const QString &path) const
 {
     if (path.isEmpty()) {
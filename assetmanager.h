@@ -1,13 +1,19 @@
 ﻿#ifndef ASSETMANAGER_H
 #define ASSETMANAGER_H
 
+#include <QCache>
 #include <QHash>
 #include <QDir>
 #include <QList>
+#include <QPixmap>
+#include <QSharedPointer>
+#include <QSize>
 #include <QString>
 #include <QStringList>
 #include <QVector3D>
 
+class QSvgRenderer;
+
 class AssetManager
 {
 public:
@@ -32,14 +38,27 @@ public:
     QStringList categories() const;
     QString assetsRoot() const;
 
+    // One parsed renderer per SVG file, shared by every item that shows it.
+    QSvgRenderer *svgRenderer(const QString &svgPath);
+    // The SVG rasterized at pixelSize, cached across items. Null if the
+    // file cannot be rendered.
+    QPixmap symbolPixmap(const QString &svgPath, const QSize &pixelSize);
+    // Drops the shared renderers and cached pixmaps. The manager outlives
+    // QApplication, and they must not, so this runs on aboutToQuit; code
+    // that never enters the event loop calls it itself.
+    void releaseGraphics();
+
 private:
-    AssetManager() = default;
+    AssetManager();
     QString resolvePath(const QString &path) const;
     void registerCategory(const QString &category);
 
     QHash<QString, Asset> m_assets;
     QStringList m_categories;
     QDir m_assetsRoot;
+    QHash<QString, QSharedPointer<QSvgRenderer>> m_renderers;
+    // Cost is in KiB.
+    QCache<QString, QPixmap> m_symbols;
 };
 
 #endif // ASSETMANAGER_H
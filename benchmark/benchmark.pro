@@ -0,0 +1,14 @@
+# Times the editor's hot paths on a generated plan; see planbenchmark.h.
+TARGET = planbenchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../untitled.pri)
+
+SOURCES += \
+    main.cpp \
+    planbenchmark.cpp
+
+HEADERS += \
+    planbenchmark.h
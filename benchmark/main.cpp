@@ -0,0 +1,15 @@
+#include "assetmanager.h"
+#include "planbenchmark.h"
+
+#include <QApplication>
+
+int main(int argc, char *argv[])
+{
+    // Benchmarks need the application, but neither the style nor a window.
+    QApplication a(argc, argv);
+
+    // No event loop runs, so aboutToQuit never comes.
+    const int result = PlanBenchmark::run(a.arguments());
+    AssetManager::instance()->releaseGraphics();
+    return result;
+}
@@ -0,0 +1,500 @@
+#include "planbenchmark.h"
+
+#include "assetmanager.h"
+#include "designscene.h"
+#include "dooritem.h"
+#include "furnitureitem.h"
+#include "modelcache.h"
+#include "projectmanager.h"
+#include "projectsnapshot.h"
+#include "scenemesher.h"
+#include "view2dwidget.h"
+#include "wallitem.h"
+#include "windowitem.h"
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QImage>
+#include <QPainter>
+#include <QPointF>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTransform>
+#include <QtMath>
+
+#include <algorithm>
+
+namespace {
+constexpr int kResultsVersion = 1;
+constexpr qreal kRoomWidth = 400.0;
+constexpr qreal kRoomDepth = 300.0;
+constexpr qreal kOpeningWidth = 64.0;
+constexpr qreal kOpeningSpacing = 16.0;
+// Cursor positions per snapping pass.
+constexpr int kProbeCount = 10000;
+// Wall counts mesh.build is also timed at, each on a plan of its own.
+constexpr int kMeshSweepWalls[] = {1000, 10000, 50000};
+// The 2D grid is painted into a viewport of this size, panned diagonally
+// by kPanStepPixels per frame, at each of kGridScales.
+constexpr int kViewportWidth = 1920;
+constexpr int kViewportHeight = 1080;
+constexpr int kPanFrames = 200;
+constexpr int kPanStepPixels = 24;
+constexpr qreal kGridScales[] = {0.05, 0.2, 1.0};
+
+QTextStream &out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QTextStream &err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+double median(QVector<double> values)
+{
+    if (values.isEmpty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    const int middle = values.size() / 2;
+    return values.size() % 2 ? values.at(middle)
+                             : (values.at(middle - 1) + values.at(middle)) / 2.0;
+}
+
+QJsonObject optionsToJson(const PlanBenchmark::Options &options)
+{
+    QJsonObject json;
+    json["rooms"] = options.rooms;
+    json["openings_per_wall"] = options.openingsPerWall;
+    json["furniture_per_room"] = options.furniturePerRoom;
+    json["seed"] = static_cast<qint64>(options.seed);
+    return json;
+}
+
+bool readJson(const QString &path, QJsonObject *object)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    *object = doc.object();
+    return doc.isObject();
+}
+
+int gridColumns(int rooms)
+{
+    return qMax(1, qCeil(std::sqrt(qreal(rooms))));
+}
+
+// Rooms for a plan with at least the given number of walls. Every room
+// adds about two walls to the grid.
+int roomsForWalls(int walls)
+{
+    return qMax(1, walls / 2);
+}
+
+// Paints the grid the way View2DWidget's cached background does, without
+// showing a window.
+class GridView : public View2DWidget
+{
+public:
+    using View2DWidget::drawBackground;
+};
+
+SceneMesher::Request meshRequest(const QList<WallItem *> &walls)
+{
+    SceneMesher::Request request;
+    for (WallItem *wall : walls) {
+        request.walls.append(SceneMesher::snapshotWall(wall));
+        request.changed.insert(wall);
+    }
+    return request;
+}
+} // namespace
+
+PlanBenchmark::PlanBenchmark(const Options &options)
+    : m_options(options)
+    , m_cases()
+{
+}
+
+int PlanBenchmark::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.addPositionalArgument("results", "Results file.");
+    const QCommandLineOption baselineOption("baseline", "Results to compare with.", "file");
+    const QCommandLineOption toleranceOption("tolerance", "Allowed slowdown in percent.",
+                                             "percent", "10");
+    const QCommandLineOption roomsOption("rooms", "Rooms in the plan.", "count", "100");
+    const QCommandLineOption openingsOption("openings-per-wall", "Openings per wall.",
+                                            "count", "1");
+    const QCommandLineOption furnitureOption("furniture-per-room", "Furniture per room.",
+                                             "count", "3");
+    const QCommandLineOption iterationsOption("iterations", "Timed runs per case.",
+                                              "count", "5");
+    const QCommandLineOption seedOption("seed", "Random seed of the plan.", "seed", "1");
+    parser.addOptions({baselineOption, toleranceOption, roomsOption,
+                       openingsOption, furnitureOption, iterationsOption, seedOption});
+    if (!parser.parse(arguments)) {
+        err() << parser.errorText() << Qt::endl;
+        return 1;
+    }
+    if (parser.positionalArguments().size() != 1) {
+        err() << parser.helpText() << Qt::endl;
+        return 1;
+    }
+
+    Options options;
+    options.rooms = qMax(1, parser.value(roomsOption).toInt());
+    options.openingsPerWall = qMax(0, parser.value(openingsOption).toInt());
+    options.furniturePerRoom = qMax(0, parser.value(furnitureOption).toInt());
+    options.iterations = qMax(1, parser.value(iterationsOption).toInt());
+    options.seed = parser.value(seedOption).toUInt();
+
+    PlanBenchmark benchmark(options);
+    const QJsonObject results = benchmark.measure();
+
+    const QString outputPath = parser.positionalArguments().constFirst();
+    QSaveFile file(outputPath);
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(QJsonDocument(results).toJson()) == -1
+        || !file.commit()) {
+        err() << QStringLiteral("无法写入结果: %1").arg(outputPath) << Qt::endl;
+        return 1;
+    }
+
+    if (!parser.isSet(baselineOption)) {
+        return 0;
+    }
+    QJsonObject baseline;
+    if (!readJson(parser.value(baselineOption), &baseline)) {
+        err() << QStringLiteral("无法读取基线: %1").arg(parser.value(baselineOption))
+              << Qt::endl;
+        return 1;
+    }
+    return compare(results, baseline, parser.value(toleranceOption).toDouble());
+}
+
+void PlanBenchmark::generatePlan(DesignScene *scene, const Options &options)
+{
+    QRandomGenerator random(options.seed);
+    const int columns = gridColumns(options.rooms);
+    const int rows = (options.rooms + columns - 1) / columns;
+
+    QVector<WallItem *> walls;
+    for (int row = 0; row <= rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            walls.append(new WallItem(QPointF(column * kRoomWidth, row * kRoomDepth),
+                                      QPointF((column + 1) * kRoomWidth, row * kRoomDepth)));
+        }
+    }
+    for (int column = 0; column <= columns; ++column) {
+        for (int row = 0; row < rows; ++row) {
+            walls.append(new WallItem(QPointF(column * kRoomWidth, row * kRoomDepth),
+                                      QPointF(column * kRoomWidth, (row + 1) * kRoomDepth)));
+        }
+    }
+
+    for (WallItem *wall : qAsConst(walls)) {
+        scene->addItem(wall);
+        const int fit = qFloor(wall->length() / (kOpeningWidth + kOpeningSpacing));
+        const int count = qMin(options.openingsPerWall, fit);
+        for (int i = 0; i < count; ++i) {
+            OpeningItem *opening = random.bounded(2)
+                ? static_cast<OpeningItem *>(new DoorItem())
+                : static_cast<OpeningItem *>(new WindowItem());
+            opening->setDistanceFromStart(wall->length() * (i + 0.5) / count);
+            scene->addItem(opening);
+            wall->addOpening(opening);
+        }
+    }
+
+    QStringList assetIds;
+    AssetManager *assets = AssetManager::instance();
+    const QStringList categories = assets->categories();
+    for (const QString &category : categories) {
+        for (const AssetManager::Asset &asset : assets->getAssetsByCategory(category)) {
+            assetIds.append(asset.id);
+        }
+    }
+    if (assetIds.isEmpty()) {
+        return;
+    }
+    for (int room = 0; room < options.rooms; ++room) {
+        const QPointF corner((room % columns) * kRoomWidth, (room / columns) * kRoomDepth);
+        for (int i = 0; i < options.furniturePerRoom; ++i) {
+            auto *item = new FurnitureItem(assetIds.at(random.bounded(assetIds.size())));
+            item->setPos(corner + QPointF(random.bounded(kRoomWidth),
+                                          random.bounded(kRoomDepth)));
+            scene->addItem(item);
+        }
+    }
+}
+
+QJsonObject PlanBenchmark::measure()
+{
+    if (AssetManager::instance()->categories().isEmpty()) {
+        AssetManager::instance()->loadAssets(AssetManager::defaultCatalogPath());
+    }
+
+    DesignScene scene;
+    generatePlan(&scene, m_options);
+    scene.flushChanges();
+    const QList<WallItem *> walls = scene.walls();
+    const QRectF bounds = scene.itemsBoundingRect();
+
+    QRandomGenerator random(m_options.seed);
+    QVector<QPointF> probes;
+    probes.reserve(kProbeCount);
+    for (int i = 0; i < kProbeCount; ++i) {
+        probes.append(QPointF(bounds.left() + random.bounded(bounds.width()),
+                              bounds.top() + random.bounded(bounds.height())));
+    }
+
+    // View3DWidget snapshots the walls on the GUI thread and meshes them on
+    // a worker; the two are timed apart.
+    SceneMesher::Request request;
+    addCase(QStringLiteral("mesh.snapshot"), [&]() {
+        request = meshRequest(walls);
+    });
+    SceneMesher::Result meshes;
+    addCase(QStringLiteral("mesh.build"), [&]() {
+        meshes = SceneMesher::build(request, nullptr);
+    });
+
+    // How meshing scales with the plan. Only the walls matter here.
+    QJsonObject meshSweep;
+    for (int wallCount : kMeshSweepWalls) {
+        Options sweepOptions = m_options;
+        sweepOptions.rooms = roomsForWalls(wallCount);
+        sweepOptions.furniturePerRoom = 0;
+        DesignScene sweepScene;
+        generatePlan(&sweepScene, sweepOptions);
+        sweepScene.flushChanges();
+        const SceneMesher::Request sweepRequest = meshRequest(sweepScene.walls());
+        const QString name = QStringLiteral("mesh.build.%1k").arg(wallCount / 1000);
+        addCase(name, [&]() {
+            SceneMesher::build(sweepRequest, nullptr);
+        });
+        meshSweep[name] = sweepRequest.walls.size();
+    }
+
+    addCase(QStringLiteral("scene.snapPosition"), [&]() {
+        bool snapped = false;
+        for (const QPointF &probe : qAsConst(probes)) {
+            scene.snapPosition(probe, &snapped);
+        }
+    });
+    addCase(QStringLiteral("scene.findWallNear"), [&]() {
+        qreal distanceAlong = 0.0;
+        for (const QPointF &probe : qAsConst(probes)) {
+            scene.findWallNear(probe, 50.0, &distanceAlong);
+        }
+    });
+
+    // With the background cached, the first frame paints the whole viewport
+    // and every panned frame only the two strips scrolled into view.
+    GridView gridView;
+    QImage viewport(kViewportWidth, kViewportHeight, QImage::Format_ARGB32_Premultiplied);
+    for (qreal gridScale : kGridScales) {
+        addCase(QStringLiteral("view2d.drawBackground.%1").arg(gridScale), [&]() {
+            QPainter painter(&viewport);
+            const QRectF full(0.0, 0.0, kViewportWidth, kViewportHeight);
+            const QRectF column(kViewportWidth - kPanStepPixels, 0.0,
+                                kPanStepPixels, kViewportHeight);
+            const QRectF row(0.0, kViewportHeight - kPanStepPixels,
+                             kViewportWidth - kPanStepPixels, kPanStepPixels);
+            for (int frame = 0; frame <= kPanFrames; ++frame) {
+                QTransform transform;
+                transform.translate(-frame * kPanStepPixels, -frame * kPanStepPixels);
+                transform.scale(gridScale, gridScale);
+                const QTransform toScene = transform.inverted();
+                painter.setWorldTransform(transform);
+                if (frame == 0) {
+                    gridView.drawBackground(&painter, toScene.mapRect(full));
+                } else {
+                    gridView.drawBackground(&painter, toScene.mapRect(column));
+                    gridView.drawBackground(&painter, toScene.mapRect(row));
+                }
+            }
+        });
+    }
+
+    // Moving an end re-derives the wall's outline and its openings'.
+    addCase(QStringLiteral("wall.updateGeometry"), [&]() {
+        for (WallItem *wall : walls) {
+            const QPointF end = wall->endPos();
+            wall->setEndPos(end + QPointF(1.0, 1.0));
+            wall->updateGeometry();
+            wall->setEndPos(end);
+            wall->updateGeometry();
+        }
+    });
+    scene.flushChanges();
+
+    QByteArray projectData;
+    addCase(QStringLiteral("project.toJson"), [&]() {
+        projectData = QJsonDocument(scene.toJson()).toJson(QJsonDocument::Compact);
+    });
+    DesignScene loaded;
+    addCase(QStringLiteral("project.fromJson"), [&]() {
+        loaded.fromJson(QJsonDocument::fromJson(projectData).object());
+        loaded.flushChanges();
+    });
+
+    // The binary format goes through the file, as saving and opening do.
+    QTemporaryDir outputDir;
+    const QString cborPath = outputDir.filePath(QStringLiteral("benchmark.qplanb"));
+    addCase(QStringLiteral("project.writeCbor"), [&]() {
+        ProjectManager::writeProject(cborPath, scene.toJson(), nullptr);
+    });
+    addCase(QStringLiteral("project.readCbor"), [&]() {
+        QJsonObject root;
+        ProjectManager::readProject(cborPath, &root, nullptr);
+        loaded.fromJson(root);
+        loaded.flushChanges();
+    });
+
+    // An autosave snapshots the scene on the GUI thread and converts and
+    // writes it on the autosave thread; the two are timed apart.
+    ProjectSnapshot snapshot;
+    addCase(QStringLiteral("autosave.snapshot"), [&]() {
+        snapshot = scene.snapshot();
+    });
+    const QString autosavePath = outputDir.filePath(QStringLiteral("benchmark.autosave.qplan"));
+    addCase(QStringLiteral("autosave.write"), [&]() {
+        ProjectManager::writeProject(autosavePath, snapshot.toJson(), nullptr);
+    });
+
+    // Loads bypass the in-memory cache and go to disk each time, as on a
+    // fresh start. After the warm-up run they are served by the on-disk
+    // mesh cache, like every start but the first.
+    QSet<QString> modelPaths;
+    for (FurnitureItem *item : scene.furniture()) {
+        const QString path = AssetManager::instance()->getAsset(item->assetId()).modelPath;
+        if (!path.isEmpty()) {
+            modelPaths.insert(path);
+        }
+    }
+    if (!modelPaths.isEmpty()) {
+        addCase(QStringLiteral("modelCache.load"), [&]() {
+            for (const QString &path : qAsConst(modelPaths)) {
+                ModelCache::loadModel(path);
+            }
+        });
+    }
+
+    QJsonObject plan;
+    plan["walls"] = walls.size();
+    plan["openings"] = scene.openings().size();
+    plan["furniture"] = scene.furniture().size();
+    plan["models"] = modelPaths.size();
+    plan["mesh_sweep_walls"] = meshSweep;
+
+    // What a full upload of the wall meshes costs in either vertex format.
+    qint64 wallVertices = 0;
+    for (const SceneMesher::WallMesh &mesh : qAsConst(meshes.meshes)) {
+        for (const QVector<MeshVertex> &part : mesh.parts) {
+            wallVertices += part.size();
+        }
+    }
+    plan["wall_vertices"] = wallVertices;
+    plan["wall_vertex_bytes"] = wallVertices * qint64(sizeof(FloatMeshVertex));
+    plan["wall_packed_vertex_bytes"] = wallVertices * qint64(sizeof(PackedMeshVertex));
+
+    QJsonObject cases;
+    for (const Case &result : qAsConst(m_cases)) {
+        cases[result.name] = toJson(result);
+        out() << QStringLiteral("%1 %2 ms")
+                     .arg(result.name, -24)
+                     .arg(median(result.runsMs), 10, 'f', 3)
+              << Qt::endl;
+    }
+    out() << QStringLiteral("墙体顶点 %1: %2 -> %3 字节")
+                 .arg(wallVertices)
+                 .arg(wallVertices * qint64(sizeof(FloatMeshVertex)))
+                 .arg(wallVertices * qint64(sizeof(PackedMeshVertex)))
+          << Qt::endl;
+
+    QJsonObject results;
+    results["version"] = kResultsVersion;
+    results["options"] = optionsToJson(m_options);
+    results["plan"] = plan;
+    results["cases"] = cases;
+    return results;
+}
+
+template <typename Function>
+void PlanBenchmark::addCase(const QString &name, Function function)
+{
+    // The first run warms caches and allocators and is not counted.
+    function();
+
+    Case result;
+    result.name = name;
+    QElapsedTimer timer;
+    for (int i = 0; i < m_options.iterations; ++i) {
+        timer.start();
+        function();
+        result.runsMs.append(timer.nsecsElapsed() / 1e6);
+    }
+    m_cases.append(result);
+}
+
+QJsonObject PlanBenchmark::toJson(const Case &result)
+{
+    QJsonArray runs;
+    for (double ms : result.runsMs) {
+        runs.append(ms);
+    }
+    QJsonObject json;
+    json["median_ms"] = median(result.runsMs);
+    json["min_ms"] = *std::min_element(result.runsMs.cbegin(), result.runsMs.cend());
+    json["runs_ms"] = runs;
+    return json;
+}
+
+int PlanBenchmark::compare(const QJsonObject &results,
+                           const QJsonObject &baseline,
+                           double tolerance)
+{
+    if (baseline.value("options").toObject() != results.value("options").toObject()) {
+        err() << QStringLiteral("基线使用了不同的场景参数，无法比较。") << Qt::endl;
+        return 1;
+    }
+
+    int regressions = 0;
+    const QJsonObject cases = results.value("cases").toObject();
+    const QJsonObject baselineCases = baseline.value("cases").toObject();
+    for (auto it = cases.constBegin(); it != cases.constEnd(); ++it) {
+        const double before = baselineCases.value(it.key()).toObject().value("median_ms").toDouble();
+        if (before <= 0.0) {
+            continue;
+        }
+        const double after = it.value().toObject().value("median_ms").toDouble();
+        const double change = (after - before) / before * 100.0;
+        const bool regressed = change > tolerance;
+        if (regressed) {
+            ++regressions;
+        }
+        out() << QStringLiteral("%1 %2 ms -> %3 ms %4%%5")
+                     .arg(it.key(), -24)
+                     .arg(before, 10, 'f', 3)
+                     .arg(after, 10, 'f', 3)
+                     .arg(change, 7, 'f', 1)
+                     .arg(regressed ? QStringLiteral("  变慢") : QString())
+              << Qt::endl;
+    }
+    return regressions > 0 ? 2 : 0;
+}
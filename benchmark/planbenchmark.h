@@ -0,0 +1,58 @@
+#ifndef PLANBENCHMARK_H
+#define PLANBENCHMARK_H
+
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class DesignScene;
+
+// Times the editor's hot paths on a generated plan. Built as its own
+// target from the application's sources:
+//
+//   planbenchmark results.json [--baseline old.json] [--rooms N]
+//                 [--openings-per-wall N] [--furniture-per-room N]
+//                 [--iterations N] [--seed N]
+//
+// The plan depends only on the options, so results of two builds can be
+// compared. With --baseline, every case whose median is more than
+// --tolerance percent slower than the baseline's is reported, and the
+// exit code is non-zero.
+class PlanBenchmark
+{
+public:
+    struct Options {
+        int rooms = 100;
+        int openingsPerWall = 1;
+        int furniturePerRoom = 3;
+        int iterations = 5;
+        quint32 seed = 1;
+    };
+
+    static int run(const QStringList &arguments);
+
+    // Lays out the rooms on a grid; every room edge is one wall.
+    static void generatePlan(DesignScene *scene, const Options &options);
+
+private:
+    struct Case {
+        QString name;
+        QVector<double> runsMs;
+    };
+
+    explicit PlanBenchmark(const Options &options);
+
+    QJsonObject measure();
+    template <typename Function>
+    void addCase(const QString &name, Function function);
+    static QJsonObject toJson(const Case &result);
+    static int compare(const QJsonObject &results,
+                       const QJsonObject &baseline,
+                       double tolerance);
+
+    Options m_options;
+    QVector<Case> m_cases;
+};
+
+#endif // PLANBENCHMARK_H
@@ -1,16 +1,142 @@
 #include "blueprintitem.h"
 
-BlueprintItem::BlueprintItem(const QPixmap &pixmap, QGraphicsItem *parent)
-    : QGraphicsPixmapItem(pixmap, parent)
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QtMath>
+
+#include <cmath>
+
+BlueprintItem::BlueprintItem(const QString &sourcePath, QGraphicsItem *parent)
+    : QGraphicsObject(parent)
+    , m_pyramid(BlueprintTiles::instance()->open(sourcePath))
 {
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);
+    connect(BlueprintTiles::instance(), &BlueprintTiles::tilesReady, this,
+            [this](const QString &path) {
+                if (path == m_pyramid.sourcePath) {
+                    update();
+                }
+            });
+    connect(BlueprintTiles::instance(), &BlueprintTiles::buildFailed, this,
+            [this](const QString &path, const QString &errorMessage) {
+                if (path == m_pyramid.sourcePath) {
+                    m_errorMessage = errorMessage;
+                    emit loadFailed(errorMessage);
+                }
+            });
+    // A build that failed before the connection was made.
+    m_errorMessage = BlueprintTiles::instance()->buildError(m_pyramid);
 }
 
-void BlueprintItem::setSourcePath(const QString &path)
+bool BlueprintItem::isNull() const
 {
-    m_sourcePath = path;
+    return m_pyramid.isNull();
 }
 
 QString BlueprintItem::sourcePath() const
 {
-    return m_sourcePath;
+    return m_pyramid.sourcePath;
+}
+
+QSize BlueprintItem::imageSize() const
+{
+    return m_pyramid.size;
+}
+
+QString BlueprintItem::errorMessage() const
+{
+    return m_errorMessage;
+}
+
+QRectF BlueprintItem::boundingRect() const
+{
+    const QSizeF size(m_pyramid.size);
+    return QRectF(QPointF(-size.width() / 2.0, -size.height() / 2.0), size);
+}
+
+void BlueprintItem::paint(QPainter *painter,
+                          const QStyleOptionGraphicsItem *option,
+                          QWidget *widget)
+{
+    if (m_pyramid.isNull()) {
+        return;
+    }
+
+    // Pick the level whose pixels are at most twice as dense as the
+    // screen's, so tiles are only ever scaled down by less than half.
+    const qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    const int coarsest = m_pyramid.levels - 1;
+    const int level = lod > 0.0
+        ? qBound(0, qFloor(std::log2(1.0 / lod)), coarsest)
+        : coarsest;
+
+    const QRectF exposed = option->exposedRect.intersected(boundingRect())
+                               .translated(-boundingRect().topLeft());
+    if (exposed.isEmpty()) {
+        return;
+    }
+
+    const QSize levelSize = m_pyramid.levelSize(level);
+    const qreal toLevelX = qreal(levelSize.width()) / m_pyramid.size.width();
+    const qreal toLevelY = qreal(levelSize.height()) / m_pyramid.size.height();
+    const int tileSize = BlueprintTiles::kTileSize;
+    const int firstColumn = qMax(0, qFloor(exposed.left() * toLevelX / tileSize));
+    const int lastColumn = qMin((levelSize.width() - 1) / tileSize,
+                                qFloor(exposed.right() * toLevelX / tileSize));
+    const int firstRow = qMax(0, qFloor(exposed.top() * toLevelY / tileSize));
+    const int lastRow = qMin((levelSize.height() - 1) / tileSize,
+                             qFloor(exposed.bottom() * toLevelY / tileSize));
+
+    // QGraphicsScene::render (exports) passes no widget; it gets one pass,
+    // so tiles are decoded right away instead of in the background.
+    const bool wait = widget == nullptr;
+    BlueprintTiles *tiles = BlueprintTiles::instance();
+    QImage overview;
+
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, true);
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            const QSize tileExtent(qMin(tileSize, levelSize.width() - column * tileSize),
+                                   qMin(tileSize, levelSize.height() - row * tileSize));
+            const QRectF target = tileRect(level, column, row, tileExtent);
+            const QImage image = tiles->tile(m_pyramid, level, column, row, wait);
+            if (!image.isNull()) {
+                painter->drawImage(target, image, QRectF(image.rect()));
+                continue;
+            }
+
+            // Stand in with the matching part of the one-tile overview. Only
+            // missing tiles get it, so a translucent blueprint is never
+            // blended twice.
+            if (level == coarsest) {
+                continue;
+            }
+            if (overview.isNull()) {
+                overview = tiles->tile(m_pyramid, coarsest, 0, 0, wait);
+                if (overview.isNull()) {
+                    continue;
+                }
+            }
+            const qreal toOverviewX = qreal(overview.width()) / m_pyramid.size.width();
+            const qreal toOverviewY = qreal(overview.height()) / m_pyramid.size.height();
+            const QRectF imageRect = target.translated(-boundingRect().topLeft());
+            const QRectF source(imageRect.left() * toOverviewX,
+                                imageRect.top() * toOverviewY,
+                                imageRect.width() * toOverviewX,
+                                imageRect.height() * toOverviewY);
+            painter->drawImage(target, overview, source);
+        }
+    }
+}
+
+QRectF BlueprintItem::tileRect(int level, int column, int row, const QSize &tileSize) const
+{
+    const QSize levelSize = m_pyramid.levelSize(level);
+    const qreal toItemX = qreal(m_pyramid.size.width()) / levelSize.width();
+    const qreal toItemY = qreal(m_pyramid.size.height()) / levelSize.height();
+    const QPointF origin = boundingRect().topLeft();
+    return QRectF(origin.x() + column * BlueprintTiles::kTileSize * toItemX,
+                  origin.y() + row * BlueprintTiles::kTileSize * toItemY,
+                  tileSize.width() * toItemX,
+                  tileSize.height() * toItemY);
 }
@@ -1,23 +1,47 @@
 #ifndef BLUEPRINTITEM_H
 #define BLUEPRINTITEM_H
 
-#include <QGraphicsPixmapItem>
+#include "blueprinttiles.h"
+
+#include <QGraphicsObject>
+#include <QSize>
 #include <QString>
 
-class BlueprintItem : public QGraphicsPixmapItem
+// Imported floor plan scan, centred on its position. It draws from the
+// scan's tile pyramid: only tiles in the exposed area, at the level that
+// matches the zoom. Tiles still loading show the coarsest level instead.
+class BlueprintItem : public QGraphicsObject
 {
+    Q_OBJECT
+
 public:
     enum { Type = UserType + 4 };
     int type() const override { return Type; }
 
-    explicit BlueprintItem(const QPixmap &pixmap,
+    explicit BlueprintItem(const QString &sourcePath,
                            QGraphicsItem *parent = nullptr);
 
-    void setSourcePath(const QString &path);
+    bool isNull() const;
     QString sourcePath() const;
+    // Size of the scan in image pixels.
+    QSize imageSize() const;
+    // Why the scan's tiles could not be built, or an empty string.
+    QString errorMessage() const;
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter,
+               const QStyleOptionGraphicsItem *option,
+               QWidget *widget) override;
+
+signals:
+    // The tile pyramid could not be built, so nothing will ever draw.
+    void loadFailed(const QString &errorMessage);
 
 private:
-    QString m_sourcePath;
+    QRectF tileRect(int level, int column, int row, const QSize &tileSize) const;
+
+    BlueprintTiles::Pyramid m_pyramid;
+    QString m_errorMessage;
 };
 
 #endif // BLUEPRINTITEM_H
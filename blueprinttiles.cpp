@@ -0,0 +1,280 @@
+#include "blueprinttiles.h"
+
+#include "imagebandreader.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
+
+#include <cstring>
+
+namespace {
+// Bump when the tile layout changes so old pyramids are rebuilt.
+constexpr int kPyramidVersion = 1;
+// Decoded tiles kept in memory, about 128 full tiles.
+constexpr int kTileCacheKiB = 128 * 1024;
+const char kCompleteMarker[] = "complete";
+
+// Light compression: tiles are written once per scan but decoded on every
+// cache miss.
+constexpr int kTilePngQuality = 80;
+
+// Pyramid directory for an image file. Size and modification time stand in
+// for the content, as for the model cache.
+QString pyramidDirectory(const QFileInfo &info)
+{
+    QString dirPath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (dirPath.isEmpty()) {
+        dirPath = QDir::tempPath();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(info.absoluteFilePath().toUtf8());
+    hash.addData(QByteArray::number(info.size()));
+    hash.addData(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+    hash.addData(QByteArray::number(kPyramidVersion));
+    return QDir(dirPath).filePath(QStringLiteral("blueprints/%1")
+                                      .arg(QString::fromLatin1(hash.result().toHex())));
+}
+
+// bottom's rows below top's; both are as wide and in the same format.
+QImage stackRows(const QImage &top, const QImage &bottom)
+{
+    QImage rows(top.width(), top.height() + bottom.height(), top.format());
+    const qsizetype bytes = static_cast<qsizetype>(top.width()) * 4;
+    for (int y = 0; y < top.height(); ++y) {
+        std::memcpy(rows.scanLine(y), top.constScanLine(y), bytes);
+    }
+    for (int y = 0; y < bottom.height(); ++y) {
+        std::memcpy(rows.scanLine(top.height() + y), bottom.constScanLine(y), bytes);
+    }
+    return rows;
+}
+} // namespace
+
+QSize BlueprintTiles::Pyramid::levelSize(int level) const
+{
+    const int divisor = 1 << level;
+    return QSize(qMax(1, (size.width() + divisor - 1) / divisor),
+                 qMax(1, (size.height() + divisor - 1) / divisor));
+}
+
+QString BlueprintTiles::Pyramid::tilePath(int level, int column, int row) const
+{
+    return QDir(directory).filePath(QStringLiteral("%1_%2_%3.png")
+                                        .arg(level)
+                                        .arg(column)
+                                        .arg(row));
+}
+
+BlueprintTiles::BlueprintTiles()
+    : QObject(nullptr)
+    , m_stopping(0)
+    , m_tiles(kTileCacheKiB)
+{
+    // One thread may be busy building a pyramid; the other keeps decoding
+    // tiles for the view.
+    m_pool.setMaxThreadCount(2);
+    if (QCoreApplication *app = QCoreApplication::instance()) {
+        connect(app, &QCoreApplication::aboutToQuit, this, &BlueprintTiles::stop);
+    }
+}
+
+BlueprintTiles::~BlueprintTiles()
+{
+    stop();
+}
+
+void BlueprintTiles::stop()
+{
+    m_stopping.storeRelaxed(1);
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+BlueprintTiles *BlueprintTiles::instance()
+{
+    static BlueprintTiles tiles;
+    return &tiles;
+}
+
+BlueprintTiles::Pyramid BlueprintTiles::open(const QString &sourcePath)
+{
+    Pyramid pyramid;
+    const QFileInfo info(sourcePath);
+    const QSize size = QImageReader(sourcePath).size();
+    if (!info.exists() || !size.isValid() || size.isEmpty()) {
+        return pyramid;
+    }
+
+    pyramid.sourcePath = info.absoluteFilePath();
+    pyramid.directory = pyramidDirectory(info);
+    pyramid.size = size;
+    pyramid.levels = 1;
+    while (qMax(pyramid.levelSize(pyramid.levels - 1).width(),
+                pyramid.levelSize(pyramid.levels - 1).height()) > kTileSize) {
+        ++pyramid.levels;
+    }
+
+    if (QFile::exists(QDir(pyramid.directory).filePath(kCompleteMarker))) {
+        return pyramid;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_building.contains(pyramid.directory)) {
+        m_building.insert(pyramid.directory, QVector<int>(pyramid.levels, 0));
+        m_failed.remove(pyramid.directory);
+        m_pool.start([this, pyramid]() {
+            build(pyramid);
+        });
+    }
+    return pyramid;
+}
+
+QString BlueprintTiles::buildError(const Pyramid &pyramid)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_failed.value(pyramid.directory);
+}
+
+QImage BlueprintTiles::tile(const Pyramid &pyramid, int level, int column, int row, bool wait)
+{
+    const QString path = pyramid.tilePath(level, column, row);
+    {
+        QMutexLocker locker(&m_mutex);
+        if (const QImage *cached = m_tiles.object(path)) {
+            return *cached;
+        }
+        const auto building = m_building.constFind(pyramid.directory);
+        if (building != m_building.constEnd() && row >= building.value().at(level)) {
+            return QImage();
+        }
+        if (!wait) {
+            if (!m_loading.contains(path)) {
+                m_loading.insert(path);
+                const QString sourcePath = pyramid.sourcePath;
+                m_pool.start([this, path, sourcePath]() {
+                    // A broken tile is not announced, or every repaint would
+                    // ask for it again straight away.
+                    if (!loadTile(path).isNull()) {
+                        emit tilesReady(sourcePath);
+                    }
+                });
+            }
+            return QImage();
+        }
+    }
+    return loadTile(path);
+}
+
+void BlueprintTiles::build(const Pyramid &pyramid)
+{
+    QString error;
+    ImageBandReader reader(pyramid.sourcePath);
+    if (!reader.open(&error)) {
+        fail(pyramid, error);
+        return;
+    }
+    if (reader.size() != pyramid.size || !QDir().mkpath(pyramid.directory)) {
+        fail(pyramid, QStringLiteral("无法生成底图缓存: %1").arg(pyramid.sourcePath));
+        return;
+    }
+
+    // The scan is read one row of level 0 tiles at a time. Every level
+    // collects rows until it has a full row of tiles, writes them and hands
+    // them on halved, so the build never holds more than about two tile
+    // rows of the scan's width.
+    QVector<QImage> pending(pyramid.levels);
+    QVector<int> written(pyramid.levels, 0);
+    while (!reader.atEnd()) {
+        if (m_stopping.loadRelaxed()) {
+            fail(pyramid, QStringLiteral("底图缓存生成已取消: %1").arg(pyramid.sourcePath));
+            return;
+        }
+        QImage rows = reader.read(kTileSize, &error);
+        if (rows.isNull()) {
+            fail(pyramid, error);
+            return;
+        }
+        rows = rows.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        const bool last = reader.atEnd();
+
+        for (int level = 0; level < pyramid.levels && !rows.isNull(); ++level) {
+            QImage &band = pending[level];
+            band = band.isNull() ? rows : stackRows(band, rows);
+            rows = QImage();
+            if (band.height() < kTileSize && !last) {
+                break;
+            }
+
+            const int row = written.at(level);
+            for (int x = 0; x < band.width(); x += kTileSize) {
+                const QImage tile = band.copy(x, 0, qMin(kTileSize, band.width() - x), band.height());
+                if (!tile.save(pyramid.tilePath(level, x / kTileSize, row), "PNG", kTilePngQuality)) {
+                    fail(pyramid, QStringLiteral("无法写入底图缓存: %1").arg(pyramid.directory));
+                    return;
+                }
+            }
+            ++written[level];
+            // Bands hold an even number of rows but the last, so the halves
+            // add up to the next level's size.
+            if (level + 1 < pyramid.levels) {
+                rows = band.scaled(pyramid.levelSize(level + 1).width(), (band.height() + 1) / 2,
+                                   Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            }
+            band = QImage();
+        }
+
+        {
+            QMutexLocker locker(&m_mutex);
+            m_building.insert(pyramid.directory, written);
+        }
+        emit tilesReady(pyramid.sourcePath);
+    }
+
+    QSaveFile marker(QDir(pyramid.directory).filePath(kCompleteMarker));
+    if (marker.open(QIODevice::WriteOnly)) {
+        marker.write(QByteArray::number(kPyramidVersion));
+        marker.commit();
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_building.remove(pyramid.directory);
+}
+
+void BlueprintTiles::fail(const Pyramid &pyramid, const QString &errorMessage)
+{
+    // Nothing will draw from a pyramid that stopped half way, and the next
+    // open starts over, so its tiles only take up disk space.
+    QDir(pyramid.directory).removeRecursively();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_building.remove(pyramid.directory);
+        m_failed.insert(pyramid.directory, errorMessage);
+    }
+    emit buildFailed(pyramid.sourcePath, errorMessage);
+}
+
+QImage BlueprintTiles::loadTile(const QString &path)
+{
+    QImage image(path);
+    if (!image.isNull()) {
+        image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_loading.remove(path);
+    if (!image.isNull()) {
+        const int cost = qMax(1, static_cast<int>(image.sizeInBytes() / 1024));
+        m_tiles.insert(path, new QImage(image), cost);
+    }
+    return image;
+}
@@ -0,0 +1,83 @@
+#ifndef BLUEPRINTTILES_H
+#define BLUEPRINTTILES_H
+
+#include <QAtomicInt>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+// Multi-resolution tile pyramids of blueprint scans. Level 0 is the full
+// image; every further level halves it until it fits in one tile. Tiles
+// are written once as PNG files under the cache directory and decoded on
+// worker threads only when a view needs them, so a site scan never has to
+// sit in memory at full size, not even while its pyramid is built.
+class BlueprintTiles : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int kTileSize = 512;
+
+    struct Pyramid {
+        QString sourcePath;
+        QString directory;
+        QSize size;
+        int levels = 0;
+
+        bool isNull() const { return levels == 0; }
+        QSize levelSize(int level) const;
+        QString tilePath(int level, int column, int row) const;
+    };
+
+    static BlueprintTiles *instance();
+
+    // Reads only the image header. Unless a complete pyramid is already on
+    // disk, it is built on a worker thread in one pass over the scan, top
+    // to bottom, every level at once.
+    Pyramid open(const QString &sourcePath);
+    // Why the pyramid's last build failed, or an empty string.
+    QString buildError(const Pyramid &pyramid);
+
+    // The decoded tile, or a null image while it is loaded in the
+    // background. With wait set it is loaded on the calling thread instead.
+    QImage tile(const Pyramid &pyramid, int level, int column, int row, bool wait = false);
+
+signals:
+    // More of sourcePath's pyramid can be drawn. Emitted from worker threads.
+    void tilesReady(const QString &sourcePath);
+    // sourcePath's pyramid could not be built. Emitted from worker threads.
+    void buildFailed(const QString &sourcePath, const QString &errorMessage);
+
+private:
+    BlueprintTiles();
+    ~BlueprintTiles() override;
+
+    // Stops the builds and tile loads in flight and waits for them. The
+    // tiles outlive QApplication, so this runs on aboutToQuit.
+    void stop();
+    void build(const Pyramid &pyramid);
+    void fail(const Pyramid &pyramid, const QString &errorMessage);
+    QImage loadTile(const QString &path);
+
+    QMutex m_mutex;
+    QThreadPool m_pool;
+    // Set by stop(); builds give up at the next tile row.
+    QAtomicInt m_stopping;
+    // Cost is in KiB.
+    QCache<QString, QImage> m_tiles;
+    QSet<QString> m_loading;
+    // Pyramids still being written, by directory: the tile rows of each
+    // level already on disk.
+    QHash<QString, QVector<int>> m_building;
+    // Error messages of failed builds, by directory.
+    QHash<QString, QString> m_failed;
+};
+
+#endif // BLUEPRINTTILES_H
@@ -0,0 +1,162 @@
+#include "boundinghierarchy.h"
+
+#include <algorithm>
+
+namespace {
+constexpr int kMaxLeafItems = 4;
+} // namespace
+
+void BoundingBox::expand(const QVector3D &point)
+{
+    if (isEmpty()) {
+        min = point;
+        max = point;
+        return;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        min[axis] = qMin(min[axis], point[axis]);
+        max[axis] = qMax(max[axis], point[axis]);
+    }
+}
+
+void BoundingBox::unite(const BoundingBox &other)
+{
+    if (other.isEmpty()) {
+        return;
+    }
+    expand(other.min);
+    expand(other.max);
+}
+
+ViewFrustum::ViewFrustum(const QMatrix4x4 &viewProjection)
+{
+    // Gribb and Hartmann: each clip plane is the last row of the matrix
+    // plus or minus one of the others.
+    const QVector4D w = viewProjection.row(3);
+    for (int axis = 0; axis < 3; ++axis) {
+        const QVector4D row = viewProjection.row(axis);
+        m_planes[2 * axis] = w + row;
+        m_planes[2 * axis + 1] = w - row;
+    }
+}
+
+ViewFrustum::Containment ViewFrustum::classify(const BoundingBox &box) const
+{
+    Containment result = Inside;
+    for (const QVector4D &plane : m_planes) {
+        // The corners furthest along and furthest against the normal.
+        QVector3D inner;
+        QVector3D outer;
+        for (int axis = 0; axis < 3; ++axis) {
+            const bool positive = plane[axis] >= 0.0f;
+            inner[axis] = positive ? box.max[axis] : box.min[axis];
+            outer[axis] = positive ? box.min[axis] : box.max[axis];
+        }
+        if (QVector3D::dotProduct(plane.toVector3D(), inner) + plane.w() < 0.0f) {
+            return Outside;
+        }
+        if (QVector3D::dotProduct(plane.toVector3D(), outer) + plane.w() < 0.0f) {
+            result = Intersects;
+        }
+    }
+    return result;
+}
+
+void BoundingHierarchy::build(const QVector<BoundingBox> &boxes)
+{
+    clear();
+    m_items.reserve(boxes.size());
+    for (int i = 0; i < boxes.size(); ++i) {
+        if (!boxes.at(i).isEmpty()) {
+            m_items.append(i);
+        }
+    }
+    if (m_items.isEmpty()) {
+        return;
+    }
+    m_nodes.reserve(2 * (m_items.size() / kMaxLeafItems + 1));
+    buildNode(boxes, 0, static_cast<int>(m_items.size()));
+
+    m_boxes.reserve(m_items.size());
+    for (int item : qAsConst(m_items)) {
+        m_boxes.append(boxes.at(item));
+    }
+}
+
+void BoundingHierarchy::clear()
+{
+    m_nodes.clear();
+    m_items.clear();
+    m_boxes.clear();
+}
+
+int BoundingHierarchy::buildNode(const QVector<BoundingBox> &boxes, int first, int count)
+{
+    const int index = static_cast<int>(m_nodes.size());
+    m_nodes.append(Node());
+
+    Node node;
+    node.first = first;
+    node.count = count;
+    BoundingBox centres;
+    for (int i = first; i < first + count; ++i) {
+        node.box.unite(boxes.at(m_items.at(i)));
+        centres.expand(boxes.at(m_items.at(i)).centre());
+    }
+
+    if (count > kMaxLeafItems) {
+        const QVector3D spread = centres.max - centres.min;
+        int axis = 0;
+        if (spread.y() > spread[axis]) {
+            axis = 1;
+        }
+        if (spread.z() > spread[axis]) {
+            axis = 2;
+        }
+
+        const int half = count / 2;
+        std::nth_element(m_items.begin() + first,
+                         m_items.begin() + first + half,
+                         m_items.begin() + first + count,
+                         [&boxes, axis](int a, int b) {
+                             return boxes.at(a).centre()[axis] < boxes.at(b).centre()[axis];
+                         });
+        buildNode(boxes, first, half);
+        node.secondChild = buildNode(boxes, first + half, count - half);
+    }
+
+    m_nodes[index] = node;
+    return index;
+}
+
+void BoundingHierarchy::collectVisible(const ViewFrustum &frustum, QVector<int> *indices) const
+{
+    if (m_nodes.isEmpty()) {
+        return;
+    }
+
+    QVector<int> stack;
+    stack.append(0);
+    while (!stack.isEmpty()) {
+        const int index = stack.takeLast();
+        const Node &node = m_nodes.at(index);
+        const ViewFrustum::Containment containment = frustum.classify(node.box);
+        if (containment == ViewFrustum::Outside) {
+            continue;
+        }
+        if (containment == ViewFrustum::Inside) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                indices->append(m_items.at(i));
+            }
+        } else if (node.secondChild < 0) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                if (frustum.classify(m_boxes.at(i)) != ViewFrustum::Outside) {
+                    indices->append(m_items.at(i));
+                }
+            }
+        } else {
+            stack.append(node.secondChild);
+            stack.append(index + 1);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef BOUNDINGHIERARCHY_H
+#define BOUNDINGHIERARCHY_H
+
+#include <QMatrix4x4>
+#include <QVector>
+#include <QVector3D>
+#include <QVector4D>
+
+// Axis-aligned box; empty while min lies past max.
+struct BoundingBox {
+    QVector3D min{1.0f, 1.0f, 1.0f};
+    QVector3D max{-1.0f, -1.0f, -1.0f};
+
+    BoundingBox() = default;
+    BoundingBox(const QVector3D &minCorner, const QVector3D &maxCorner)
+        : min(minCorner)
+        , max(maxCorner)
+    {
+    }
+
+    bool isEmpty() const { return min.x() > max.x(); }
+    QVector3D centre() const { return (min + max) / 2.0f; }
+
+    void expand(const QVector3D &point);
+    void unite(const BoundingBox &other);
+};
+
+// The clip volume of a view-projection matrix as six inward-facing planes.
+class ViewFrustum
+{
+public:
+    enum Containment {
+        Outside,
+        Intersects,
+        Inside
+    };
+
+    explicit ViewFrustum(const QMatrix4x4 &viewProjection);
+
+    Containment classify(const BoundingBox &box) const;
+
+private:
+    QVector4D m_planes[6];
+};
+
+// Bounding volume hierarchy over a list of boxes, split at the median of
+// the longest axis. Rebuilt whole when the boxes change; finding what a
+// frustum sees skips every subtree whose box lies outside it.
+class BoundingHierarchy
+{
+public:
+    void build(const QVector<BoundingBox> &boxes);
+    void clear();
+
+    // Appends the indices of the boxes the frustum may see, in no
+    // particular order. Empty boxes are never reported.
+    void collectVisible(const ViewFrustum &frustum, QVector<int> *indices) const;
+
+private:
+    struct Node {
+        BoundingBox box;
+        // The subtree holds m_items[first, first + count). Inner nodes
+        // have their first child right after them and the second at
+        // secondChild; leaves have none.
+        int first = 0;
+        int count = 0;
+        int secondChild = -1;
+    };
+
+    int buildNode(const QVector<BoundingBox> &boxes, int first, int count);
+
+    QVector<Node> m_nodes;
+    QVector<int> m_items;
+    // The box of each of m_items.
+    QVector<BoundingBox> m_boxes;
+};
+
+#endif // BOUNDINGHIERARCHY_H
@@ -26,6 +26,7 @@
 #include <QMimeData>
 #include <QPen>
 #include <QRectF>
+#include <QTimer>
 #include <QTransform>
 #include <QVector2D>
 #include <QtGlobal>
@@ -56,14 +57,13 @@ DesignScene::DesignScene(QObject *parent)
     , m_previewFurniture(nullptr)
     , m_hoverWall(nullptr)
     , m_projectCreatedAt()
+    , m_wallIndex()
+    , m_pendingChanges()
+    , m_changeFlushQueued(false)
 {
     setSceneRect(-50000.0, -50000.0, 100000.0, 100000.0);
     initializeHelpers();
     m_projectCreatedAt = QDateTime::currentDateTime().toString(Qt::ISODate);
-
-    connect(this, &QGraphicsScene::changed, this, [this](const QList<QRectF> &) {
-        emit sceneContentChanged();
-    });
 }
 
 void DesignScene::initializeHelpers()
@@ -112,29 +112,57 @@ DesignScene::Mode DesignScene::mode() const
     return m_mode;
 }
 
-bool DesignScene::setBlueprintPixmap(const QPixmap &pixmap)
+bool DesignScene::setBlueprintImage(const QString &path, QString *errorMessage)
 {
-    if (pixmap.isNull()) {
+    auto *blueprint = new BlueprintItem(path);
+    if (blueprint->isNull() || !blueprint->errorMessage().isEmpty()) {
+        if (errorMessage) {
+            *errorMessage = blueprint->isNull()
+                ? QStringLiteral("无法读取底图: %1").arg(path)
+                : blueprint->errorMessage();
+        }
+        delete blueprint;
         return false;
     }
+    connect(blueprint, &BlueprintItem::loadFailed, this,
+            [this, blueprint](const QString &message) {
+                discardBlueprint(blueprint, message);
+            });
 
-    if (!m_blueprintItem) {
-        m_blueprintItem = new BlueprintItem(pixmap);
-        addItem(m_blueprintItem);
-    } else {
-        m_blueprintItem->setPixmap(pixmap);
+    // The scan belongs to the item, so a new image replaces the item but
+    // keeps its calibration.
+    if (m_blueprintItem) {
+        blueprint->setScale(m_blueprintItem->scale());
+        blueprint->setRotation(m_blueprintItem->rotation());
+        reportChange(m_blueprintItem, SceneChange_Removed);
+        delete m_blueprintItem;
     }
+    m_blueprintItem = blueprint;
+    addItem(m_blueprintItem);
+    reportChange(m_blueprintItem, SceneChange_Added);
 
     m_blueprintItem->setZValue(-100.0);
-    m_blueprintItem->setTransformationMode(Qt::SmoothTransformation);
     m_blueprintItem->setOpacity(0.6);
-    m_blueprintItem->setOffset(-pixmap.width() / 2.0, -pixmap.height() / 2.0);
     m_blueprintItem->setTransformOriginPoint(0.0, 0.0);
     m_blueprintItem->setPos(0.0, 0.0);
     m_blueprintItem->setFlag(QGraphicsItem::ItemIsSelectable, true);
     return true;
 }
 
+void DesignScene::discardBlueprint(BlueprintItem *blueprint, const QString &errorMessage)
+{
+    if (blueprint != m_blueprintItem) {
+        return;
+    }
+
+    reportChange(m_blueprintItem, SceneChange_Removed);
+    removeItem(m_blueprintItem);
+    // It is still emitting the signal that got us here.
+    m_blueprintItem->deleteLater();
+    m_blueprintItem = nullptr;
+    emit blueprintFailed(errorMessage);
+}
+
 void DesignScene::setBlueprintOpacity(qreal opacity)
 {
     if (!m_blueprintItem) {
@@ -143,6 +171,7 @@ void DesignScene::setBlueprintOpacity(qreal opacity)
 
     const qreal clamped = qMax(0.0, qMin(1.0, opacity));
     m_blueprintItem->setOpacity(clamped);
+    reportChange(m_blueprintItem, SceneChange_Property);
 }
 
 bool DesignScene::hasBlueprint() const
@@ -165,10 +194,32 @@ void DesignScene::applyCalibration(qreal actualLengthMm)
 
     const qreal factor = actualLengthMm / m_lastCalibrationLength;
     m_blueprintItem->setScale(m_blueprintItem->scale() * factor);
+    reportChange(m_blueprintItem, SceneChange_Geometry);
     resetCalibration();
     setMode(Mode_Select);
 }
 
+void DesignScene::addDetectedWalls(const QVector<WallDetector::Wall> &walls)
+{
+    if (!m_blueprintItem) {
+        return;
+    }
+
+    const QPointF origin = m_blueprintItem->boundingRect().topLeft();
+    const qreal scale = m_blueprintItem->scale();
+    clearSelection();
+    for (const WallDetector::Wall &wall : walls) {
+        // Traced thicknesses are rounded to whole centimetres.
+        const qreal thickness = qMax(10.0, std::round(wall.thickness * scale / 10.0) * 10.0);
+        auto *item = new WallItem(m_blueprintItem->mapToScene(wall.line.p1() + origin),
+                                  m_blueprintItem->mapToScene(wall.line.p2() + origin),
+                                  thickness,
+                                  m_wallHeight);
+        addItem(item);
+        item->setSelected(true);
+    }
+}
+
 void DesignScene::applyWallHeightToAllWalls(qreal height)
 {
     m_wallHeight = height;
@@ -180,70 +231,120 @@ void DesignScene::applyWallHeightToAllWalls(qreal height)
         }
         wall->setHeight(height);
     }
-
-    emit sceneContentChanged();
 }
 
 void DesignScene::notifySceneChanged()
 {
-    emit sceneContentChanged();
+    m_pendingChanges.sceneWide = true;
+    reportChange(nullptr, SceneChangeFlags());
 }
 
-QJsonObject DesignScene::toJson() const
+void DesignScene::reportItemChange(QGraphicsItem *item, SceneChangeFlags flags)
+{
+    // During scene teardown the cast fails and nobody is listening.
+    if (auto *designScene = qobject_cast<DesignScene *>(item->scene())) {
+        designScene->reportChange(item, flags);
+    }
+}
+
+void DesignScene::reportChange(QGraphicsItem *item, SceneChangeFlags flags)
+{
+    if (!m_changeFlushQueued) {
+        m_changeFlushQueued = true;
+        QTimer::singleShot(0, this, &DesignScene::flushChanges);
+    }
+    if (!item || m_pendingChanges.reset) {
+        return;
+    }
+
+    // Drag previews are helpers until they are dropped.
+    if (auto *opening = qgraphicsitem_cast<OpeningItem *>(item)) {
+        if (opening->isPreview()) {
+            return;
+        }
+        // A wall's mesh includes its openings.
+        if (!(flags & SceneChange_Removed) && opening->wall()) {
+            reportChange(opening->wall(), SceneChange_Property);
+        }
+    } else if (auto *furnitureItem = qgraphicsitem_cast<FurnitureItem *>(item)) {
+        if (furnitureItem->isPreview()) {
+            return;
+        }
+    }
+
+    // Added and Removed describe where the item ended up, so the later one wins.
+    SceneChangeFlags &pending = m_pendingChanges.items[item];
+    if (flags & SceneChange_Added) {
+        pending &= ~SceneChangeFlags(SceneChange_Removed);
+    }
+    if (flags & SceneChange_Removed) {
+        pending &= ~SceneChangeFlags(SceneChange_Added);
+    }
+    pending |= flags;
+}
+
+void DesignScene::flushChanges()
 {
-    QJsonObject root;
-    QJsonObject info;
-    info["version"] = QStringLiteral("1.0");
-    const QString createdAt = m_projectCreatedAt.isEmpty()
+    m_changeFlushQueued = false;
+    if (m_pendingChanges.isEmpty()) {
+        return;
+    }
+
+    const SceneChangeSet changes = m_pendingChanges;
+    m_pendingChanges = SceneChangeSet();
+    emit contentChanged(changes);
+}
+
+ProjectSnapshot::Settings DesignScene::settingsSnapshot() const
+{
+    ProjectSnapshot::Settings settings;
+    if (m_blueprintItem) {
+        settings.backgroundImage = m_blueprintItem->sourcePath();
+        settings.pixelRatio = m_blueprintItem->scale();
+        settings.opacity = m_blueprintItem->opacity();
+        settings.rotation = m_blueprintItem->rotation();
+    }
+    return settings;
+}
+
+ProjectSnapshot DesignScene::snapshot() const
+{
+    ProjectSnapshot snapshot;
+    snapshot.createdAt = m_projectCreatedAt.isEmpty()
         ? QDateTime::currentDateTime().toString(Qt::ISODate)
         : m_projectCreatedAt;
-    info["created_at"] = createdAt;
-    root["project_info"] = info;
 
-    QJsonObject settings;
-    if (m_blueprintItem) {
-        settings["background_image"] = m_blueprintItem->sourcePath();
-        settings["pixel_ratio"] = m_blueprintItem->scale();
-        settings["opacity"] = m_blueprintItem->opacity();
-        settings["rotation"] = m_blueprintItem->rotation();
-    } else {
-        settings["background_image"] = QString();
-        settings["pixel_ratio"] = 1.0;
-        settings["opacity"] = 1.0;
-        settings["rotation"] = 0.0;
-    }
-    root["settings"] = settings;
-
-    QJsonArray wallsArray;
-    for (WallItem *wall : walls()) {
-        if (wall) {
-            wallsArray.append(wall->toJson());
-        }
+    snapshot.settings = settingsSnapshot();
+
+    const QList<WallItem *> sceneWalls = walls();
+    snapshot.walls.reserve(sceneWalls.size());
+    for (WallItem *wall : sceneWalls) {
+        snapshot.walls.append(wall->snapshot());
     }
-    root["walls"] = wallsArray;
 
-    QJsonArray openingsArray;
-    for (OpeningItem *opening : openings()) {
-        if (opening) {
-            openingsArray.append(opening->toJson());
-        }
+    const QList<OpeningItem *> sceneOpenings = openings();
+    snapshot.openings.reserve(sceneOpenings.size());
+    for (OpeningItem *opening : sceneOpenings) {
+        snapshot.openings.append(opening->snapshot());
     }
-    root["openings"] = openingsArray;
 
-    QJsonArray furnitureArray;
-    for (FurnitureItem *item : furniture()) {
-        if (item) {
-            furnitureArray.append(item->toJson());
-        }
+    const QList<FurnitureItem *> sceneFurniture = furniture();
+    snapshot.furniture.reserve(sceneFurniture.size());
+    for (FurnitureItem *item : sceneFurniture) {
+        snapshot.furniture.append(item->snapshot());
     }
-    root["furniture"] = furnitureArray;
 
-    return root;
+    return snapshot;
+}
+
+QJsonObject DesignScene::toJson() const
+{
+    return snapshot().toJson();
 }
 
 void DesignScene::fromJson(const QJsonObject &root)
 {
-    resetScene();
+    clearSceneContent();
 
     const QJsonObject info = root.value("project_info").toObject();
     m_projectCreatedAt = info.value("created_at").toString();
@@ -258,10 +359,8 @@ void DesignScene::fromJson(const QJsonObject &root)
     const qreal rotation = settings.value("rotation").toDouble(0.0);
 
     if (!backgroundPath.isEmpty()) {
-        QPixmap pixmap(backgroundPath);
-        if (!pixmap.isNull() && setBlueprintPixmap(pixmap)) {
+        if (setBlueprintImage(backgroundPath)) {
             if (m_blueprintItem) {
-                m_blueprintItem->setSourcePath(backgroundPath);
                 m_blueprintItem->setScale(pixelRatio > 0.0 ? pixelRatio : 1.0);
                 m_blueprintItem->setOpacity(qBound(0.0, opacity, 1.0));
                 m_blueprintItem->setRotation(rotation);
@@ -304,10 +403,21 @@ void DesignScene::fromJson(const QJsonObject &root)
         FurnitureItem *item = FurnitureItem::fromJson(value.toObject());
         addItem(item);
     }
+
+    flushChanges();
 }
 
 void DesignScene::resetScene()
 {
+    clearSceneContent();
+    flushChanges();
+}
+
+void DesignScene::clearSceneContent()
+{
+    // Subscribers resync from scratch, so per-item reports are dropped.
+    m_pendingChanges = SceneChangeSet();
+    m_pendingChanges.reset = true;
     clear();
     setSceneRect(-50000.0, -50000.0, 100000.0, 100000.0);
     m_blueprintItem = nullptr;
@@ -386,6 +496,11 @@ BlueprintItem *DesignScene::blueprintItem() const
     return m_blueprintItem;
 }
 
+WallIndex *DesignScene::wallIndex()
+{
+    return &m_wallIndex;
+}
+
 void DesignScene::setSnapEnabled(bool enabled)
 {
     m_snapEnabled = enabled;
@@ -772,7 +887,7 @@ void DesignScene::dropEvent(QGraphicsSceneDragDropEvent *event)
             m_hoverWall->addOpening(m_previewOpening);
             clearSelection();  // 清除之前的选择
             m_previewOpening->setSelected(true);
-            notifySceneChanged();
+            reportChange(m_previewOpening, SceneChange_Added);
             m_previewOpening = nullptr;
             updateHoverWall(nullptr);
         } else {
@@ -788,7 +903,7 @@ void DesignScene::dropEvent(QGraphicsSceneDragDropEvent *event)
             m_previewFurniture->setPreview(false);
             clearSelection();  // 清除之前的选择
             m_previewFurniture->setSelected(true);
-            notifySceneChanged();
+            reportChange(m_previewFurniture, SceneChange_Added);
             m_previewFurniture = nullptr;
         }
         event->acceptProposedAction();
@@ -903,7 +1018,7 @@ QPointF DesignScene::snapPosition(const QPointF &pos, bool *snapped)
     QPointF best = pos;
     qreal bestDist = m_snapTolerance + 1.0;
 
-    const QList<WallItem *> walls = wallItems();
+    const QList<WallItem *> walls = wallsNear(pos, bestDist);
     for (WallItem *wall : walls) {
         const QPointF start = wall->startPos();
         const QPointF end = wall->endPos();
@@ -963,15 +1078,11 @@ QPointF DesignScene::snapPosition(const QPointF &pos, bool *snapped)
     return isSnapped ? best : pos;
 }
 
-QList<WallItem *> DesignScene::wallItems() const
+QList<WallItem *> DesignScene::wallsNear(const QPointF &pos, qreal radius) const
 {
     QList<WallItem *> result;
-    const QList<QGraphicsItem *> sceneItems = items();
-    for (QGraphicsItem *item : sceneItems) {
-        auto *wall = qgraphicsitem_cast<WallItem *>(item);
-        if (!wall) {
-            continue;
-        }
+    const QList<WallItem *> candidates = m_wallIndex.wallsNear(pos, radius);
+    for (WallItem *wall : candidates) {
         if (wall == m_activeWall || wall == m_editWall) {
             continue;
         }
@@ -1020,13 +1131,8 @@ bool DesignScene::tryBeginEdit(const QPointF &scenePos)
     EditHandle closestHandle = Handle_None;
     qreal bestDist = handleRadius;
 
-    const QList<QGraphicsItem *> sceneItems = items();
-    for (QGraphicsItem *item : sceneItems) {
-        auto *wall = qgraphicsitem_cast<WallItem *>(item);
-        if (!wall) {
-            continue;
-        }
-
+    const QList<WallItem *> candidates = m_wallIndex.wallsNear(scenePos, handleRadius);
+    for (WallItem *wall : candidates) {
         const qreal distStart = QLineF(scenePos, wall->startPos()).length();
         if (distStart < bestDist) {
             bestDist = distStart;
@@ -1110,7 +1216,7 @@ WallItem *DesignScene::findWallNear(const QPointF &pos,
     qreal bestDistance = maxDistance;
     qreal bestAlong = 0.0;
 
-    const QList<WallItem *> walls = wallItems();
+    const QList<WallItem *> walls = wallsNear(pos, maxDistance);
     for (WallItem *wall : walls) {
         if (!wall) {
             continue;
@@ -1,9 +1,13 @@
 #ifndef DESIGNSCENE_H
 #define DESIGNSCENE_H
 
+#include "projectsnapshot.h"
+#include "scenechange.h"
+#include "walldetector.h"
+#include "wallindex.h"
+
 #include <QGraphicsScene>
 #include <QList>
-#include <QPixmap>
 #include <QString>
 #include <QVector2D>
 
@@ -32,15 +36,30 @@ public:
     void setMode(Mode mode);
     Mode mode() const;
 
-    bool setBlueprintPixmap(const QPixmap &pixmap);
+    // Only the image header is read here; the scan is tiled in the
+    // background. If tiling fails later, the blueprint is removed again and
+    // blueprintFailed() emitted.
+    bool setBlueprintImage(const QString &path, QString *errorMessage = nullptr);
     void setBlueprintOpacity(qreal opacity);
     bool hasBlueprint() const;
 
     void setWallDefaults(qreal thickness, qreal height);
     void applyCalibration(qreal actualLengthMm);
+    // Adds walls traced on the blueprint, placed by its calibration, and
+    // selects them for review.
+    void addDetectedWalls(const QVector<WallDetector::Wall> &walls);
     void applyWallHeightToAllWalls(qreal height);
     void notifySceneChanged();
 
+    // Items call this when they change; the scene coalesces reports and
+    // emits contentChanged() once per event-loop turn.
+    static void reportItemChange(QGraphicsItem *item, SceneChangeFlags flags);
+    void reportChange(QGraphicsItem *item, SceneChangeFlags flags);
+    // Delivers pending changes now instead of on the next turn.
+    void flushChanges();
+
+    ProjectSnapshot::Settings settingsSnapshot() const;
+    ProjectSnapshot snapshot() const;
     QJsonObject toJson() const;
     void fromJson(const QJsonObject &root);
     void resetScene();
@@ -48,16 +67,25 @@ public:
     QList<OpeningItem *> openings() const;
     QList<FurnitureItem *> furniture() const;
     BlueprintItem *blueprintItem() const;
+    WallIndex *wallIndex();
 
     void setSnapEnabled(bool enabled);
     bool snapEnabled() const;
     void setSnapToGridEnabled(bool enabled);
     bool snapToGridEnabled() const;
+    // Where a cursor at pos lands while drawing, as the drawing tools snap
+    // it.
+    QPointF snapPosition(const QPointF &pos, bool *snapped);
+    // The wall closest to pos within maxDistance, as openings are placed.
+    WallItem *findWallNear(const QPointF &pos,
+                           qreal maxDistance,
+                           qreal *distanceAlong = nullptr) const;
 
 signals:
-    void sceneContentChanged();
+    void contentChanged(const SceneChangeSet &changes);
     void modeChanged(Mode mode);
     void calibrationRequested(qreal measuredLength);
+    void blueprintFailed(const QString &errorMessage);
 
 protected:
     void mousePressEvent(QGraphicsSceneMouseEvent *event) override;
@@ -80,19 +108,17 @@ private:
                              const QPointF &anchor,
                              bool orthogonal,
                              bool *snapped);
-    QPointF snapPosition(const QPointF &pos, bool *snapped);
-    QList<WallItem *> wallItems() const;
+    QList<WallItem *> wallsNear(const QPointF &pos, qreal radius) const;
     void updateSnapIndicator(const QPointF &pos, bool visible);
     void updateLengthIndicator();
     bool tryBeginEdit(const QPointF &scenePos);
     bool tryBeginDrag(const QPointF &scenePos);
     void initializeHelpers();
+    void clearSceneContent();
+    void discardBlueprint(BlueprintItem *blueprint, const QString &errorMessage);
 
     void finalizeWall(const QPointF &endPos, bool applyEndPos);
     void resetCalibration();
-    WallItem *findWallNear(const QPointF &pos,
-                           qreal maxDistance,
-                           qreal *distanceAlong = nullptr) const;
     void updateHoverWall(WallItem *wall);
     void clearOpeningPreview();
     void clearFurniturePreview();
@@ -122,6 +148,9 @@ private:
     FurnitureItem *m_previewFurniture;
     WallItem *m_hoverWall;
     QString m_projectCreatedAt;
+    WallIndex m_wallIndex;
+    SceneChangeSet m_pendingChanges;
+    bool m_changeFlushQueued;
 };
 
 #endif // DESIGNSCENE_H
@@ -1,5 +1,7 @@
 ﻿#include "furnitureitem.h"
 #include "designscene.h"
+#include "levelofdetail.h"
+#include "meshrevision.h"
 
 #include <QGraphicsSceneMouseEvent>
 #include <QJsonArray>
@@ -8,6 +10,7 @@
 #include <QPainter>
 #include <QStyleOptionGraphicsItem>
 #include <QSvgRenderer>
+#include <QUuid>
 #include <QtMath>
 #include <cmath>
 
@@ -17,10 +20,13 @@ constexpr qreal kHandleRadius = 4.5;
 constexpr qreal kRotateHandleOffset = 16.0;
 constexpr qreal kRotateSnapStep = 45.0;
 constexpr qreal kRotateSnapThreshold = 6.0;
+// Past this size on screen the symbol is drawn as vectors instead.
+constexpr int kMaxSymbolPixels = 2048;
 } // namespace
 
 FurnitureItem::FurnitureItem(const QString &assetId, QGraphicsItem *parent)
     : QGraphicsSvgItem(parent)
+    , m_id(QUuid::createUuid().toString(QUuid::WithoutBraces))
     , m_assetId(assetId)
     , m_asset()
     , m_size2D(300.0, 300.0)
@@ -31,6 +37,7 @@ FurnitureItem::FurnitureItem(const QString &assetId, QGraphicsItem *parent)
     , m_preview(false)
     , m_dragMode(DragMode::None)
     , m_dragStartSize(300.0, 300.0)
+    , m_meshRevision(nextMeshRevision())
 {
     setFlags(QGraphicsItem::ItemIsSelectable
              | QGraphicsItem::ItemIsMovable
@@ -46,6 +53,23 @@ FurnitureItem::FurnitureItem(const QString &assetId, QGraphicsItem *parent)
     }
 }
 
+FurnitureItem::~FurnitureItem()
+{
+    DesignScene::reportItemChange(this, SceneChange_Removed);
+}
+
+QString FurnitureItem::id() const
+{
+    return m_id;
+}
+
+void FurnitureItem::setId(const QString &id)
+{
+    if (!id.isEmpty()) {
+        m_id = id;
+    }
+}
+
 QString FurnitureItem::assetId() const
 {
     return m_assetId;
@@ -76,6 +100,7 @@ bool FurnitureItem::isPreview() const
 void FurnitureItem::setElevation(qreal elevation)
 {
     m_elevation = elevation;
+    markMeshChanged(SceneChange_Geometry);
 }
 
 qreal FurnitureItem::elevation() const
@@ -86,6 +111,7 @@ qreal FurnitureItem::elevation() const
 void FurnitureItem::setRotationDegrees(qreal angle)
 {
     m_rotation = std::fmod(angle + 360.0, 360.0);
+    markMeshChanged(SceneChange_Geometry);
     setRotation(m_rotation);
     update();
 }
@@ -106,6 +132,7 @@ void FurnitureItem::setSize2D(const QSizeF &size)
     }
     prepareGeometryChange();
     m_size2D = clamped;
+    markMeshChanged(SceneChange_Geometry);
     updateGeometry();
 }
 
@@ -117,6 +144,7 @@ QSizeF FurnitureItem::size2D() const
 void FurnitureItem::setHeight3D(qreal height)
 {
     m_height3D = qMax(10.0, height);
+    markMeshChanged(SceneChange_Geometry);
 }
 
 qreal FurnitureItem::height3D() const
@@ -127,6 +155,7 @@ qreal FurnitureItem::height3D() const
 void FurnitureItem::setScale3D(const QVector3D &scale)
 {
     m_scale3D = scale;
+    markMeshChanged(SceneChange_Geometry);
 }
 
 QVector3D FurnitureItem::scale3D() const
@@ -176,23 +205,30 @@ QString FurnitureItem::material() const
     return m_asset.material;
 }
 
+ProjectSnapshot::Furniture FurnitureItem::snapshot() const
+{
+    ProjectSnapshot::Furniture furniture;
+    furniture.id = m_id;
+    furniture.modelId = m_assetId;
+    furniture.pos = pos();
+    furniture.rotation = m_rotation;
+    furniture.scale = m_scale3D;
+    furniture.elevation = m_elevation;
+    furniture.size = m_size2D;
+    furniture.height = m_height3D;
+    return furniture;
+}
+
 QJsonObject FurnitureItem::toJson() const
 {
-    QJsonObject obj;
-    obj["model_id"] = m_assetId;
-    obj["pos"] = QJsonArray{pos().x(), pos().y()};
-    obj["rotate"] = m_rotation;
-    obj["scale"] = QJsonArray{m_scale3D.x(), m_scale3D.y(), m_scale3D.z()};
-    obj["elevation"] = m_elevation;
-    obj["size"] = QJsonArray{m_size2D.width(), m_size2D.height()};
-    obj["height"] = m_height3D;
-    return obj;
+    return ProjectSnapshot::toJson(snapshot());
 }
 
 FurnitureItem *FurnitureItem::fromJson(const QJsonObject &json)
 {
     const QString assetId = json.value("model_id").toString();
     FurnitureItem *item = new FurnitureItem(assetId);
+    item->setId(json.value("id").toString());
 
     const QJsonArray posArray = json.value("pos").toArray();
     item->setPos(QPointF(posArray.size() > 0 ? posArray.at(0).toDouble() : 0.0,
@@ -231,6 +267,11 @@ QMatrix4x4 FurnitureItem::transformMatrix() const
     return matrix;
 }
 
+quint64 FurnitureItem::meshRevision() const
+{
+    return m_meshRevision;
+}
+
 QRectF FurnitureItem::boundingRect() const
 {
     return QRectF(-m_size2D.width() / 2.0,
@@ -248,8 +289,19 @@ void FurnitureItem::paint(QPainter *painter,
 
     painter->setRenderHint(QPainter::Antialiasing, true);
 
-    if (renderer() && renderer()->isValid()) {
-        renderer()->render(painter, boundingRect());
+    const qreal extent = qMax(m_size2D.width(), m_size2D.height());
+    if (symbolDetail(painter, extent) != SymbolDetail::Full) {
+        // A filled footprint keeps the layout readable without touching the
+        // SVG at all.
+        painter->fillRect(boundingRect(), QColor(196, 206, 216));
+    } else if (renderer() && renderer()->isValid()) {
+        const QPixmap symbol = symbolPixmap(painter);
+        if (!symbol.isNull()) {
+            painter->setRenderHint(QPainter::SmoothPixmapTransform, true);
+            painter->drawPixmap(boundingRect(), symbol, QRectF(symbol.rect()));
+        } else {
+            renderer()->render(painter, boundingRect());
+        }
     } else {
         painter->setPen(QPen(QColor(47, 110, 143), 1.5));
         painter->setBrush(Qt::NoBrush);
@@ -280,6 +332,13 @@ QVariant FurnitureItem::itemChange(GraphicsItemChange change, const QVariant &va
     if (change == QGraphicsItem::ItemSelectedHasChanged) {
         update();
     }
+    if (change == QGraphicsItem::ItemPositionHasChanged) {
+        markMeshChanged(SceneChange_Geometry);
+    } else if (change == QGraphicsItem::ItemSceneChange) {
+        DesignScene::reportItemChange(this, SceneChange_Removed);
+    } else if (change == QGraphicsItem::ItemSceneHasChanged) {
+        DesignScene::reportItemChange(this, SceneChange_Added);
+    }
     return QGraphicsSvgItem::itemChange(change, value);
 }
 
@@ -344,13 +403,11 @@ void FurnitureItem::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
 {
     if (m_dragMode != DragMode::Move) {
         m_dragMode = DragMode::None;
-        notifySceneChanged();
         event->accept();
         return;
     }
 
     QGraphicsSvgItem::mouseReleaseEvent(event);
-    notifySceneChanged();
 }
 
 void FurnitureItem::loadAsset(const AssetManager::Asset &asset)
@@ -359,12 +416,12 @@ void FurnitureItem::loadAsset(const AssetManager::Asset &asset)
     m_assetId = asset.id;
 
     if (!asset.svgPath.isEmpty()) {
-        auto *svg = new QSvgRenderer(asset.svgPath, this);
-        setSharedRenderer(svg);
+        setSharedRenderer(AssetManager::instance()->svgRenderer(asset.svgPath));
     }
 
     m_size2D = QSizeF(asset.defaultSize.x(), asset.defaultSize.y());
     m_height3D = asset.defaultSize.z();
+    markMeshChanged(SceneChange_Property);
     updateGeometry();
 }
 
@@ -409,6 +466,26 @@ qreal FurnitureItem::snappedAngle(qreal angle) const
     return normalized;
 }
 
+QPixmap FurnitureItem::symbolPixmap(const QPainter *painter) const
+{
+    const qreal scale =
+        QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform())
+        * painter->device()->devicePixelRatioF();
+    if (scale <= 0.0) {
+        return QPixmap();
+    }
+
+    // Zoom levels share one raster per power of two, so a zoom gesture only
+    // rasterizes a few times, and the blit only ever scales down.
+    const qreal bucket = qPow(2.0, std::ceil(std::log2(scale)));
+    const QSize pixels(qCeil(m_size2D.width() * bucket), qCeil(m_size2D.height() * bucket));
+    if (pixels.isEmpty() || pixels.width() > kMaxSymbolPixels
+        || pixels.height() > kMaxSymbolPixels) {
+        return QPixmap();
+    }
+    return AssetManager::instance()->symbolPixmap(m_asset.svgPath, pixels);
+}
+
 void FurnitureItem::updateGeometry()
 {
     setTransformOriginPoint(0.0, 0.0);
@@ -416,13 +493,8 @@ void FurnitureItem::updateGeometry()
     update();
 }
 
-void FurnitureItem::notifySceneChanged()
+void FurnitureItem::markMeshChanged(SceneChangeFlags flags)
 {
-    if (m_preview) {
-        return;
-    }
-    auto *designScene = qobject_cast<DesignScene *>(scene());
-    if (designScene) {
-        designScene->notifySceneChanged();
-    }
+    m_meshRevision = nextMeshRevision();
+    DesignScene::reportItemChange(this, flags);
 }
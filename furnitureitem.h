@@ -3,10 +3,13 @@
 
 #include <QGraphicsSvgItem>
 #include <QMatrix4x4>
+#include <QPixmap>
 #include <QSizeF>
 #include <QVector3D>
 
 #include "assetmanager.h"
+#include "projectsnapshot.h"
+#include "scenechange.h"
 
 class QJsonObject;
 
@@ -17,6 +20,10 @@ public:
     int type() const override { return Type; }
 
     explicit FurnitureItem(const QString &assetId, QGraphicsItem *parent = nullptr);
+    ~FurnitureItem() override;
+
+    QString id() const;
+    void setId(const QString &id);
 
     QString assetId() const;
     const AssetManager::Asset &asset() const;
@@ -45,10 +52,12 @@ public:
 
     QString material() const;
 
+    ProjectSnapshot::Furniture snapshot() const;
     QJsonObject toJson() const;
     static FurnitureItem *fromJson(const QJsonObject &json);
 
     QMatrix4x4 transformMatrix() const;
+    quint64 meshRevision() const;
 
     QRectF boundingRect() const override;
     void paint(QPainter *painter,
@@ -75,9 +84,11 @@ private:
     QList<QRectF> scaleHandleRects() const;
     QPointF itemCenter() const;
     qreal snappedAngle(qreal angle) const;
+    QPixmap symbolPixmap(const QPainter *painter) const;
     void updateGeometry();
-    void notifySceneChanged();
+    void markMeshChanged(SceneChangeFlags flags);
 
+    QString m_id;
     QString m_assetId;
     AssetManager::Asset m_asset;
     QSizeF m_size2D;
@@ -88,6 +99,7 @@ private:
     bool m_preview;
     DragMode m_dragMode;
     QSizeF m_dragStartSize;
+    quint64 m_meshRevision;
 };
 
 #endif // FURNITUREITEM_H
@@ -0,0 +1,686 @@
+#include "imagebandreader.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QImageReader>
+#include <QVector>
+#include <QtEndian>
+
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+
+#include <jpeglib.h>
+#include <zlib.h>
+
+namespace {
+// Compressed bytes read from the file at a time.
+constexpr qint64 kInputBytes = 64 * 1024;
+// Largest image decoded whole, for formats that cannot be read by rows:
+// 512 MiB of ARGB32, about 11500 pixels square.
+constexpr qint64 kMaxWholeBytes = 512LL * 1024 * 1024;
+const char kPngSignature[] = "\x89PNG\r\n\x1a\n";
+
+int paeth(int left, int up, int upLeft)
+{
+    const int estimate = left + up - upLeft;
+    const int toLeft = qAbs(estimate - left);
+    const int toUp = qAbs(estimate - up);
+    const int toUpLeft = qAbs(estimate - upLeft);
+    if (toLeft <= toUp && toLeft <= toUpLeft) {
+        return left;
+    }
+    return toUp <= toUpLeft ? up : upLeft;
+}
+} // namespace
+
+// Produces an image's rows in order.
+class ImageBandDecoder
+{
+public:
+    virtual ~ImageBandDecoder() = default;
+
+    // Reads the header; an invalid size on failure. errorMessage is only
+    // set when there is more to say than that the file is unreadable.
+    virtual QSize open(QString *errorMessage) = 0;
+    // Fills every row of band, which is Format_ARGB32.
+    virtual bool read(QImage &band) = 0;
+};
+
+namespace {
+// PNG without interlacing, inflated one row at a time.
+class PngBandDecoder : public ImageBandDecoder
+{
+public:
+    explicit PngBandDecoder(const QString &path)
+        : m_file(path)
+    {
+    }
+
+    ~PngBandDecoder() override
+    {
+        if (m_inflating) {
+            inflateEnd(&m_stream);
+        }
+    }
+
+    QSize open(QString *errorMessage) override;
+    bool read(QImage &band) override;
+
+private:
+    bool readChunkHeader(quint32 *length, QByteArray *type);
+    bool fillInput();
+    bool inflateRow();
+    bool unfilterRow();
+    int sample(int index) const;
+    int toByte(int value) const;
+    void convertRow(QRgb *out) const;
+
+    QFile m_file;
+    z_stream m_stream{};
+    bool m_inflating = false;
+    int m_width = 0;
+    int m_depth = 0;
+    int m_colorType = 0;
+    int m_channels = 0;
+    // Bytes per whole pixel, at least one; the filters work in these.
+    int m_pixelBytes = 0;
+    QVector<QRgb> m_palette;
+    // tRNS colour key of grey and RGB images, in raw samples.
+    QVector<int> m_key;
+    quint32 m_dataLeft = 0;
+    QByteArray m_input;
+    // The filter byte and the row as inflated.
+    QByteArray m_filtered;
+    // The unfiltered row, also the row above for the next one.
+    QByteArray m_row;
+};
+
+QSize PngBandDecoder::open(QString *errorMessage)
+{
+    Q_UNUSED(errorMessage);
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.read(8) != QByteArray(kPngSignature, 8)) {
+        return QSize();
+    }
+
+    quint32 length = 0;
+    QByteArray type;
+    if (!readChunkHeader(&length, &type) || type != "IHDR" || length != 13) {
+        return QSize();
+    }
+    const QByteArray header = m_file.read(13 + 4);
+    if (header.size() != 13 + 4) {
+        return QSize();
+    }
+    const uchar *fields = reinterpret_cast<const uchar *>(header.constData());
+    const quint32 width = qFromBigEndian<quint32>(fields);
+    const quint32 height = qFromBigEndian<quint32>(fields + 4);
+    m_depth = fields[8];
+    m_colorType = fields[9];
+    // Compression, filter method and interlacing: Adam7 rows do not come
+    // in image order.
+    if (fields[10] != 0 || fields[11] != 0 || fields[12] != 0) {
+        return QSize();
+    }
+    if (width == 0 || height == 0 || width > 0x7fffffff / 8 || height > 0x7fffffff) {
+        return QSize();
+    }
+
+    switch (m_colorType) {
+    case 0:
+        m_channels = 1;
+        break;
+    case 2:
+        m_channels = 3;
+        break;
+    case 3:
+        m_channels = 1;
+        break;
+    case 4:
+        m_channels = 2;
+        break;
+    case 6:
+        m_channels = 4;
+        break;
+    default:
+        return QSize();
+    }
+    const bool subByte = m_depth == 1 || m_depth == 2 || m_depth == 4;
+    const bool validDepth = m_colorType == 0 ? subByte || m_depth == 8 || m_depth == 16
+                          : m_colorType == 3 ? subByte || m_depth == 8
+                                             : m_depth == 8 || m_depth == 16;
+    if (!validDepth) {
+        return QSize();
+    }
+    m_width = static_cast<int>(width);
+    m_pixelBytes = qMax(1, m_channels * m_depth / 8);
+    const qsizetype rowBytes = (static_cast<qsizetype>(m_width) * m_channels * m_depth + 7) / 8;
+
+    m_palette.fill(qRgb(0, 0, 0), 256);
+    for (;;) {
+        if (!readChunkHeader(&length, &type) || type == "IEND") {
+            return QSize();
+        }
+        if (type == "IDAT") {
+            m_dataLeft = length;
+            break;
+        }
+        const QByteArray data = m_file.read(static_cast<qint64>(length) + 4);
+        if (data.size() != static_cast<qsizetype>(length) + 4) {
+            return QSize();
+        }
+        const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+        if (type == "PLTE") {
+            for (quint32 i = 0; i < qMin<quint32>(length / 3, 256); ++i) {
+                m_palette[i] = qRgb(bytes[i * 3], bytes[i * 3 + 1], bytes[i * 3 + 2]);
+            }
+        } else if (type == "tRNS") {
+            if (m_colorType == 3) {
+                for (quint32 i = 0; i < qMin<quint32>(length, 256); ++i) {
+                    m_palette[i] = qRgba(qRed(m_palette.at(i)), qGreen(m_palette.at(i)),
+                                         qBlue(m_palette.at(i)), bytes[i]);
+                }
+            } else if ((m_colorType == 0 || m_colorType == 2) && length == quint32(2 * m_channels)) {
+                for (int i = 0; i < m_channels; ++i) {
+                    m_key.append(qFromBigEndian<quint16>(bytes + i * 2));
+                }
+            }
+        }
+    }
+
+    if (inflateInit(&m_stream) != Z_OK) {
+        return QSize();
+    }
+    m_inflating = true;
+    m_filtered.resize(rowBytes + 1);
+    m_row.fill(0, rowBytes);
+    return QSize(m_width, static_cast<int>(height));
+}
+
+bool PngBandDecoder::read(QImage &band)
+{
+    for (int y = 0; y < band.height(); ++y) {
+        if (!inflateRow() || !unfilterRow()) {
+            return false;
+        }
+        convertRow(reinterpret_cast<QRgb *>(band.scanLine(y)));
+    }
+    return true;
+}
+
+bool PngBandDecoder::readChunkHeader(quint32 *length, QByteArray *type)
+{
+    const QByteArray header = m_file.read(8);
+    if (header.size() != 8) {
+        return false;
+    }
+    *length = qFromBigEndian<quint32>(header.constData());
+    *type = header.mid(4);
+    return *length <= 0x7fffffff;
+}
+
+// Points the stream at the next piece of image data. The data may be split
+// over any number of IDAT chunks; their CRCs are not checked.
+bool PngBandDecoder::fillInput()
+{
+    while (m_dataLeft == 0) {
+        quint32 length = 0;
+        QByteArray type;
+        if (m_file.read(4).size() != 4 || !readChunkHeader(&length, &type) || type != "IDAT") {
+            return false;
+        }
+        m_dataLeft = length;
+    }
+    m_input = m_file.read(qMin<qint64>(m_dataLeft, kInputBytes));
+    if (m_input.isEmpty()) {
+        return false;
+    }
+    m_dataLeft -= static_cast<quint32>(m_input.size());
+    m_stream.next_in = reinterpret_cast<Bytef *>(m_input.data());
+    m_stream.avail_in = static_cast<uInt>(m_input.size());
+    return true;
+}
+
+bool PngBandDecoder::inflateRow()
+{
+    m_stream.next_out = reinterpret_cast<Bytef *>(m_filtered.data());
+    m_stream.avail_out = static_cast<uInt>(m_filtered.size());
+    while (m_stream.avail_out > 0) {
+        if (m_stream.avail_in == 0 && !fillInput()) {
+            return false;
+        }
+        const int status = inflate(&m_stream, Z_NO_FLUSH);
+        if (status == Z_STREAM_END) {
+            return m_stream.avail_out == 0;
+        }
+        if (status != Z_OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PngBandDecoder::unfilterRow()
+{
+    const uchar *in = reinterpret_cast<const uchar *>(m_filtered.constData()) + 1;
+    uchar *row = reinterpret_cast<uchar *>(m_row.data());
+    const int bytes = static_cast<int>(m_row.size());
+    const int step = m_pixelBytes;
+
+    // row still holds the row above, so each byte is replaced in place
+    // after its left and upper neighbours have been used.
+    switch (m_filtered.at(0)) {
+    case 0:
+        std::memcpy(row, in, bytes);
+        break;
+    case 1:
+        for (int i = 0; i < bytes; ++i) {
+            row[i] = static_cast<uchar>(in[i] + (i >= step ? row[i - step] : 0));
+        }
+        break;
+    case 2:
+        for (int i = 0; i < bytes; ++i) {
+            row[i] = static_cast<uchar>(in[i] + row[i]);
+        }
+        break;
+    case 3:
+        for (int i = 0; i < bytes; ++i) {
+            const int left = i >= step ? row[i - step] : 0;
+            row[i] = static_cast<uchar>(in[i] + (left + row[i]) / 2);
+        }
+        break;
+    case 4: {
+        // The upper-left byte is overwritten before it is needed, so it
+        // is carried along per byte of the pixel.
+        uchar upLeft[8] = {};
+        for (int i = 0; i < bytes; ++i) {
+            const int left = i >= step ? row[i - step] : 0;
+            const int up = row[i];
+            row[i] = static_cast<uchar>(in[i] + paeth(left, up, i >= step ? upLeft[i % step] : 0));
+            upLeft[i % step] = static_cast<uchar>(up);
+        }
+        break;
+    }
+    default:
+        return false;
+    }
+    return true;
+}
+
+// Sample index of the row, at the image's bit depth.
+int PngBandDecoder::sample(int index) const
+{
+    const uchar *row = reinterpret_cast<const uchar *>(m_row.constData());
+    switch (m_depth) {
+    case 8:
+        return row[index];
+    case 16:
+        return (row[index * 2] << 8) | row[index * 2 + 1];
+    default: {
+        const int bit = index * m_depth;
+        const int shift = 8 - m_depth - bit % 8;
+        return (row[bit / 8] >> shift) & ((1 << m_depth) - 1);
+    }
+    }
+}
+
+int PngBandDecoder::toByte(int value) const
+{
+    switch (m_depth) {
+    case 8:
+        return value;
+    case 16:
+        return value >> 8;
+    default:
+        return value * 255 / ((1 << m_depth) - 1);
+    }
+}
+
+void PngBandDecoder::convertRow(QRgb *out) const
+{
+    for (int x = 0; x < m_width; ++x) {
+        const int first = x * m_channels;
+        switch (m_colorType) {
+        case 0: {
+            const int grey = sample(first);
+            const int alpha = !m_key.isEmpty() && grey == m_key.at(0) ? 0 : 255;
+            out[x] = qRgba(toByte(grey), toByte(grey), toByte(grey), alpha);
+            break;
+        }
+        case 2: {
+            const int red = sample(first);
+            const int green = sample(first + 1);
+            const int blue = sample(first + 2);
+            const bool keyed = !m_key.isEmpty() && red == m_key.at(0)
+                               && green == m_key.at(1) && blue == m_key.at(2);
+            out[x] = qRgba(toByte(red), toByte(green), toByte(blue), keyed ? 0 : 255);
+            break;
+        }
+        case 3:
+            out[x] = m_palette.at(sample(first));
+            break;
+        case 4: {
+            const int grey = toByte(sample(first));
+            out[x] = qRgba(grey, grey, grey, toByte(sample(first + 1)));
+            break;
+        }
+        default:
+            out[x] = qRgba(toByte(sample(first)), toByte(sample(first + 1)),
+                           toByte(sample(first + 2)), toByte(sample(first + 3)));
+            break;
+        }
+    }
+}
+
+// libjpeg reports fatal errors through error_exit, which must not return.
+struct JpegError {
+    jpeg_error_mgr manager;
+    std::jmp_buf jump;
+};
+
+void jpegErrorExit(j_common_ptr info)
+{
+    std::longjmp(reinterpret_cast<JpegError *>(info->err)->jump, 1);
+}
+
+void jpegOutputMessage(j_common_ptr)
+{
+}
+
+// Feeds libjpeg from a QFile, so paths are not limited to the local
+// codepage and the file is never read whole.
+struct JpegSource {
+    jpeg_source_mgr manager;
+    QFile *file;
+    QByteArray buffer;
+};
+
+void jpegInitSource(j_decompress_ptr)
+{
+}
+
+boolean jpegFillInput(j_decompress_ptr info)
+{
+    static const JOCTET endOfImage[2] = {0xFF, JPEG_EOI};
+    auto *source = reinterpret_cast<JpegSource *>(info->src);
+    source->buffer = source->file->read(kInputBytes);
+    if (source->buffer.isEmpty()) {
+        // A truncated file ends the image; the missing rows stay grey.
+        source->manager.next_input_byte = endOfImage;
+        source->manager.bytes_in_buffer = 2;
+    } else {
+        source->manager.next_input_byte = reinterpret_cast<const JOCTET *>(source->buffer.constData());
+        source->manager.bytes_in_buffer = static_cast<size_t>(source->buffer.size());
+    }
+    return TRUE;
+}
+
+void jpegSkipInput(j_decompress_ptr info, long count)
+{
+    auto *source = reinterpret_cast<JpegSource *>(info->src);
+    while (count > static_cast<long>(source->manager.bytes_in_buffer)) {
+        count -= static_cast<long>(source->manager.bytes_in_buffer);
+        jpegFillInput(info);
+    }
+    if (count > 0) {
+        source->manager.next_input_byte += count;
+        source->manager.bytes_in_buffer -= static_cast<size_t>(count);
+    }
+}
+
+void jpegTermSource(j_decompress_ptr)
+{
+}
+
+// Baseline or progressive JPEG, read by scanlines. Progressive files are
+// buffered by libjpeg as coefficients, a fraction of the decoded size.
+class JpegBandDecoder : public ImageBandDecoder
+{
+public:
+    explicit JpegBandDecoder(const QString &path)
+        : m_file(path)
+    {
+    }
+
+    ~JpegBandDecoder() override
+    {
+        if (m_created) {
+            jpeg_destroy_decompress(&m_info);
+        }
+    }
+
+    QSize open(QString *errorMessage) override;
+    bool read(QImage &band) override;
+
+private:
+    QFile m_file;
+    jpeg_decompress_struct m_info{};
+    JpegError m_error{};
+    JpegSource m_source{};
+    bool m_created = false;
+    QByteArray m_row;
+};
+
+QSize JpegBandDecoder::open(QString *errorMessage)
+{
+    Q_UNUSED(errorMessage);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return QSize();
+    }
+
+    m_info.err = jpeg_std_error(&m_error.manager);
+    m_error.manager.error_exit = jpegErrorExit;
+    m_error.manager.output_message = jpegOutputMessage;
+    if (setjmp(m_error.jump)) {
+        return QSize();
+    }
+    jpeg_create_decompress(&m_info);
+    m_created = true;
+
+    m_source.file = &m_file;
+    m_source.manager.init_source = jpegInitSource;
+    m_source.manager.fill_input_buffer = jpegFillInput;
+    m_source.manager.skip_input_data = jpegSkipInput;
+    m_source.manager.resync_to_restart = jpeg_resync_to_restart;
+    m_source.manager.term_source = jpegTermSource;
+    m_info.src = &m_source.manager;
+
+    jpeg_read_header(&m_info, TRUE);
+    // Every libjpeg converts YCbCr to RGB; grey and CMYK are expanded here.
+    switch (m_info.jpeg_color_space) {
+    case JCS_GRAYSCALE:
+        m_info.out_color_space = JCS_GRAYSCALE;
+        break;
+    case JCS_CMYK:
+    case JCS_YCCK:
+        m_info.out_color_space = JCS_CMYK;
+        break;
+    default:
+        m_info.out_color_space = JCS_RGB;
+        break;
+    }
+    jpeg_start_decompress(&m_info);
+    m_row.resize(static_cast<qsizetype>(m_info.output_width) * m_info.output_components);
+    return QSize(static_cast<int>(m_info.output_width), static_cast<int>(m_info.output_height));
+}
+
+bool JpegBandDecoder::read(QImage &band)
+{
+    if (setjmp(m_error.jump)) {
+        return false;
+    }
+    for (int y = 0; y < band.height(); ++y) {
+        JSAMPROW row = reinterpret_cast<JSAMPROW>(m_row.data());
+        if (jpeg_read_scanlines(&m_info, &row, 1) != 1) {
+            return false;
+        }
+        QRgb *out = reinterpret_cast<QRgb *>(band.scanLine(y));
+        const uchar *in = row;
+        for (int x = 0; x < band.width(); ++x) {
+            switch (m_info.output_components) {
+            case 1:
+                out[x] = qRgb(in[0], in[0], in[0]);
+                break;
+            case 3:
+                out[x] = qRgb(in[0], in[1], in[2]);
+                break;
+            default:
+                // Adobe writes CMYK inverted, as Qt's own handler assumes.
+                out[x] = qRgb(in[0] * in[3] / 255, in[1] * in[3] / 255, in[2] * in[3] / 255);
+                break;
+            }
+            in += m_info.output_components;
+        }
+    }
+    return true;
+}
+
+// Any other format Qt reads, decoded whole under an explicit allocation
+// limit and handed out in bands.
+class WholeImageDecoder : public ImageBandDecoder
+{
+public:
+    explicit WholeImageDecoder(const QString &path)
+        : m_path(path)
+    {
+    }
+
+    QSize open(QString *errorMessage) override;
+    bool read(QImage &band) override;
+
+private:
+    QString m_path;
+    QImage m_image;
+    int m_position = 0;
+};
+
+QSize WholeImageDecoder::open(QString *errorMessage)
+{
+    QImageReader reader(m_path);
+    const QSize size = reader.size();
+    if (!size.isValid() || size.isEmpty()) {
+        return QSize();
+    }
+    const qint64 bytes = static_cast<qint64>(size.width()) * size.height() * 4;
+    if (bytes > kMaxWholeBytes) {
+        if (errorMessage) {
+            *errorMessage = QStringLiteral("图片过大（%1×%2），请转换为 PNG 或 JPEG 后再导入: %3")
+                                .arg(size.width())
+                                .arg(size.height())
+                                .arg(m_path);
+        }
+        return QSize();
+    }
+
+    // Qt's default limit would refuse most scans; this one is sized to the
+    // image and capped above.
+    reader.setAllocationLimit(static_cast<int>(bytes / (1024 * 1024)) + 1);
+    m_image = reader.read();
+    if (m_image.isNull() || m_image.size() != size) {
+        return QSize();
+    }
+    m_image = m_image.convertToFormat(QImage::Format_ARGB32);
+    return size;
+}
+
+bool WholeImageDecoder::read(QImage &band)
+{
+    const qsizetype bytes = static_cast<qsizetype>(band.width()) * 4;
+    for (int y = 0; y < band.height(); ++y) {
+        std::memcpy(band.scanLine(y), m_image.constScanLine(m_position + y), bytes);
+    }
+    m_position += band.height();
+    if (m_position >= m_image.height()) {
+        m_image = QImage();
+    }
+    return true;
+}
+} // namespace
+
+ImageBandReader::ImageBandReader(const QString &path)
+    : m_path(path)
+    , m_position(0)
+    , m_decoder(nullptr)
+{
+}
+
+ImageBandReader::~ImageBandReader()
+{
+    delete m_decoder;
+}
+
+bool ImageBandReader::open(QString *errorMessage)
+{
+    delete m_decoder;
+    m_decoder = nullptr;
+    m_position = 0;
+
+    // A file the streaming decoders turn down, such as an interlaced PNG,
+    // is still read whole if it is small enough.
+    const QByteArray format = QImageReader(m_path).format();
+    if (format == "png") {
+        m_decoder = new PngBandDecoder(m_path);
+    } else if (format == "jpeg") {
+        m_decoder = new JpegBandDecoder(m_path);
+    }
+    QString error;
+    if (m_decoder) {
+        m_size = m_decoder->open(&error);
+        if (!m_size.isValid()) {
+            delete m_decoder;
+            m_decoder = nullptr;
+        }
+    }
+    if (!m_decoder) {
+        m_decoder = new WholeImageDecoder(m_path);
+        m_size = m_decoder->open(&error);
+    }
+
+    if (!m_size.isValid() || m_size.isEmpty()) {
+        delete m_decoder;
+        m_decoder = nullptr;
+        if (errorMessage) {
+            *errorMessage = error.isEmpty()
+                ? QStringLiteral("无法读取图片: %1").arg(m_path)
+                : error;
+        }
+        return false;
+    }
+    return true;
+}
+
+QSize ImageBandReader::size() const
+{
+    return m_size;
+}
+
+int ImageBandReader::position() const
+{
+    return m_position;
+}
+
+bool ImageBandReader::atEnd() const
+{
+    return !m_decoder || m_position >= m_size.height();
+}
+
+QImage ImageBandReader::read(int count, QString *errorMessage)
+{
+    if (atEnd() || count <= 0) {
+        return QImage();
+    }
+
+    QImage band(m_size.width(), qMin(count, m_size.height() - m_position), QImage::Format_ARGB32);
+    if (band.isNull() || !m_decoder->read(band)) {
+        delete m_decoder;
+        m_decoder = nullptr;
+        if (errorMessage) {
+            *errorMessage = QStringLiteral("无法读取图片: %1（第 %2 行）")
+                                .arg(m_path)
+                                .arg(m_position + 1);
+        }
+        return QImage();
+    }
+    m_position += band.height();
+    return band;
+}
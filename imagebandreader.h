@@ -0,0 +1,41 @@
+#ifndef IMAGEBANDREADER_H
+#define IMAGEBANDREADER_H
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+class ImageBandDecoder;
+
+// Reads an image file top to bottom, a band of rows at a time, so a scan of
+// any size can be processed with only one band in memory. Non-interlaced
+// PNG is inflated row by row and JPEG read by scanlines. Other formats are
+// decoded whole once, under an explicit allocation limit, and refused above
+// it.
+class ImageBandReader
+{
+public:
+    explicit ImageBandReader(const QString &path);
+    ~ImageBandReader();
+
+    // Reads the header. Fails if the image cannot be read band by band.
+    bool open(QString *errorMessage = nullptr);
+    QSize size() const;
+    // Rows handed out so far.
+    int position() const;
+    bool atEnd() const;
+
+    // The next rows, at most count of them, as Format_ARGB32. Null on
+    // error or at the end.
+    QImage read(int count, QString *errorMessage = nullptr);
+
+private:
+    Q_DISABLE_COPY(ImageBandReader)
+
+    QString m_path;
+    QSize m_size;
+    int m_position;
+    ImageBandDecoder *m_decoder;
+};
+
+#endif // IMAGEBANDREADER_H
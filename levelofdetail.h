@@ -0,0 +1,37 @@
+#ifndef LEVELOFDETAIL_H
+#define LEVELOFDETAIL_H
+
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QtGlobal>
+
+// How much of a 2D symbol is worth drawing at the current zoom. Zoomed out
+// over a whole building, door swings and furniture artwork shrink to a few
+// pixels and only cost paint time.
+enum class SymbolDetail {
+    // Too small to see; skip it.
+    Hidden,
+    // Draw the outline or footprint only.
+    Footprint,
+    Full
+};
+
+// sceneSize is the symbol's larger extent in scene units; the painter's
+// transform turns it into screen pixels.
+inline SymbolDetail symbolDetail(const QPainter *painter, qreal sceneSize)
+{
+    constexpr qreal kHiddenPixels = 3.0;
+    constexpr qreal kFootprintPixels = 24.0;
+
+    const qreal pixels = sceneSize
+        * QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    if (pixels < kHiddenPixels) {
+        return SymbolDetail::Hidden;
+    }
+    if (pixels < kFootprintPixels) {
+        return SymbolDetail::Footprint;
+    }
+    return SymbolDetail::Full;
+}
+
+#endif // LEVELOFDETAIL_H
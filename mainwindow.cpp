@@ -7,9 +7,11 @@
 #include "designscene.h"
 #include "furnitureitem.h"
 #include "openingitem.h"
+#include "planexporter.h"
 #include "projectmanager.h"
 #include "view2dwidget.h"
 #include "view3dwidget.h"
+#include "walldetector.h"
 #include "wallitem.h"
 
 #include <QActionGroup>
@@ -37,7 +39,7 @@
 #include <QPainter>
 #include <QPointF>
 #include <QPoint>
-#include <QPixmap>
+#include <QProgressDialog>
 #include <QRect>
 #include <QKeySequence>
 #include <QSignalBlocker>
@@ -52,6 +54,7 @@
 #include <QWidget>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QtConcurrent>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -104,8 +107,12 @@ MainWindow::MainWindow(QWidget *parent)
     , m_calibrateAction(nullptr)
     , m_snapAction(nullptr)
     , m_deleteAction(nullptr)
+    , m_detectWallsAction(nullptr)
     , m_recentMenu(nullptr)
     , m_autosaveTimer(nullptr)
+    , m_wallDetectionWatcher(nullptr)
+    , m_wallDetectionProgress(nullptr)
+    , m_wallDetectionCancelled(0)
 {
     ui->setupUi(this);
 
@@ -133,9 +140,18 @@ MainWindow::MainWindow(QWidget *parent)
 
     m_autosaveTimer = new QTimer(this);
     m_autosaveTimer->setInterval(5 * 60 * 1000);
-    connect(m_autosaveTimer, &QTimer::timeout, this, []() {
-        ProjectManager::instance()->saveAutosave();
+    connect(m_autosaveTimer, &QTimer::timeout, this, [this]() {
+        QString error;
+        if (!ProjectManager::instance()->saveAutosave(&error) && !error.isEmpty()) {
+            statusBar()->showMessage(tr("自动保存失败: %1").arg(error), 10000);
+        }
     });
+    connect(ProjectManager::instance(), &ProjectManager::autosaveFinished, this,
+            [this](bool saved, const QString &errorMessage) {
+                if (!saved) {
+                    statusBar()->showMessage(tr("自动保存失败: %1").arg(errorMessage), 10000);
+                }
+            });
     m_autosaveTimer->start();
 
     rebuildRecentFilesMenu();
@@ -146,6 +162,12 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    // A running detection holds a pointer to the cancel flag.
+    if (m_wallDetectionWatcher) {
+        m_wallDetectionCancelled.storeRelaxed(1);
+        m_wallDetectionWatcher->waitForFinished();
+    }
+
     // Disconnect all signals from m_scene before destruction
     // to prevent accessing destroyed objects during cleanup
     if (m_scene) {
@@ -520,6 +542,7 @@ void MainWindow::setupToolbar()
     m_deleteAction->setEnabled(false);
     m_exportAction = new QAction(tr("导出"), this);
     auto *importBlueprintAction = new QAction(tr("导入底图"), this);
+    m_detectWallsAction = new QAction(tr("识别墙体"), this);
     m_snapAction = new QAction(tr("吸附"), this);
     m_snapAction->setCheckable(true);
     m_snapAction->setChecked(true);
@@ -553,6 +576,7 @@ void MainWindow::setupToolbar()
     toolbar->addAction(alignVerticalAction);
     toolbar->addSeparator();
     toolbar->addAction(importBlueprintAction);
+    toolbar->addAction(m_detectWallsAction);
 
     auto *fileMenu = menuBar()->addMenu(tr("文件"));
     fileMenu->addAction(m_newAction);
@@ -562,6 +586,7 @@ void MainWindow::setupToolbar()
     m_recentMenu = fileMenu->addMenu(tr("最近文件"));
     fileMenu->addSeparator();
     fileMenu->addAction(importBlueprintAction);
+    fileMenu->addAction(m_detectWallsAction);
     fileMenu->addSeparator();
     fileMenu->addAction(m_exportAction);
 
@@ -638,9 +663,8 @@ void MainWindow::setupToolbar()
         if (!removed) {
             QMessageBox::information(this, tr("提示"), tr("请先选择墙体、门窗或家具。"));
         }
-        // ✅ 删除后先清除选择，再通知场景变化
+        // 删除的项目已各自上报，这里只需清除选择
         m_scene->clearSelection();
-        m_scene->notifySceneChanged();
         updateSelectionDetails();
     });
     connect(alignHorizontalAction, &QAction::triggered, this, [this]() {
@@ -678,6 +702,7 @@ void MainWindow::setupToolbar()
         wall->updateGeometry();
     });
     connect(importBlueprintAction, &QAction::triggered, this, &MainWindow::importBlueprint);
+    connect(m_detectWallsAction, &QAction::triggered, this, &MainWindow::detectWalls);
 }
 
 void MainWindow::setupStatusBar()
@@ -751,10 +776,27 @@ void MainWindow::connectSignals()
     connect(m_scene, &DesignScene::modeChanged, this, &MainWindow::updateToolHint);
     connect(m_scene, &DesignScene::calibrationRequested,
             this, &MainWindow::handleCalibration);
+    connect(m_scene, &DesignScene::blueprintFailed, this,
+            [this](const QString &errorMessage) {
+                m_blueprintOpacitySlider->setEnabled(false);
+                QMessageBox::warning(this, tr("导入失败"), errorMessage);
+            });
     connect(m_scene, &QGraphicsScene::selectionChanged,
             this, &MainWindow::updateSelectionDetails);
-    connect(m_scene, &DesignScene::sceneContentChanged,
-            this, &MainWindow::updateSelectionDetails);
+    connect(m_scene, &DesignScene::contentChanged, this,
+            [this](const SceneChangeSet &changes) {
+                if (changes.reset || changes.sceneWide) {
+                    updateSelectionDetails();
+                    return;
+                }
+                const QList<QGraphicsItem *> selected = m_scene->selectedItems();
+                for (QGraphicsItem *item : selected) {
+                    if (changes.touches(item)) {
+                        updateSelectionDetails();
+                        return;
+                    }
+                }
+            });
 
     connect(m_blueprintOpacitySlider, &QSlider::valueChanged, this,
             [this](int value) {
@@ -768,12 +810,12 @@ void MainWindow::connectSignals()
                 if (!blueprint) {
                     return;
                 }
-                const QPixmap pixmap = blueprint->pixmap();
-                if (pixmap.isNull() || pixmap.width() <= 0) {
+                const QSize size = blueprint->imageSize();
+                if (size.width() <= 0) {
                     return;
                 }
-                blueprint->setScale(value / pixmap.width());
-                m_scene->notifySceneChanged();
+                blueprint->setScale(value / size.width());
+                m_scene->reportChange(blueprint, SceneChange_Geometry);
             });
 
     connect(m_blueprintLengthSpin,
@@ -783,12 +825,12 @@ void MainWindow::connectSignals()
                 if (!blueprint) {
                     return;
                 }
-                const QPixmap pixmap = blueprint->pixmap();
-                if (pixmap.isNull() || pixmap.height() <= 0) {
+                const QSize size = blueprint->imageSize();
+                if (size.height() <= 0) {
                     return;
                 }
-                blueprint->setScale(value / pixmap.height());
-                m_scene->notifySceneChanged();
+                blueprint->setScale(value / size.height());
+                m_scene->reportChange(blueprint, SceneChange_Geometry);
             });
 
     connect(m_blueprintAngleSpin,
@@ -799,7 +841,7 @@ void MainWindow::connectSignals()
                     return;
                 }
                 blueprint->setRotation(value);
-                m_scene->notifySceneChanged();
+                m_scene->reportChange(blueprint, SceneChange_Geometry);
             });
 
     connect(m_lengthSpin, qOverload<double>(&QDoubleSpinBox::valueChanged), this,
@@ -815,7 +857,6 @@ void MainWindow::connectSignals()
                 line.setLength(value);
                 wall->setEndPos(line.p2());
                 wall->updateGeometry();
-                m_scene->notifySceneChanged();
             });
 
     connect(m_angleSpin, qOverload<double>(&QDoubleSpinBox::valueChanged), this,
@@ -831,7 +872,6 @@ void MainWindow::connectSignals()
                 line.setAngle(value);
                 wall->setEndPos(line.p2());
                 wall->updateGeometry();
-                m_scene->notifySceneChanged();
             });
 
     connect(m_startXSpin, qOverload<double>(&QDoubleSpinBox::valueChanged), this,
@@ -844,7 +884,6 @@ void MainWindow::connectSignals()
                 start.setX(value);
                 wall->setStartPos(start);
                 wall->updateGeometry();
-                m_scene->notifySceneChanged();
             });
 
     connect(m_startYSpin, qOverload<double>(&QDoubleSpinBox::valueChanged), this,
@@ -857,7 +896,6 @@ void MainWindow::connectSignals()
                 start.setY(value);
                 wall->setStartPos(start);
                 wall->updateGeometry();
-                m_scene->notifySceneChanged();
             });
 
     connect(m_endXSpin, qOverload<double>(&QDoubleSpinBox::valueChanged), this,
@@ -870,7 +908,6 @@ void MainWindow::connectSignals()
                 end.setX(value);
                 wall->setEndPos(end);
                 wall->updateGeometry();
-                m_scene->notifySceneChanged();
             });
 
     connect(m_endYSpin, qOverload<double>(&QDoubleSpinBox::valueChanged), this,
@@ -883,7 +920,6 @@ void MainWindow::connectSignals()
                 end.setY(value);
                 wall->setEndPos(end);
                 wall->updateGeometry();
-                m_scene->notifySceneChanged();
             });
 
     connect(m_heightSpin, qOverload<double>(&QDoubleSpinBox::valueChanged), this,
@@ -893,7 +929,6 @@ void MainWindow::connectSignals()
                     return;
                 }
                 wall->setHeight(value);
-                m_scene->notifySceneChanged();
             });
 
     connect(m_thicknessSpin, qOverload<double>(&QDoubleSpinBox::valueChanged), this,
@@ -903,7 +938,6 @@ void MainWindow::connectSignals()
                     return;
                 }
                 wall->setThickness(value);
-                m_scene->notifySceneChanged();
             });
 
     connect(m_openingWidthSpin, qOverload<double>(&QDoubleSpinBox::valueChanged),
@@ -913,7 +947,6 @@ void MainWindow::connectSignals()
                     return;
                 }
                 opening->setWidth(value);
-                m_scene->notifySceneChanged();
             });
 
     connect(m_openingHeightSpin, qOverload<double>(&QDoubleSpinBox::valueChanged),
@@ -923,7 +956,6 @@ void MainWindow::connectSignals()
                     return;
                 }
                 opening->setHeight(value);
-                m_scene->notifySceneChanged();
             });
 
     connect(m_openingSillSpin, qOverload<double>(&QDoubleSpinBox::valueChanged),
@@ -933,7 +965,6 @@ void MainWindow::connectSignals()
                     return;
                 }
                 opening->setSillHeight(value);
-                m_scene->notifySceneChanged();
             });
 
     connect(m_openingOffsetSpin,
@@ -944,7 +975,6 @@ void MainWindow::connectSignals()
                     return;
                 }
                 opening->setDistanceFromStart(value);
-                m_scene->notifySceneChanged();
             });
 
     connect(m_furnitureWidthSpin, qOverload<double>(&QDoubleSpinBox::valueChanged),
@@ -956,7 +986,6 @@ void MainWindow::connectSignals()
                 QSizeF size = furniture->size2D();
                 size.setWidth(value);
                 furniture->setSize2D(size);
-                m_scene->notifySceneChanged();
             });
 
     connect(m_furnitureDepthSpin, qOverload<double>(&QDoubleSpinBox::valueChanged),
@@ -968,7 +997,6 @@ void MainWindow::connectSignals()
                 QSizeF size = furniture->size2D();
                 size.setHeight(value);
                 furniture->setSize2D(size);
-                m_scene->notifySceneChanged();
             });
 
     connect(m_furnitureHeightSpin, qOverload<double>(&QDoubleSpinBox::valueChanged),
@@ -978,7 +1006,6 @@ void MainWindow::connectSignals()
                     return;
                 }
                 furniture->setHeight3D(value);
-                m_scene->notifySceneChanged();
             });
 
     connect(m_furnitureElevationSpin,
@@ -989,7 +1016,6 @@ void MainWindow::connectSignals()
                     return;
                 }
                 furniture->setElevation(value);
-                m_scene->notifySceneChanged();
             });
 
     connect(m_furnitureRotationSpin,
@@ -1000,7 +1026,6 @@ void MainWindow::connectSignals()
                     return;
                 }
                 furniture->setRotationDegrees(value);
-                m_scene->notifySceneChanged();
             });
 }
 
@@ -1094,6 +1119,8 @@ bool MainWindow::confirmSave()
         return saveProject();
     }
     if (reply == QMessageBox::Discard) {
+        // Discarded edits should not come back as a recovery prompt.
+        manager->removeAutosave();
         return true;
     }
     return false;
@@ -1122,7 +1149,7 @@ void MainWindow::openProject()
         this,
         tr("打开项目"),
         QString(),
-        tr("QtPlanArchitect 项目 (*.qplan)"));
+        tr("QtPlanArchitect 项目 (*.qplan *.qplanb)"));
     if (fileName.isEmpty()) {
         return;
     }
@@ -1180,7 +1207,7 @@ bool MainWindow::saveProjectAs()
         this,
         tr("另存为"),
         tr("未命名.qplan"),
-        tr("QtPlanArchitect 项目 (*.qplan)"));
+        tr("QtPlanArchitect 项目 (*.qplan);;QtPlanArchitect 二进制项目 (*.qplanb)"));
     if (fileName.isEmpty()) {
         return false;
     }
@@ -1253,16 +1280,12 @@ void MainWindow::exportImage()
         fileName += "." + suffix;
     }
 
-    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
-    image.fill(Qt::white);
-
-    QPainter painter(&image);
-    painter.setRenderHint(QPainter::Antialiasing, true);
-    m_scene->render(&painter, QRectF(0.0, 0.0, width, height), sourceRect, Qt::KeepAspectRatio);
-    painter.end();
-
-    if (!image.save(fileName)) {
-        QMessageBox::warning(this, tr("导出失败"), tr("无法写入图片: %1").arg(fileName));
+    // Print-size exports do not fit in one image; PNG and BMP are rendered
+    // and written in bands.
+    const PlanExporter exporter(m_scene, sourceRect, QSize(width, height));
+    QString error;
+    if (!exporter.write(fileName, &error)) {
+        QMessageBox::warning(this, tr("导出失败"), error);
     }
 }
 
@@ -1278,23 +1301,75 @@ void MainWindow::importBlueprint()
         return;
     }
 
-    QPixmap pixmap(fileName);
-    if (pixmap.isNull()) {
-        QMessageBox::warning(this, tr("导入失败"), tr("无法加载选中的图片。"));
+    QString error;
+    if (!m_scene->setBlueprintImage(fileName, &error)) {
+        QMessageBox::warning(this, tr("导入失败"), error);
         return;
     }
 
-    if (!m_scene->setBlueprintPixmap(pixmap)) {
-        QMessageBox::warning(this, tr("导入失败"), tr("底图初始化失败。"));
+    m_blueprintOpacitySlider->setEnabled(true);
+    m_blueprintOpacitySlider->setValue(60);
+}
+
+void MainWindow::detectWalls()
+{
+    BlueprintItem *blueprint = m_scene->blueprintItem();
+    if (!blueprint) {
+        QMessageBox::information(this, tr("提示"), tr("请先导入底图再识别墙体。"));
+        return;
+    }
+    if (!m_wallDetectionWatcher) {
+        m_wallDetectionWatcher = new QFutureWatcher<WallDetector::Result>(this);
+        connect(m_wallDetectionWatcher, &QFutureWatcher<WallDetector::Result>::finished,
+                this, &MainWindow::finishWallDetection);
+    } else if (m_wallDetectionWatcher->isRunning()) {
         return;
     }
 
-    if (BlueprintItem *blueprint = m_scene->blueprintItem()) {
-        blueprint->setSourcePath(fileName);
+    // Wall sizes are judged in millimetres, through the blueprint's
+    // calibration.
+    WallDetector::Request request;
+    request.imagePath = blueprint->sourcePath();
+    request.pixelSize = blueprint->scale();
+
+    m_wallDetectionCancelled.storeRelaxed(0);
+    m_wallDetectionProgress = new QProgressDialog(tr("正在识别墙体…"), tr("取消"), 0, 0, this);
+    m_wallDetectionProgress->setWindowModality(Qt::WindowModal);
+    m_wallDetectionProgress->setMinimumDuration(0);
+    connect(m_wallDetectionProgress, &QProgressDialog::canceled, this, [this]() {
+        m_wallDetectionCancelled.storeRelaxed(1);
+    });
+    m_wallDetectionProgress->show();
+
+    const QAtomicInt *cancelled = &m_wallDetectionCancelled;
+    m_wallDetectionWatcher->setFuture(QtConcurrent::run([request, cancelled]() {
+        return WallDetector::detect(request, cancelled);
+    }));
+}
+
+void MainWindow::finishWallDetection()
+{
+    if (m_wallDetectionProgress) {
+        m_wallDetectionProgress->hide();
+        m_wallDetectionProgress->deleteLater();
+        m_wallDetectionProgress = nullptr;
     }
 
-    m_blueprintOpacitySlider->setEnabled(true);
-    m_blueprintOpacitySlider->setValue(60);
+    const WallDetector::Result result = m_wallDetectionWatcher->result();
+    if (result.cancelled) {
+        return;
+    }
+    if (!result.errorMessage.isEmpty()) {
+        QMessageBox::warning(this, tr("识别失败"), result.errorMessage);
+        return;
+    }
+    if (result.walls.isEmpty()) {
+        QMessageBox::information(this, tr("提示"), tr("未识别到墙体，请确认底图已校准。"));
+        return;
+    }
+
+    m_scene->addDetectedWalls(result.walls);
+    statusBar()->showMessage(tr("已识别 %1 段墙体").arg(result.walls.size()), 5000);
 }
 
 void MainWindow::updateSelectionDetails()
@@ -1396,10 +1471,10 @@ void MainWindow::updateSelectionDetails()
         QSignalBlocker blockLength(m_blueprintLengthSpin);
         QSignalBlocker blockAngle(m_blueprintAngleSpin);
         QSignalBlocker blockOpacity(m_blueprintOpacitySlider);
-        const QPixmap pixmap = blueprint->pixmap();
+        const QSize size = blueprint->imageSize();
         const qreal scale = blueprint->scale();
-        const qreal width = pixmap.isNull() ? 0.0 : pixmap.width() * scale;
-        const qreal length = pixmap.isNull() ? 0.0 : pixmap.height() * scale;
+        const qreal width = size.width() * scale;
+        const qreal length = size.height() * scale;
         m_blueprintWidthSpin->setValue(width);
         m_blueprintLengthSpin->setValue(length);
         m_blueprintAngleSpin->setValue(blueprint->rotation());
@@ -1,9 +1,12 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QAtomicInt>
+#include <QFutureWatcher>
 #include <QMainWindow>
 
 #include "designscene.h"
+#include "walldetector.h"
 class View2DWidget;
 class WallItem;
 class View3DWidget;
@@ -20,6 +23,7 @@ class QAction;
 class QDockWidget;
 class QGroupBox;
 class QMenu;
+class QProgressDialog;
 class QTimer;
 class QCloseEvent;
 
@@ -48,6 +52,8 @@ private:
     void setupPreview3D();
     void connectSignals();
     void importBlueprint();
+    void detectWalls();
+    void finishWallDetection();
     void updateWindowTitle();
     void rebuildRecentFilesMenu();
     void checkAutosaveRecovery();
@@ -115,7 +121,11 @@ private:
     QAction *m_calibrateAction;
     QAction *m_snapAction;
     QAction *m_deleteAction;
+    QAction *m_detectWallsAction;
     QMenu *m_recentMenu;
     QTimer *m_autosaveTimer;
+    QFutureWatcher<WallDetector::Result> *m_wallDetectionWatcher;
+    QProgressDialog *m_wallDetectionProgress;
+    QAtomicInt m_wallDetectionCancelled;
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,14 @@
+#ifndef MESHREVISION_H
+#define MESHREVISION_H
+
+#include <QtGlobal>
+
+// Monotonic stamp handed out whenever a scene item changes something that
+// affects its 3D mesh. The 3D view compares stamps to decide what to re-mesh.
+inline quint64 nextMeshRevision()
+{
+    static quint64 counter = 0;
+    return ++counter;
+}
+
+#endif // MESHREVISION_H
@@ -0,0 +1,267 @@
+#include "meshsimplifier.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QVector3D>
+
+namespace {
+constexpr int kMaxPasses = 64;
+// Costs are computed once per pass, so a pass only collapses this share
+// of the vertices before they are refreshed.
+constexpr double kMaxPassShare = 0.2;
+// A collapse may not turn any remaining triangle further than this,
+// as the cosine of the angle between its old and new normal.
+constexpr double kMinNormalCosine = 0.2;
+
+// Sum of squared distances to a set of planes, area weighted, as the
+// upper triangle of a symmetric 4x4 matrix.
+struct Quadric {
+    double xx = 0.0, xy = 0.0, xz = 0.0, xw = 0.0;
+    double yy = 0.0, yz = 0.0, yw = 0.0;
+    double zz = 0.0, zw = 0.0;
+    double ww = 0.0;
+
+    void addPlane(const QVector3D &normal, double d, double weight)
+    {
+        const double a = normal.x();
+        const double b = normal.y();
+        const double c = normal.z();
+        xx += weight * a * a; xy += weight * a * b; xz += weight * a * c; xw += weight * a * d;
+        yy += weight * b * b; yz += weight * b * c; yw += weight * b * d;
+        zz += weight * c * c; zw += weight * c * d;
+        ww += weight * d * d;
+    }
+
+    void add(const Quadric &other)
+    {
+        xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+        yy += other.yy; yz += other.yz; yw += other.yw;
+        zz += other.zz; zw += other.zw;
+        ww += other.ww;
+    }
+
+    double error(const QVector3D &p) const
+    {
+        const double x = p.x();
+        const double y = p.y();
+        const double z = p.z();
+        return xx * x * x + 2.0 * (xy * x * y + xz * x * z + xw * x)
+               + yy * y * y + 2.0 * (yz * y * z + yw * y)
+               + zz * z * z + 2.0 * zw * z
+               + ww;
+    }
+};
+
+struct Collapse {
+    quint32 from;
+    quint32 to;
+    double cost;
+};
+
+quint64 edgeKey(quint32 a, quint32 b)
+{
+    return (quint64(a) << 32) | b;
+}
+
+// Vertices that must not move: those sharing a position with another
+// vertex, and those on an edge only one triangle uses.
+QVector<bool> lockedVertices(const QVector<MeshVertex> &vertices, const QVector<quint32> &indices)
+{
+    const int count = static_cast<int>(vertices.size());
+    QVector<bool> locked(count, false);
+
+    QVector<quint32> order(count);
+    for (int i = 0; i < count; ++i) {
+        order[i] = static_cast<quint32>(i);
+    }
+    const auto samePosition = [&vertices](quint32 a, quint32 b) {
+        return std::memcmp(vertices.at(a).position, vertices.at(b).position,
+                           sizeof(MeshVertex::position)) == 0;
+    };
+    std::sort(order.begin(), order.end(), [&vertices](quint32 a, quint32 b) {
+        return std::memcmp(vertices.at(a).position, vertices.at(b).position,
+                           sizeof(MeshVertex::position)) < 0;
+    });
+    for (int i = 1; i < count; ++i) {
+        if (samePosition(order.at(i - 1), order.at(i))) {
+            locked[order.at(i - 1)] = true;
+            locked[order.at(i)] = true;
+        }
+    }
+
+    QVector<quint64> edges;
+    edges.reserve(indices.size());
+    for (int t = 0; t + 2 < indices.size(); t += 3) {
+        for (int corner = 0; corner < 3; ++corner) {
+            edges.append(edgeKey(indices.at(t + corner), indices.at(t + (corner + 1) % 3)));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (quint64 edge : qAsConst(edges)) {
+        const quint32 a = quint32(edge >> 32);
+        const quint32 b = quint32(edge);
+        if (!std::binary_search(edges.cbegin(), edges.cend(), edgeKey(b, a))) {
+            locked[a] = true;
+            locked[b] = true;
+        }
+    }
+    return locked;
+}
+
+QVector3D triangleNormal(const QVector3D &a, const QVector3D &b, const QVector3D &c)
+{
+    return QVector3D::crossProduct(b - a, c - a);
+}
+} // namespace
+
+QVector<quint32> MeshSimplifier::simplify(const QVector<MeshVertex> &vertices,
+                                          const QVector<quint32> &indices,
+                                          int targetIndexCount)
+{
+    const int vertexCount = static_cast<int>(vertices.size());
+    QVector<quint32> result = indices;
+    if (result.size() <= targetIndexCount || vertexCount == 0) {
+        return result;
+    }
+
+    QVector<QVector3D> positions(vertexCount);
+    for (int i = 0; i < vertexCount; ++i) {
+        positions[i] = vertices.at(i).pos();
+    }
+
+    QVector<Quadric> quadrics(vertexCount);
+    for (int t = 0; t + 2 < result.size(); t += 3) {
+        const QVector3D normal = triangleNormal(positions.at(result.at(t)),
+                                                positions.at(result.at(t + 1)),
+                                                positions.at(result.at(t + 2)));
+        const float doubleArea = normal.length();
+        if (doubleArea <= 0.0f) {
+            continue;
+        }
+        const QVector3D unit = normal / doubleArea;
+        const double d = -QVector3D::dotProduct(unit, positions.at(result.at(t)));
+        for (int corner = 0; corner < 3; ++corner) {
+            quadrics[result.at(t + corner)].addPlane(unit, d, doubleArea / 2.0);
+        }
+    }
+
+    const QVector<bool> locked = lockedVertices(vertices, indices);
+    QVector<int> firstTriangle(vertexCount + 1);
+    QVector<int> triangles;
+    QVector<Collapse> candidates;
+    QVector<bool> touched(vertexCount);
+    QVector<quint32> remap(vertexCount);
+
+    for (int pass = 0; pass < kMaxPasses && result.size() > targetIndexCount; ++pass) {
+        // Triangles around each vertex, as one flat list.
+        firstTriangle.fill(0);
+        for (quint32 index : qAsConst(result)) {
+            ++firstTriangle[index + 1];
+        }
+        for (int i = 0; i < vertexCount; ++i) {
+            firstTriangle[i + 1] += firstTriangle.at(i);
+        }
+        triangles.resize(result.size());
+        QVector<int> fill = firstTriangle;
+        for (int i = 0; i < result.size(); ++i) {
+            triangles[fill[result.at(i)]++] = i / 3;
+        }
+
+        candidates.clear();
+        int liveVertices = 0;
+        for (int i = 0; i < vertexCount; ++i) {
+            if (firstTriangle.at(i + 1) > firstTriangle.at(i)) {
+                ++liveVertices;
+            }
+        }
+        for (int t = 0; t < result.size(); t += 3) {
+            for (int corner = 0; corner < 3; ++corner) {
+                const quint32 from = result.at(t + corner);
+                const quint32 to = result.at(t + (corner + 1) % 3);
+                if (locked.at(from) || from == to) {
+                    continue;
+                }
+                Quadric merged = quadrics.at(from);
+                merged.add(quadrics.at(to));
+                candidates.append(Collapse{from, to, merged.error(positions.at(to))});
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+        // Each collapse removes about two triangles.
+        const int wanted = (static_cast<int>(result.size()) - targetIndexCount) / 6 + 1;
+        const int limit = qMin(wanted, qMax(1, int(liveVertices * kMaxPassShare)));
+        touched.fill(false);
+        for (int i = 0; i < vertexCount; ++i) {
+            remap[i] = static_cast<quint32>(i);
+        }
+
+        int collapses = 0;
+        for (const Collapse &collapse : qAsConst(candidates)) {
+            if (collapses >= limit) {
+                break;
+            }
+            if (touched.at(collapse.from) || touched.at(collapse.to)) {
+                continue;
+            }
+
+            // Moving from onto to must not fold any triangle that survives.
+            bool folds = false;
+            for (int k = firstTriangle.at(collapse.from);
+                 k < firstTriangle.at(collapse.from + 1) && !folds; ++k) {
+                const int t = triangles.at(k) * 3;
+                const quint32 a = result.at(t);
+                const quint32 b = result.at(t + 1);
+                const quint32 c = result.at(t + 2);
+                if (a == collapse.to || b == collapse.to || c == collapse.to) {
+                    continue;
+                }
+                const auto moved = [&](quint32 index) {
+                    return positions.at(index == collapse.from ? collapse.to : index);
+                };
+                const QVector3D before = triangleNormal(positions.at(a), positions.at(b),
+                                                        positions.at(c));
+                const QVector3D after = triangleNormal(moved(a), moved(b), moved(c));
+                folds = QVector3D::dotProduct(before, after)
+                        <= kMinNormalCosine * before.length() * after.length();
+            }
+            if (folds) {
+                continue;
+            }
+
+            // Neither end, nor anything sharing a triangle with from, may
+            // change again this pass: the checks above would go stale.
+            for (int k = firstTriangle.at(collapse.from);
+                 k < firstTriangle.at(collapse.from + 1); ++k) {
+                const int t = triangles.at(k) * 3;
+                touched[result.at(t)] = true;
+                touched[result.at(t + 1)] = true;
+                touched[result.at(t + 2)] = true;
+            }
+            touched[collapse.to] = true;
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics.at(collapse.from));
+            ++collapses;
+        }
+        if (collapses == 0) {
+            break;
+        }
+
+        int out = 0;
+        for (int t = 0; t < result.size(); t += 3) {
+            const quint32 a = remap.at(result.at(t));
+            const quint32 b = remap.at(result.at(t + 1));
+            const quint32 c = remap.at(result.at(t + 2));
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            result[out++] = a;
+            result[out++] = b;
+            result[out++] = c;
+        }
+        result.resize(out);
+    }
+    return result;
+}
@@ -0,0 +1,24 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include "meshvertex.h"
+
+#include <QVector>
+
+// Quadric error simplification (Garland and Heckbert) by half-edge
+// collapse: a vertex is merged into one of its neighbours, never moved to
+// a new position, so the simplified index list still draws the original
+// vertex array. Vertices on open borders and on seams, where several
+// vertices share a position, stay put so no cracks open. Pure function of
+// its arguments; safe on any thread.
+class MeshSimplifier
+{
+public:
+    // A triangle list over vertices, cut down to about targetIndexCount
+    // indices, or as far as the locked vertices allow.
+    static QVector<quint32> simplify(const QVector<MeshVertex> &vertices,
+                                     const QVector<quint32> &indices,
+                                     int targetIndexCount);
+};
+
+#endif // MESHSIMPLIFIER_H
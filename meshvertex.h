@@ -0,0 +1,112 @@
+#ifndef MESHVERTEX_H
+#define MESHVERTEX_H
+
+#include <QVector3D>
+#include <QtGlobal>
+
+// Interleaved vertex of every mesh the 3D view draws: the position, then
+// the normal packed as GL_INT_2_10_10_10_REV, 16 bytes in all.
+struct MeshVertex {
+    float position[3];
+    quint32 normal;
+
+    MeshVertex() = default;
+    MeshVertex(const QVector3D &pos, quint32 packedNormal)
+        : position{pos.x(), pos.y(), pos.z()}
+        , normal(packedNormal)
+    {
+    }
+
+    QVector3D pos() const
+    {
+        return QVector3D(position[0], position[1], position[2]);
+    }
+
+    // Signed 10-bit components in x, y, z order from the low bits; w is 0.
+    static quint32 packNormal(const QVector3D &normal)
+    {
+        const QVector3D unit = normal.normalized();
+        const auto component = [](float value) {
+            return static_cast<quint32>(qRound(qBound(-1.0f, value, 1.0f) * 511.0f)) & 0x3ffu;
+        };
+        return component(unit.x()) | component(unit.y()) << 10 | component(unit.z()) << 20;
+    }
+};
+
+static_assert(sizeof(MeshVertex) == 16, "vertices are uploaded as they are laid out");
+
+// Compact upload form of MeshVertex: the position in 16-bit steps of a
+// VertexQuantization grid, 12 bytes in all. The material fills what would
+// be padding before the 4-byte aligned normal.
+struct PackedMeshVertex {
+    qint16 position[3];
+    qint16 material;
+    quint32 normal;
+};
+
+static_assert(sizeof(PackedMeshVertex) == 12, "vertices are uploaded as they are laid out");
+
+// Full-precision upload form of MeshVertex with its material, for plans
+// too large for a fine enough VertexQuantization grid.
+struct FloatMeshVertex {
+    float position[3];
+    quint32 normal;
+    qint32 material;
+
+    FloatMeshVertex() = default;
+    FloatMeshVertex(const MeshVertex &vertex, qint32 materialIndex)
+        : position{vertex.position[0], vertex.position[1], vertex.position[2]}
+        , normal(vertex.normal)
+        , material(materialIndex)
+    {
+    }
+};
+
+static_assert(sizeof(FloatMeshVertex) == 20, "vertices are uploaded as they are laid out");
+
+// A 16-bit grid of points around origin, step apart. Vertex shaders
+// recover a packed position as origin + position * step.
+struct VertexQuantization {
+    static constexpr float kMaxSteps = 32767.0f;
+
+    QVector3D origin;
+    float step = 1.0f;
+
+    // The finest grid that still reaches every point of the box.
+    static VertexQuantization forBounds(const QVector3D &minBounds,
+                                        const QVector3D &maxBounds)
+    {
+        const QVector3D halfSize = (maxBounds - minBounds) / 2.0f;
+        const float reach = qMax(halfSize.x(), qMax(halfSize.y(), halfSize.z()));
+        VertexQuantization grid;
+        grid.origin = (minBounds + maxBounds) / 2.0f;
+        grid.step = qMax(reach / kMaxSteps, 1e-6f);
+        return grid;
+    }
+
+    bool contains(const QVector3D &minBounds, const QVector3D &maxBounds) const
+    {
+        const float reach = kMaxSteps * step;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (minBounds[axis] < origin[axis] - reach
+                || maxBounds[axis] > origin[axis] + reach) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    PackedMeshVertex pack(const MeshVertex &vertex, qint16 material = 0) const
+    {
+        PackedMeshVertex packed;
+        for (int axis = 0; axis < 3; ++axis) {
+            const float steps = (vertex.position[axis] - origin[axis]) / step;
+            packed.position[axis] = static_cast<qint16>(qRound(qBound(-kMaxSteps, steps, kMaxSteps)));
+        }
+        packed.material = material;
+        packed.normal = vertex.normal;
+        return packed;
+    }
+};
+
+#endif // MESHVERTEX_H
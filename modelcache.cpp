@@ -1,40 +1,437 @@
 ﻿#include "modelcache.h"
 
+#include "meshsimplifier.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QFileInfo>
+#include <QHash>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
 #include <QString>
+#include <QStringList>
+#include <QThread>
 #include <QtGlobal>
 #include <cfloat>
+#include <cstring>
 
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+namespace {
+// Bump whenever MeshData or the import settings change; older blobs are
+// then ignored and rewritten.
+constexpr quint32 kMeshCacheVersion = 3;
+constexpr char kMeshCacheMagic[4] = {'H', 'M', 'S', 'H'};
+constexpr qint64 kDefaultMemoryBudget = 256 * 1024 * 1024;
+
+// Fixed-size header of a cached mesh, followed by the vertices, the
+// indices and the levels' first index and index count, all in native byte
+// order.
+struct MeshCacheHeader {
+    char magic[4];
+    quint32 version;
+    quint32 vertexCount;
+    quint32 indexCount;
+    quint32 indexSize;
+    quint32 levelCount;
+    float minBounds[3];
+    float maxBounds[3];
+};
+
+// Models with fewer triangles are drawn at full detail at any size.
+constexpr int kMinLevelTriangles = 2000;
+// Triangles each coarser level aims for, as a share of the full mesh.
+constexpr float kLevelShares[] = {0.25f, 0.06f};
+
+// Files without normals get them smoothed across edges flatter than this,
+// in degrees; sharper creases keep a vertex per face.
+constexpr float kSmoothingAngle = 80.0f;
+
+// Exact bit pattern of a position and its packed normal, used to merge
+// vertices shared between faces and between the meshes Assimp hands back.
+struct VertexKey {
+    float xyz[3];
+    quint32 normal;
+
+    bool operator==(const VertexKey &other) const
+    {
+        return std::memcmp(this, &other, sizeof(VertexKey)) == 0;
+    }
+};
+
+size_t qHash(const VertexKey &key, size_t seed = 0)
+{
+    return qHashBits(&key, sizeof(key), seed);
+}
+
+// Picks the narrowest index type that can address every vertex.
+void setIndices(MeshData *data, const QVector<quint32> &indices)
+{
+    if (data->vertices.size() <= 0x10000) {
+        data->indices16.reserve(indices.size());
+        for (quint32 index : indices) {
+            data->indices16.append(static_cast<quint16>(index));
+        }
+        data->indices32.clear();
+    } else {
+        data->indices32 = indices;
+        data->indices16.clear();
+    }
+}
+
+// Blob name for a model file. Size and modification time stand in for the
+// content, so an edited file gets a new blob instead of a stale one.
+QString meshCachePath(const QFileInfo &info)
+{
+    QString dirPath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (dirPath.isEmpty()) {
+        dirPath = QDir::tempPath();
+    }
+    QDir dir(dirPath);
+    if (!dir.mkpath(QStringLiteral("models"))) {
+        return QString();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(info.absoluteFilePath().toUtf8());
+    hash.addData(QByteArray::number(info.size()));
+    hash.addData(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+    hash.addData(QByteArray::number(kMeshCacheVersion));
+    return dir.filePath(QStringLiteral("models/%1.mesh")
+                            .arg(QString::fromLatin1(hash.result().toHex())));
+}
+
+// Simplifies the mesh into coarser levels appended after the full one. A
+// level that barely shrinks, because seams and borders pin most vertices,
+// ends the chain.
+void setLevels(MeshData *data, const QVector<quint32> &indices)
+{
+    QVector<quint32> allIndices = indices;
+    data->levels = {MeshData::Level{0, static_cast<int>(indices.size())}};
+    if (indices.size() / 3 >= kMinLevelTriangles) {
+        QVector<quint32> previous = indices;
+        for (float share : kLevelShares) {
+            const int target = static_cast<int>(indices.size() / 3 * share) * 3;
+            QVector<quint32> level = MeshSimplifier::simplify(data->vertices, previous, target);
+            if (level.isEmpty() || level.size() > previous.size() * 3 / 4) {
+                break;
+            }
+            data->levels.append(MeshData::Level{static_cast<int>(allIndices.size()),
+                                                static_cast<int>(level.size())});
+            allIndices += level;
+            previous = level;
+        }
+    }
+    setIndices(data, allIndices);
+}
+
+QSharedPointer<MeshData> readMeshCache(const QString &cachePath)
+{
+    QFile file(cachePath);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(MeshCacheHeader))) {
+        return QSharedPointer<MeshData>();
+    }
+
+    const uchar *bytes = file.map(0, file.size());
+    if (!bytes) {
+        return QSharedPointer<MeshData>();
+    }
+
+    MeshCacheHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    const qint64 vertexBytes = qint64(header.vertexCount) * qint64(sizeof(MeshVertex));
+    const qint64 indexBytes = qint64(header.indexCount) * header.indexSize;
+    const qint64 levelBytes = qint64(header.levelCount) * 2 * qint64(sizeof(quint32));
+    if (std::memcmp(header.magic, kMeshCacheMagic, sizeof(header.magic)) != 0
+        || header.version != kMeshCacheVersion
+        || (header.indexSize != sizeof(quint16) && header.indexSize != sizeof(quint32))
+        || header.indexCount == 0
+        || header.levelCount == 0
+        || file.size() != qint64(sizeof(header)) + vertexBytes + indexBytes + levelBytes) {
+        file.unmap(const_cast<uchar *>(bytes));
+        return QSharedPointer<MeshData>();
+    }
+
+    auto data = QSharedPointer<MeshData>::create();
+    const uchar *cursor = bytes + sizeof(header);
+    data->vertices.resize(header.vertexCount);
+    std::memcpy(data->vertices.data(), cursor, size_t(vertexBytes));
+    cursor += vertexBytes;
+    if (header.indexSize == sizeof(quint16)) {
+        data->indices16.resize(header.indexCount);
+        std::memcpy(data->indices16.data(), cursor, size_t(indexBytes));
+    } else {
+        data->indices32.resize(header.indexCount);
+        std::memcpy(data->indices32.data(), cursor, size_t(indexBytes));
+    }
+    cursor += indexBytes;
+    for (quint32 i = 0; i < header.levelCount; ++i) {
+        quint32 range[2];
+        std::memcpy(range, cursor, sizeof(range));
+        cursor += sizeof(range);
+        if (range[0] > header.indexCount || range[1] > header.indexCount - range[0]) {
+            file.unmap(const_cast<uchar *>(bytes));
+            return QSharedPointer<MeshData>();
+        }
+        data->levels.append(MeshData::Level{int(range[0]), int(range[1])});
+    }
+    data->minBounds = QVector3D(header.minBounds[0], header.minBounds[1], header.minBounds[2]);
+    data->maxBounds = QVector3D(header.maxBounds[0], header.maxBounds[1], header.maxBounds[2]);
+
+    file.unmap(const_cast<uchar *>(bytes));
+    return data;
+}
+
+// Best effort: a model that cannot be cached is simply imported again.
+void writeMeshCache(const QString &cachePath, const MeshData &data)
+{
+    MeshCacheHeader header;
+    std::memcpy(header.magic, kMeshCacheMagic, sizeof(header.magic));
+    header.version = kMeshCacheVersion;
+    header.vertexCount = static_cast<quint32>(data.vertices.size());
+    header.indexCount = static_cast<quint32>(data.indexCount());
+    header.indexSize = data.indices16.isEmpty() ? sizeof(quint32) : sizeof(quint16);
+    header.levelCount = static_cast<quint32>(data.levels.size());
+    for (int axis = 0; axis < 3; ++axis) {
+        header.minBounds[axis] = data.minBounds[axis];
+        header.maxBounds[axis] = data.maxBounds[axis];
+    }
+
+    // QSaveFile renames into place, so a reader never sees half a blob.
+    QSaveFile file(cachePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(data.vertices.constData()),
+               data.vertices.size() * qint64(sizeof(MeshVertex)));
+    if (data.indices16.isEmpty()) {
+        file.write(reinterpret_cast<const char *>(data.indices32.constData()),
+                   data.indices32.size() * qint64(sizeof(quint32)));
+    } else {
+        file.write(reinterpret_cast<const char *>(data.indices16.constData()),
+                   data.indices16.size() * qint64(sizeof(quint16)));
+    }
+    for (const MeshData::Level &level : data.levels) {
+        const quint32 range[2] = {quint32(level.firstIndex), quint32(level.indexCount)};
+        file.write(reinterpret_cast<const char *>(range), sizeof(range));
+    }
+    file.commit();
+}
+}
+
+ModelCache::ModelCache()
+    : QObject(nullptr)
+    , m_placeholder(createPlaceholder())
+    , m_budgetBytes(kDefaultMemoryBudget)
+    , m_residentBytes(0)
+    , m_useClock(0)
+    , m_statistics()
+{
+    // Leave a core for the GUI thread while a project's models are parsed.
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+ModelCache::~ModelCache()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
 ModelCache *ModelCache::instance()
 {
     static ModelCache cache;
     return &cache;
 }
 
+QSharedPointer<MeshData> ModelCache::requestModel(const QString &path)
+{
+    if (path.isEmpty()) {
+        return m_placeholder;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_cache.find(path);
+    if (it != m_cache.end()) {
+        ++m_statistics.hits;
+        return acquire(it.value());
+    }
+
+    ++m_statistics.misses;
+    if (!m_loading.contains(path)) {
+        m_loading.insert(path);
+        m_pool.start([this, path]() {
+            QElapsedTimer timer;
+            timer.start();
+            QSharedPointer<MeshData> model = loadModel(path);
+            finishLoad(path, model, timer.elapsed());
+        });
+    }
+    return m_placeholder;
+}
+
 QSharedPointer<MeshData> ModelCache::getModel(const QString &path, QString *errorMessage)
 {
     if (path.isEmpty()) {
         if (errorMessage) {
             *errorMessage = QStringLiteral("模型路径为空");
         }
-        return placeholderModel();
+        return m_placeholder;
     }
 
-    if (m_cache.contains(path)) {
-        return m_cache.value(path);
+    {
+        QMutexLocker locker(&m_mutex);
+        const auto it = m_cache.find(path);
+        if (it != m_cache.end()) {
+            ++m_statistics.hits;
+            return acquire(it.value());
+        }
+        ++m_statistics.misses;
     }
 
+    // A worker may be parsing the same file; whichever finishes first wins.
+    QElapsedTimer timer;
+    timer.start();
     QSharedPointer<MeshData> model = loadModel(path, errorMessage);
-    if (!model || model->vertices.isEmpty()) {
-        model = placeholderModel();
+
+    QMutexLocker locker(&m_mutex);
+    return acquire(insertModel(path, model, timer.elapsed()));
+}
+
+QSharedPointer<MeshData> ModelCache::placeholderModel() const
+{
+    return m_placeholder;
+}
+
+void ModelCache::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_budgetBytes = qMax<qint64>(0, bytes);
+    trim();
+}
+
+qint64 ModelCache::memoryBudget() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_budgetBytes;
+}
+
+ModelCache::Statistics ModelCache::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    Statistics statistics = m_statistics;
+    statistics.residentBytes = m_residentBytes;
+    return statistics;
+}
+
+void ModelCache::finishLoad(const QString &path,
+                            const QSharedPointer<MeshData> &model,
+                            qint64 elapsedMs)
+{
+    bool loaded = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_loading.remove(path);
+        loaded = insertModel(path, model, elapsedMs).mesh != m_placeholder;
+    }
+
+    if (loaded) {
+        emit modelReady(path);
+    }
+}
+
+ModelCache::Entry &ModelCache::insertModel(const QString &path,
+                                           const QSharedPointer<MeshData> &model,
+                                           qint64 elapsedMs)
+{
+    const auto existing = m_cache.find(path);
+    if (existing != m_cache.end()) {
+        return existing.value();
+    }
+
+    const bool loaded = model && model->indexCount() > 0;
+    if (loaded) {
+        ++m_statistics.loads;
+    } else {
+        ++m_statistics.failedLoads;
     }
+    int bucket = 0;
+    while (bucket < LoadTimeBuckets - 1 && elapsedMs >= (qint64(1) << (2 * bucket))) {
+        ++bucket;
+    }
+    ++m_statistics.loadTimeHistogram[bucket];
+
+    // Failed files keep the placeholder so they are not parsed again.
+    Entry entry;
+    entry.mesh = loaded ? model : m_placeholder;
+    entry.bytes = loaded ? model->memoryBytes() : 0;
+    entry.lastUse = ++m_useClock;
+    m_residentBytes += entry.bytes;
+    m_cache.insert(path, entry);
 
-    m_cache.insert(path, model);
-    return model;
+    // trim() skips the most recently used entry, so the new one survives
+    // even though nothing holds it yet.
+    trim();
+    return m_cache[path];
+}
+
+QSharedPointer<MeshData> ModelCache::acquire(Entry &entry)
+{
+    entry.lastUse = ++m_useClock;
+    if (entry.mesh == m_placeholder) {
+        return m_placeholder;
+    }
+
+    // Callers share one handle per mesh. The handle keeps the mesh alive on
+    // its own, and the cache can tell from the weak reference whether any
+    // furniture still uses the mesh. Once the last user lets go, the mesh
+    // may be what keeps the cache over budget, so it is trimmed again on
+    // the cache's thread; the handle may be dropped on any thread, and with
+    // m_mutex held.
+    QSharedPointer<MeshData> handle = entry.handle.toStrongRef();
+    if (!handle) {
+        const QSharedPointer<MeshData> owner = entry.mesh;
+        handle = QSharedPointer<MeshData>(owner.data(), [this, owner](MeshData *) {
+            QMetaObject::invokeMethod(this, [this]() {
+                QMutexLocker locker(&m_mutex);
+                trim();
+            }, Qt::QueuedConnection);
+        });
+        entry.handle = handle;
+    }
+    return handle;
+}
+
+void ModelCache::trim()
+{
+    while (m_residentBytes > m_budgetBytes) {
+        auto victim = m_cache.end();
+        for (auto it = m_cache.begin(); it != m_cache.end(); ++it) {
+            if (it->bytes == 0 || !it->handle.isNull()) {
+                continue;
+            }
+            if (it->lastUse == m_useClock) {
+                continue;
+            }
+            if (victim == m_cache.end() || it->lastUse < victim->lastUse) {
+                victim = it;
+            }
+        }
+        if (victim == m_cache.end()) {
+            // Everything left is in use; the budget is exceeded until some
+            // furniture lets go of its mesh, which trims again.
+            return;
+        }
+        m_residentBytes -= victim->bytes;
+        ++m_statistics.evictions;
+        m_cache.erase(victim);
+    }
 }
 
 QSharedPointer<MeshData> ModelCache::loadModel(const QString &path, QString *errorMessage)
@@ -47,12 +444,20 @@ QSharedPointer<MeshData> ModelCache::loadModel(const QString &path, QString *err
         return QSharedPointer<MeshData>();
     }
 
+    const QString cachePath = meshCachePath(info);
+    if (!cachePath.isEmpty()) {
+        if (QSharedPointer<MeshData> cached = readMeshCache(cachePath)) {
+            return cached;
+        }
+    }
+
     Assimp::Importer importer;
+    importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, kSmoothingAngle);
     const aiScene *scene = importer.ReadFile(
         path.toStdString(),
         aiProcess_Triangulate |
+        aiProcess_GenSmoothNormals |
         aiProcess_JoinIdenticalVertices |
-        aiProcess_GenNormals |
         aiProcess_ImproveCacheLocality |
         aiProcess_PreTransformVertices);
 
@@ -67,25 +472,32 @@ QSharedPointer<MeshData> ModelCache::loadModel(const QString &path, QString *err
     QVector3D minBounds(FLT_MAX, FLT_MAX, FLT_MAX);
     QVector3D maxBounds(-FLT_MAX, -FLT_MAX, -FLT_MAX);
 
+    QHash<VertexKey, quint32> vertexLookup;
+    QVector<quint32> indices;
+    QVector<quint32> remap;
+
     for (unsigned int i = 0; i < scene->mNumMeshes; ++i) {
         const aiMesh *mesh = scene->mMeshes[i];
         if (!mesh || !mesh->HasPositions()) {
             continue;
         }
 
-        for (unsigned int f = 0; f < mesh->mNumFaces; ++f) {
-            const aiFace &face = mesh->mFaces[f];
-            if (face.mNumIndices != 3) {
-                continue;
-            }
-            for (unsigned int j = 0; j < 3; ++j) {
-                const unsigned int idx = face.mIndices[j];
-                if (idx >= mesh->mNumVertices) {
-                    continue;
-                }
-                const aiVector3D &v = mesh->mVertices[idx];
-                const QVector3D pos(v.x, v.y, v.z);
-                data->vertices.append(pos);
+        // UVs are not used, so vertices Assimp kept apart for them collapse
+        // into one; so do normals that pack to the same value.
+        remap.resize(mesh->mNumVertices);
+        for (unsigned int v = 0; v < mesh->mNumVertices; ++v) {
+            const aiVector3D &src = mesh->mVertices[v];
+            const quint32 normal = mesh->HasNormals()
+                ? MeshVertex::packNormal(QVector3D(mesh->mNormals[v].x,
+                                                   mesh->mNormals[v].y,
+                                                   mesh->mNormals[v].z))
+                : 0;
+            const VertexKey key{{src.x, src.y, src.z}, normal};
+            auto it = vertexLookup.constFind(key);
+            if (it == vertexLookup.constEnd()) {
+                const QVector3D pos(src.x, src.y, src.z);
+                it = vertexLookup.insert(key, static_cast<quint32>(data->vertices.size()));
+                data->vertices.append(MeshVertex(pos, normal));
 
                 minBounds.setX(qMin(minBounds.x(), pos.x()));
                 minBounds.setY(qMin(minBounds.y(), pos.y()));
@@ -94,52 +506,109 @@ QSharedPointer<MeshData> ModelCache::loadModel(const QString &path, QString *err
                 maxBounds.setY(qMax(maxBounds.y(), pos.y()));
                 maxBounds.setZ(qMax(maxBounds.z(), pos.z()));
             }
+            remap[v] = it.value();
+        }
+
+        for (unsigned int f = 0; f < mesh->mNumFaces; ++f) {
+            const aiFace &face = mesh->mFaces[f];
+            if (face.mNumIndices != 3
+                || face.mIndices[0] >= mesh->mNumVertices
+                || face.mIndices[1] >= mesh->mNumVertices
+                || face.mIndices[2] >= mesh->mNumVertices) {
+                continue;
+            }
+            indices << remap[face.mIndices[0]]
+                    << remap[face.mIndices[1]]
+                    << remap[face.mIndices[2]];
         }
     }
 
-    if (data->vertices.isEmpty()) {
+    if (indices.isEmpty()) {
         if (errorMessage) {
             *errorMessage = QStringLiteral("模型无有效三角面: %1").arg(path);
         }
         return QSharedPointer<MeshData>();
     }
 
+    setLevels(data.data(), indices);
+    data->vertices.squeeze();
     data->minBounds = minBounds;
     data->maxBounds = maxBounds;
+    if (!cachePath.isEmpty()) {
+        writeMeshCache(cachePath, *data);
+    }
     return data;
 }
 
-QSharedPointer<MeshData> ModelCache::placeholderModel()
+QSharedPointer<MeshData> ModelCache::createPlaceholder()
 {
-    if (m_placeholder) {
-        return m_placeholder;
-    }
-
     auto data = QSharedPointer<MeshData>::create();
-    const QVector3D p000(0.0f, 0.0f, 0.0f);
-    const QVector3D p100(1.0f, 0.0f, 0.0f);
-    const QVector3D p010(0.0f, 1.0f, 0.0f);
-    const QVector3D p110(1.0f, 1.0f, 0.0f);
-    const QVector3D p001(0.0f, 0.0f, 1.0f);
-    const QVector3D p101(1.0f, 0.0f, 1.0f);
-    const QVector3D p011(0.0f, 1.0f, 1.0f);
-    const QVector3D p111(1.0f, 1.0f, 1.0f);
-
-    data->vertices << p000 << p100 << p110;
-    data->vertices << p000 << p110 << p010;
-    data->vertices << p001 << p101 << p111;
-    data->vertices << p001 << p111 << p011;
-    data->vertices << p000 << p100 << p101;
-    data->vertices << p000 << p101 << p001;
-    data->vertices << p010 << p110 << p111;
-    data->vertices << p010 << p111 << p011;
-    data->vertices << p000 << p010 << p011;
-    data->vertices << p000 << p011 << p001;
-    data->vertices << p100 << p110 << p111;
-    data->vertices << p100 << p111 << p101;
+    // Four corners per face, so every face gets its own normal.
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int side = 0; side < 2; ++side) {
+            QVector3D normal;
+            normal[axis] = side ? 1.0f : -1.0f;
+            const quint32 packed = MeshVertex::packNormal(normal);
+            const quint16 first = static_cast<quint16>(data->vertices.size());
+            for (int corner = 0; corner < 4; ++corner) {
+                QVector3D pos;
+                pos[axis] = float(side);
+                pos[(axis + 1) % 3] = float(corner & 1);
+                pos[(axis + 2) % 3] = float(corner >> 1);
+                data->vertices.append(MeshVertex(pos, packed));
+            }
+            data->indices16 << first << quint16(first + 1) << quint16(first + 3)
+                            << first << quint16(first + 3) << quint16(first + 2);
+        }
+    }
 
+    data->levels = {MeshData::Level{0, data->indexCount()}};
     data->minBounds = QVector3D(0.0f, 0.0f, 0.0f);
     data->maxBounds = QVector3D(1.0f, 1.0f, 1.0f);
-    m_placeholder = data;
-    return m_placeholder;
+    return data;
+}
+
+QString ModelCache::memoryReport() const
+{
+    QMutexLocker locker(&m_mutex);
+    QString report;
+    qint64 totalBefore = 0;
+    qint64 totalAfter = 0;
+    for (auto it = m_cache.cbegin(); it != m_cache.cend(); ++it) {
+        const QSharedPointer<MeshData> &mesh = it->mesh;
+        if (!mesh || mesh == m_placeholder) {
+            continue;
+        }
+        totalBefore += mesh->unindexedBytes();
+        totalAfter += mesh->memoryBytes();
+        QStringList levelTriangles;
+        for (const MeshData::Level &level : mesh->levels) {
+            levelTriangles.append(QString::number(level.indexCount / 3));
+        }
+        report += QStringLiteral("%1: %2 -> %3 字节 (%4 顶点, %5 位索引, 三角形 %6)\n")
+                      .arg(QFileInfo(it.key()).fileName())
+                      .arg(mesh->unindexedBytes())
+                      .arg(mesh->memoryBytes())
+                      .arg(mesh->vertices.size())
+                      .arg(mesh->indices16.isEmpty() ? 32 : 16)
+                      .arg(levelTriangles.join(QStringLiteral(" / ")));
+    }
+    report += QStringLiteral("合计: %1 -> %2 字节\n").arg(totalBefore).arg(totalAfter);
+    report += QStringLiteral("常驻: %1 / %2 字节, 命中 %3, 未命中 %4, 加载 %5 (失败 %6), 淘汰 %7\n")
+                  .arg(m_residentBytes)
+                  .arg(m_budgetBytes)
+                  .arg(m_statistics.hits)
+                  .arg(m_statistics.misses)
+                  .arg(m_statistics.loads)
+                  .arg(m_statistics.failedLoads)
+                  .arg(m_statistics.evictions);
+    report += QStringLiteral("加载耗时:");
+    for (int bucket = 0; bucket < LoadTimeBuckets; ++bucket) {
+        const QString label = bucket < LoadTimeBuckets - 1
+            ? QStringLiteral("<%1ms").arg(qint64(1) << (2 * bucket))
+            : QStringLiteral(">=%1ms").arg(qint64(1) << (2 * (bucket - 1)));
+        report += QStringLiteral(" %1: %2").arg(label).arg(m_statistics.loadTimeHistogram[bucket]);
+    }
+    report += QLatin1Char('\n');
+    return report;
 }
@@ -1,16 +1,55 @@
 ﻿#ifndef MODELCACHE_H
 #define MODELCACHE_H
 
+#include "meshvertex.h"
+
 #include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
 #include <QSharedPointer>
+#include <QThreadPool>
+#include <QWeakPointer>
 #include <QVector>
 #include <QVector3D>
 
 struct MeshData {
-    QVector<QVector3D> vertices;
+    // A range of the index array drawing the whole model.
+    struct Level {
+        int firstIndex = 0;
+        int indexCount = 0;
+    };
+
+    // Unique position and normal pairs, drawn as an indexed triangle list.
+    // Only one index array is filled: 16-bit whenever the vertex count
+    // allows it.
+    QVector<MeshVertex> vertices;
+    QVector<quint16> indices16;
+    QVector<quint32> indices32;
+    // Detail levels within the index array, full detail first. Coarser
+    // levels draw the same vertices with most of them collapsed away.
+    QVector<Level> levels;
     QVector3D minBounds;
     QVector3D maxBounds;
 
+    // Indices of every level together.
+    int indexCount() const {
+        return static_cast<int>(indices16.isEmpty() ? indices32.size()
+                                                    : indices16.size());
+    }
+
+    // Bytes held by the vertex and index arrays.
+    qint64 memoryBytes() const {
+        return vertices.size() * qint64(sizeof(MeshVertex))
+               + indices16.size() * qint64(sizeof(quint16))
+               + indices32.size() * qint64(sizeof(quint32));
+    }
+
+    // Bytes the full-detail mesh would need as an unindexed triangle list.
+    qint64 unindexedBytes() const {
+        return levels.isEmpty() ? 0 : levels.first().indexCount * qint64(sizeof(MeshVertex));
+    }
+
     QVector3D size() const {
         return maxBounds - minBounds;
     }
@@ -22,23 +61,82 @@ struct MeshData {
     }
 };
 
-class ModelCache
+// Meshes loaded from furniture model files, shared by every item that uses
+// the same file. All public functions may be called from any thread.
+class ModelCache : public QObject
 {
+    Q_OBJECT
+
 public:
+    enum { LoadTimeBuckets = 6 };
+
+    struct Statistics {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 loads = 0;
+        quint64 failedLoads = 0;
+        quint64 evictions = 0;
+        qint64 residentBytes = 0;
+        // Loads taking <1, <4, <16, <64, <256 and >=256 ms.
+        quint64 loadTimeHistogram[LoadTimeBuckets] = {};
+    };
+
     static ModelCache *instance();
+    ~ModelCache() override;
 
+    // Returns the cached mesh, or the placeholder cube while the file is
+    // parsed on a worker thread. modelReady() is emitted once it is cached.
+    QSharedPointer<MeshData> requestModel(const QString &path);
+    // Loads on the calling thread if the model is not cached yet.
     QSharedPointer<MeshData> getModel(const QString &path,
                                       QString *errorMessage = nullptr);
+    QSharedPointer<MeshData> placeholderModel() const;
+    // Parses the file, or reads its on-disk mesh cache, bypassing this
+    // cache altogether.
+    static QSharedPointer<MeshData> loadModel(const QString &path,
+                                              QString *errorMessage = nullptr);
+
+    // Meshes no furniture uses any more are dropped, least recently used
+    // first, while the cache holds more than this many bytes.
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const;
+    Statistics statistics() const;
+    QString memoryReport() const;
+
+signals:
+    void modelReady(const QString &path);
 
 private:
-    ModelCache() = default;
+    struct Entry {
+        QSharedPointer<MeshData> mesh;
+        // Handle given to callers; null once nobody uses the mesh.
+        QWeakPointer<MeshData> handle;
+        qint64 bytes = 0;
+        quint64 lastUse = 0;
+    };
+
+    ModelCache();
 
-    QSharedPointer<MeshData> loadModel(const QString &path,
-                                       QString *errorMessage = nullptr);
-    QSharedPointer<MeshData> placeholderModel();
+    static QSharedPointer<MeshData> createPlaceholder();
+    void finishLoad(const QString &path,
+                    const QSharedPointer<MeshData> &model,
+                    qint64 elapsedMs);
+    // The functions below expect m_mutex to be held.
+    Entry &insertModel(const QString &path,
+                       const QSharedPointer<MeshData> &model,
+                       qint64 elapsedMs);
+    QSharedPointer<MeshData> acquire(Entry &entry);
+    void trim();
 
-    QHash<QString, QSharedPointer<MeshData>> m_cache;
-    QSharedPointer<MeshData> m_placeholder;
+    mutable QMutex m_mutex;
+    QHash<QString, Entry> m_cache;
+    QSet<QString> m_loading;
+    const QSharedPointer<MeshData> m_placeholder;
+    qint64 m_budgetBytes;
+    qint64 m_residentBytes;
+    quint64 m_useClock;
+    Statistics m_statistics;
+    QThreadPool m_pool;
 };
 
 #endif // MODELCACHE_H
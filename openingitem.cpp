@@ -1,5 +1,8 @@
 #include "openingitem.h"
 
+#include "designscene.h"
+#include "levelofdetail.h"
+#include "meshrevision.h"
 #include "wallitem.h"
 
 #include <QPainter>
@@ -10,6 +13,7 @@
 #include <QLineF>
 #include <QtMath>
 #include <QVector2D>
+#include <QUuid>
 #include <QtGlobal>
 #include <cmath>
 
@@ -81,6 +85,7 @@ OpeningItem::OpeningItem(Kind kind,
                          qreal sillHeight,
                          QGraphicsItem *parent)
     : QGraphicsItem(parent)
+    , m_id(QUuid::createUuid().toString(QUuid::WithoutBraces))
     , m_kind(kind)
     , m_style(style)
     , m_width(width)
@@ -91,6 +96,7 @@ OpeningItem::OpeningItem(Kind kind,
     , m_flipped(false)
     , m_ignorePositionChange(false)
     , m_wall(nullptr)
+    , m_meshRevision(nextMeshRevision())
 {
     setFlag(QGraphicsItem::ItemIsSelectable, true);
     setFlag(QGraphicsItem::ItemIsMovable, true);
@@ -99,6 +105,23 @@ OpeningItem::OpeningItem(Kind kind,
     setZValue(1.0);  // 略高于墙体(0.0)，但低于家具(5.0)
 }
 
+OpeningItem::~OpeningItem()
+{
+    DesignScene::reportItemChange(this, SceneChange_Removed);
+}
+
+QString OpeningItem::id() const
+{
+    return m_id;
+}
+
+void OpeningItem::setId(const QString &id)
+{
+    if (!id.isEmpty()) {
+        m_id = id;
+    }
+}
+
 OpeningItem::Kind OpeningItem::kind() const
 {
     return m_kind;
@@ -134,18 +157,24 @@ QString OpeningItem::styleLabel() const
     }
 }
 
+ProjectSnapshot::Opening OpeningItem::snapshot() const
+{
+    ProjectSnapshot::Opening opening;
+    opening.id = m_id;
+    opening.type = kindToString(m_kind);
+    opening.style = styleToString(m_style);
+    opening.wallId = m_wall ? m_wall->id() : QString();
+    opening.distanceFromStart = m_distance;
+    opening.width = m_width;
+    opening.height = m_height;
+    opening.sillHeight = m_sillHeight;
+    opening.flipped = m_flipped;
+    return opening;
+}
+
 QJsonObject OpeningItem::toJson() const
 {
-    QJsonObject obj;
-    obj["type"] = kindToString(m_kind);
-    obj["style"] = styleToString(m_style);
-    obj["wall_id"] = m_wall ? m_wall->id() : QString();
-    obj["distance_from_start"] = m_distance;
-    obj["width"] = m_width;
-    obj["height"] = m_height;
-    obj["sill_height"] = m_sillHeight;
-    obj["flipped"] = m_flipped;
-    return obj;
+    return ProjectSnapshot::toJson(snapshot());
 }
 
 OpeningItem *OpeningItem::fromJson(const QJsonObject &json, WallItem *wall)
@@ -165,6 +194,7 @@ OpeningItem *OpeningItem::fromJson(const QJsonObject &json, WallItem *wall)
                            .toDouble(json.value("sill").toDouble(0.0));
 
     OpeningItem *opening = new OpeningItem(kind, style, width, height, sill);
+    opening->setId(json.value("id").toString());
     opening->setPreview(false);
     opening->setWall(wall);
     if (wall) {
@@ -183,6 +213,7 @@ void OpeningItem::setWall(WallItem *wall)
         return;
     }
     m_wall = wall;
+    markMeshChanged(SceneChange_Property);
     syncWithWall();
 }
 
@@ -198,6 +229,7 @@ void OpeningItem::setDistanceFromStart(qreal distance)
         return;
     }
     m_distance = clamped;
+    markMeshChanged(SceneChange_Geometry);
     syncWithWall();
 }
 
@@ -214,6 +246,7 @@ void OpeningItem::setWidth(qreal width)
     prepareGeometryChange();
     m_width = width;
     m_distance = clampDistance(m_distance);
+    markMeshChanged(SceneChange_Geometry);
     syncWithWall();
 }
 
@@ -228,6 +261,7 @@ void OpeningItem::setHeight(qreal height)
         return;
     }
     m_height = height;
+    markMeshChanged(SceneChange_Geometry);
     update();
 }
 
@@ -239,6 +273,7 @@ qreal OpeningItem::height() const
 void OpeningItem::setSillHeight(qreal height)
 {
     m_sillHeight = qMax(0.0, height);
+    markMeshChanged(SceneChange_Geometry);
     update();
 }
 
@@ -267,6 +302,7 @@ void OpeningItem::setFlipped(bool flipped)
         return;
     }
     m_flipped = flipped;
+    markMeshChanged(SceneChange_Property);
     update();
 }
 
@@ -280,6 +316,11 @@ void OpeningItem::toggleFlip()
     setFlipped(!m_flipped);
 }
 
+quint64 OpeningItem::meshRevision() const
+{
+    return m_meshRevision;
+}
+
 void OpeningItem::syncWithWall()
 {
     if (!m_wall) {
@@ -335,6 +376,11 @@ void OpeningItem::paint(QPainter *painter,
     Q_UNUSED(option);
     Q_UNUSED(widget);
 
+    const SymbolDetail detail = symbolDetail(painter, m_width);
+    if (detail == SymbolDetail::Hidden) {
+        return;
+    }
+
     painter->save();
     painter->setRenderHint(QPainter::Antialiasing, true);
 
@@ -347,7 +393,10 @@ void OpeningItem::paint(QPainter *painter,
     painter->setPen(symbolPen);
     painter->setBrush(Qt::NoBrush);
 
-    if (m_kind == Kind::Door) {
+    if (detail == SymbolDetail::Footprint) {
+        // Swings, sashes and arrows would be a smudge of sub-pixel paths.
+        painter->drawRect(maskRect);
+    } else if (m_kind == Kind::Door) {
         painter->drawRect(maskRect);
 
         const qreal swingDir = m_flipped ? -1.0 : 1.0;
@@ -495,14 +544,26 @@ QVariant OpeningItem::itemChange(GraphicsItemChange change, const QVariant &valu
         qreal distance = projectDistance(proposed);
         distance = clampDistance(distance);
         m_distance = distance;
+        markMeshChanged(SceneChange_Geometry);
         return startPointForDistance(distance);
     }
+    if (change == ItemSceneChange) {
+        DesignScene::reportItemChange(this, SceneChange_Removed);
+    } else if (change == ItemSceneHasChanged) {
+        DesignScene::reportItemChange(this, SceneChange_Added);
+    }
     if (change == ItemSelectedHasChanged || change == ItemPositionHasChanged) {
         update();
     }
     return QGraphicsItem::itemChange(change, value);
 }
 
+void OpeningItem::markMeshChanged(SceneChangeFlags flags)
+{
+    m_meshRevision = nextMeshRevision();
+    DesignScene::reportItemChange(this, flags);
+}
+
 void OpeningItem::mousePressEvent(QGraphicsSceneMouseEvent *event)
 {
     if (m_kind == Kind::Door && isSelected() &&
@@ -1,6 +1,9 @@
 #ifndef OPENINGITEM_H
 #define OPENINGITEM_H
 
+#include "projectsnapshot.h"
+#include "scenechange.h"
+
 #include <QGraphicsItem>
 #include <QPolygonF>
 #include <QString>
@@ -34,12 +37,16 @@ public:
                 qreal height,
                 qreal sillHeight = 0.0,
                 QGraphicsItem *parent = nullptr);
+    ~OpeningItem() override;
 
     Kind kind() const;
     Style style() const;
     QString kindLabel() const;
     QString styleLabel() const;
 
+    QString id() const;
+    void setId(const QString &id);
+
     void setWall(WallItem *wall);
     WallItem *wall() const;
 
@@ -64,6 +71,9 @@ public:
 
     void syncWithWall();
 
+    quint64 meshRevision() const;
+
+    ProjectSnapshot::Opening snapshot() const;
     QJsonObject toJson() const;
     static OpeningItem *fromJson(const QJsonObject &json, WallItem *wall);
 
@@ -90,7 +100,9 @@ private:
     qreal projectDistance(const QPointF &scenePos) const;
     qreal clampDistance(qreal distance) const;
     void updateFlags();
+    void markMeshChanged(SceneChangeFlags flags);
 
+    QString m_id;
     Kind m_kind;
     Style m_style;
     qreal m_width;
@@ -101,6 +113,7 @@ private:
     bool m_flipped;
     bool m_ignorePositionChange;
     WallItem *m_wall;
+    quint64 m_meshRevision;
 };
 
 #endif // OPENINGITEM_H
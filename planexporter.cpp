@@ -0,0 +1,471 @@
+#include "planexporter.h"
+
+#include <QFileInfo>
+#include <QFuture>
+#include <QGraphicsScene>
+#include <QIODevice>
+#include <QPainter>
+#include <QQueue>
+#include <QSaveFile>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#include <csetjmp>
+#include <cstdio>
+
+#include <jpeglib.h>
+#include <jerror.h>
+#include <zlib.h>
+
+namespace {
+// Rendered bytes per band; the band height follows from the width.
+constexpr qint64 kBandBytes = 16 * 1024 * 1024;
+// Largest export in a format that is only written whole: 256 MiB of RGB32,
+// about 8000 pixels square.
+constexpr qint64 kMaxInMemoryBytes = 256LL * 1024 * 1024;
+// Qt's own default for JPEG.
+constexpr int kJpegQuality = 75;
+constexpr qint64 kJpegBufferBytes = 64 * 1024;
+const char kPngSignature[] = "\x89PNG\r\n\x1a\n";
+constexpr uchar kPngFilterUp = 2;
+
+struct PngBand {
+    QByteArray data;
+    uLong adler = 0;
+    qint64 rawSize = 0;
+};
+
+void appendBigEndian(QByteArray &data, quint32 value)
+{
+    char bytes[4];
+    qToBigEndian(value, bytes);
+    data.append(bytes, 4);
+}
+
+void appendLittleEndian(QByteArray &data, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    data.append(bytes, 4);
+}
+
+void appendLittleEndian16(QByteArray &data, quint16 value)
+{
+    char bytes[2];
+    qToLittleEndian(value, bytes);
+    data.append(bytes, 2);
+}
+
+bool writePngChunk(QIODevice *device, const char *type, const QByteArray &data)
+{
+    QByteArray chunk;
+    chunk.reserve(data.size() + 12);
+    appendBigEndian(chunk, static_cast<quint32>(data.size()));
+    chunk.append(type, 4);
+    chunk.append(data);
+    const uLong crc = crc32(crc32(0L, Z_NULL, 0),
+                            reinterpret_cast<const Bytef *>(chunk.constData() + 4),
+                            static_cast<uInt>(data.size() + 4));
+    appendBigEndian(chunk, static_cast<quint32>(crc));
+    return device->write(chunk) == chunk.size();
+}
+
+// Bands are white-filled, so premultiplied and straight RGB agree.
+void toRgb(const QImage &image, int y, uchar *out)
+{
+    const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+    for (int x = 0; x < image.width(); ++x) {
+        *out++ = static_cast<uchar>(qRed(line[x]));
+        *out++ = static_cast<uchar>(qGreen(line[x]));
+        *out++ = static_cast<uchar>(qBlue(line[x]));
+    }
+}
+
+// Filters and deflates one band as a piece of a single zlib stream, the way
+// pigz does: every band but the last ends on a byte-aligned sync flush so
+// the pieces concatenate, and the stream's Adler-32 is combined from the
+// pieces afterwards. previousRow is the row above the band, if any.
+PngBand deflatePngBand(const QImage &band, const QImage &previousRow, bool last)
+{
+    const int rowBytes = band.width() * 3;
+    QByteArray above(rowBytes, 0);
+    if (!previousRow.isNull()) {
+        toRgb(previousRow, 0, reinterpret_cast<uchar *>(above.data()));
+    }
+    QByteArray current(rowBytes, Qt::Uninitialized);
+
+    QByteArray raw;
+    raw.resize(static_cast<qsizetype>(rowBytes + 1) * band.height());
+    uchar *out = reinterpret_cast<uchar *>(raw.data());
+    for (int y = 0; y < band.height(); ++y) {
+        toRgb(band, y, reinterpret_cast<uchar *>(current.data()));
+        const uchar *row = reinterpret_cast<const uchar *>(current.constData());
+        const uchar *up = reinterpret_cast<const uchar *>(above.constData());
+        *out++ = kPngFilterUp;
+        for (int i = 0; i < rowBytes; ++i) {
+            *out++ = static_cast<uchar>(row[i] - up[i]);
+        }
+        above.swap(current);
+    }
+
+    PngBand result;
+    result.rawSize = raw.size();
+    result.adler = adler32(adler32(0L, Z_NULL, 0),
+                           reinterpret_cast<const Bytef *>(raw.constData()),
+                           static_cast<uInt>(raw.size()));
+
+    z_stream stream{};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return PngBand();
+    }
+    // The bound covers a finished stream; a sync flush adds an empty stored
+    // block of at most five bytes.
+    result.data.resize(static_cast<qsizetype>(deflateBound(&stream, raw.size())) + 16);
+    stream.next_in = reinterpret_cast<Bytef *>(raw.data());
+    stream.avail_in = static_cast<uInt>(raw.size());
+    stream.next_out = reinterpret_cast<Bytef *>(result.data.data());
+    stream.avail_out = static_cast<uInt>(result.data.size());
+    const int status = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    const bool ok = last ? status == Z_STREAM_END
+                         : status == Z_OK && stream.avail_in == 0 && stream.avail_out > 0;
+    result.data.resize(static_cast<qsizetype>(stream.total_out));
+    deflateEnd(&stream);
+    return ok ? result : PngBand();
+}
+
+// libjpeg reports fatal errors, including failed writes, through
+// error_exit, which must not return.
+struct JpegError {
+    jpeg_error_mgr manager;
+    std::jmp_buf jump;
+};
+
+void jpegErrorExit(j_common_ptr info)
+{
+    std::longjmp(reinterpret_cast<JpegError *>(info->err)->jump, 1);
+}
+
+void jpegOutputMessage(j_common_ptr)
+{
+}
+
+struct JpegDestination {
+    jpeg_destination_mgr manager;
+    QIODevice *device;
+    QByteArray buffer;
+};
+
+void jpegInitDestination(j_compress_ptr info)
+{
+    auto *destination = reinterpret_cast<JpegDestination *>(info->dest);
+    destination->manager.next_output_byte = reinterpret_cast<JOCTET *>(destination->buffer.data());
+    destination->manager.free_in_buffer = static_cast<size_t>(destination->buffer.size());
+}
+
+boolean jpegEmptyBuffer(j_compress_ptr info)
+{
+    // Called with the whole buffer full, whatever free_in_buffer says.
+    auto *destination = reinterpret_cast<JpegDestination *>(info->dest);
+    if (destination->device->write(destination->buffer) != destination->buffer.size()) {
+        ERREXIT(info, JERR_FILE_WRITE);
+    }
+    jpegInitDestination(info);
+    return TRUE;
+}
+
+void jpegTermDestination(j_compress_ptr info)
+{
+    auto *destination = reinterpret_cast<JpegDestination *>(info->dest);
+    const qint64 used = destination->buffer.size()
+                        - static_cast<qint64>(destination->manager.free_in_buffer);
+    if (destination->device->write(destination->buffer.constData(), used) != used) {
+        ERREXIT(info, JERR_FILE_WRITE);
+    }
+}
+
+// Drives libjpeg. Every step sets its own return point and keeps no
+// locals with destructors, so a longjmp out of libjpeg skips nothing.
+class JpegWriter
+{
+public:
+    explicit JpegWriter(QIODevice *device)
+    {
+        m_info.err = jpeg_std_error(&m_error.manager);
+        m_error.manager.error_exit = jpegErrorExit;
+        m_error.manager.output_message = jpegOutputMessage;
+        m_destination.device = device;
+        m_destination.buffer.resize(kJpegBufferBytes);
+        m_destination.manager.init_destination = jpegInitDestination;
+        m_destination.manager.empty_output_buffer = jpegEmptyBuffer;
+        m_destination.manager.term_destination = jpegTermDestination;
+    }
+
+    ~JpegWriter()
+    {
+        if (m_created) {
+            jpeg_destroy_compress(&m_info);
+        }
+    }
+
+    bool start(const QSize &size)
+    {
+        if (setjmp(m_error.jump)) {
+            return false;
+        }
+        jpeg_create_compress(&m_info);
+        m_created = true;
+        m_info.dest = &m_destination.manager;
+        m_info.image_width = static_cast<JDIMENSION>(size.width());
+        m_info.image_height = static_cast<JDIMENSION>(size.height());
+        m_info.input_components = 3;
+        m_info.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&m_info);
+        jpeg_set_quality(&m_info, kJpegQuality, TRUE);
+        jpeg_start_compress(&m_info, TRUE);
+        m_row.resize(static_cast<qsizetype>(size.width()) * 3);
+        return true;
+    }
+
+    bool write(const QImage &band)
+    {
+        if (setjmp(m_error.jump)) {
+            return false;
+        }
+        for (int y = 0; y < band.height(); ++y) {
+            toRgb(band, y, reinterpret_cast<uchar *>(m_row.data()));
+            JSAMPROW row = reinterpret_cast<JSAMPROW>(m_row.data());
+            jpeg_write_scanlines(&m_info, &row, 1);
+        }
+        return true;
+    }
+
+    bool finish()
+    {
+        if (setjmp(m_error.jump)) {
+            return false;
+        }
+        jpeg_finish_compress(&m_info);
+        return true;
+    }
+
+private:
+    jpeg_compress_struct m_info{};
+    JpegError m_error{};
+    JpegDestination m_destination{};
+    bool m_created = false;
+    QByteArray m_row;
+};
+} // namespace
+
+PlanExporter::PlanExporter(QGraphicsScene *scene, const QRectF &sourceRect, const QSize &size)
+    : m_scene(scene)
+    , m_sourceRect(sourceRect)
+    , m_size(size)
+    , m_scale(qMin(size.width() / sourceRect.width(), size.height() / sourceRect.height()))
+{
+}
+
+bool PlanExporter::write(const QString &path, QString *errorMessage) const
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    const bool jpeg = suffix == QLatin1String("jpg") || suffix == QLatin1String("jpeg");
+    if (suffix != QLatin1String("png") && suffix != QLatin1String("bmp") && !jpeg) {
+        if (static_cast<qint64>(m_size.width()) * m_size.height() * 4 > kMaxInMemoryBytes) {
+            if (errorMessage) {
+                *errorMessage = QStringLiteral("图片过大（%1×%2），%3 格式只能整张写入。"
+                                               "请导出为 PNG、JPEG 或 BMP，或降低分辨率。")
+                                    .arg(m_size.width())
+                                    .arg(m_size.height())
+                                    .arg(suffix.toUpper());
+            }
+            return false;
+        }
+        QImage image(m_size, QImage::Format_RGB32);
+        QPainter painter(&image);
+        const int rows = bandHeight();
+        for (int top = 0; top < m_size.height(); top += rows) {
+            painter.drawImage(0, top, renderBand(top, qMin(rows, m_size.height() - top)));
+        }
+        painter.end();
+        if (!image.save(path)) {
+            if (errorMessage) {
+                *errorMessage = QStringLiteral("无法写入图片: %1").arg(path);
+            }
+            return false;
+        }
+        return true;
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorMessage) {
+            *errorMessage = QStringLiteral("无法写入图片: %1").arg(path);
+        }
+        return false;
+    }
+
+    const bool written = suffix == QLatin1String("png") ? writePng(&file)
+                       : jpeg                           ? writeJpeg(&file)
+                                                        : writeBmp(&file);
+    if (!written || !file.commit()) {
+        file.cancelWriting();
+        if (errorMessage) {
+            *errorMessage = QStringLiteral("导出失败: %1").arg(path);
+        }
+        return false;
+    }
+    return true;
+}
+
+int PlanExporter::bandHeight() const
+{
+    const qint64 rowBytes = static_cast<qint64>(m_size.width()) * 4;
+    return static_cast<int>(qBound<qint64>(1, kBandBytes / rowBytes, m_size.height()));
+}
+
+QImage PlanExporter::renderBand(int top, int rows) const
+{
+    QImage band(m_size.width(), rows, QImage::Format_ARGB32_Premultiplied);
+    band.fill(Qt::white);
+
+    // The band's slice of the source keeps the scale of a single render of
+    // the whole image, so lines meet exactly across band edges.
+    const QRectF source(m_sourceRect.left(),
+                        m_sourceRect.top() + top / m_scale,
+                        m_size.width() / m_scale,
+                        rows / m_scale);
+    QPainter painter(&band);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    m_scene->render(&painter, QRectF(0.0, 0.0, m_size.width(), rows), source,
+                    Qt::IgnoreAspectRatio);
+    painter.end();
+    return band;
+}
+
+bool PlanExporter::writePng(QIODevice *device) const
+{
+    if (device->write(kPngSignature, 8) != 8) {
+        return false;
+    }
+
+    QByteArray header;
+    appendBigEndian(header, static_cast<quint32>(m_size.width()));
+    appendBigEndian(header, static_cast<quint32>(m_size.height()));
+    // 8-bit RGB, deflate, adaptive filtering, no interlace.
+    header.append(char(8));
+    header.append(char(2));
+    header.append(char(0));
+    header.append(char(0));
+    header.append(char(0));
+    if (!writePngChunk(device, "IHDR", header)) {
+        return false;
+    }
+
+    // Each finished band becomes one IDAT chunk, written in order while
+    // later bands are still being compressed.
+    const int maxInFlight = qMax(2, QThread::idealThreadCount());
+    const int rows = bandHeight();
+    QQueue<QFuture<PngBand>> pending;
+    QImage previousRow;
+    uLong adler = adler32(0L, Z_NULL, 0);
+    bool first = true;
+
+    for (int top = 0; top < m_size.height(); top += rows) {
+        const int bandRows = qMin(rows, m_size.height() - top);
+        const bool last = top + bandRows >= m_size.height();
+        const QImage band = renderBand(top, bandRows);
+        pending.enqueue(QtConcurrent::run(deflatePngBand, band, previousRow, last));
+        previousRow = band.copy(0, bandRows - 1, band.width(), 1);
+
+        while (!pending.isEmpty() && (pending.size() >= maxInFlight || last)) {
+            const PngBand result = pending.dequeue().result();
+            if (result.data.isEmpty()) {
+                return false;
+            }
+
+            QByteArray data;
+            if (first) {
+                // zlib header: deflate, 32K window, default level.
+                data.append(char(0x78));
+                data.append(char(0x9c));
+                first = false;
+            }
+            data.append(result.data);
+            adler = adler32_combine(adler, result.adler, result.rawSize);
+            if (last && pending.isEmpty()) {
+                appendBigEndian(data, static_cast<quint32>(adler));
+            }
+            if (!writePngChunk(device, "IDAT", data)) {
+                return false;
+            }
+        }
+    }
+
+    return writePngChunk(device, "IEND", QByteArray());
+}
+
+bool PlanExporter::writeJpeg(QIODevice *device) const
+{
+    JpegWriter writer(device);
+    if (!writer.start(m_size)) {
+        return false;
+    }
+    const int rows = bandHeight();
+    for (int top = 0; top < m_size.height(); top += rows) {
+        if (!writer.write(renderBand(top, qMin(rows, m_size.height() - top)))) {
+            return false;
+        }
+    }
+    return writer.finish();
+}
+
+bool PlanExporter::writeBmp(QIODevice *device) const
+{
+    const int rowBytes = m_size.width() * 3;
+    const int stride = (rowBytes + 3) & ~3;
+    const quint32 imageBytes = static_cast<quint32>(stride) * m_size.height();
+
+    // BITMAPFILEHEADER and BITMAPINFOHEADER. The negative height marks the
+    // rows as top-down, so they can be written in render order.
+    QByteArray header;
+    header.append("BM", 2);
+    appendLittleEndian(header, 54 + imageBytes);
+    appendLittleEndian(header, 0);
+    appendLittleEndian(header, 54);
+    appendLittleEndian(header, 40);
+    appendLittleEndian(header, static_cast<quint32>(m_size.width()));
+    appendLittleEndian(header, static_cast<quint32>(-m_size.height()));
+    appendLittleEndian16(header, 1);
+    appendLittleEndian16(header, 24);
+    appendLittleEndian(header, 0);
+    appendLittleEndian(header, imageBytes);
+    appendLittleEndian(header, 2835);
+    appendLittleEndian(header, 2835);
+    appendLittleEndian(header, 0);
+    appendLittleEndian(header, 0);
+    if (device->write(header) != header.size()) {
+        return false;
+    }
+
+    const int rows = bandHeight();
+    QByteArray data;
+    for (int top = 0; top < m_size.height(); top += rows) {
+        const QImage band = renderBand(top, qMin(rows, m_size.height() - top));
+        data.fill(0, static_cast<qsizetype>(stride) * band.height());
+        for (int y = 0; y < band.height(); ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb *>(band.constScanLine(y));
+            uchar *out = reinterpret_cast<uchar *>(data.data()) + static_cast<qsizetype>(stride) * y;
+            for (int x = 0; x < band.width(); ++x) {
+                *out++ = static_cast<uchar>(qBlue(line[x]));
+                *out++ = static_cast<uchar>(qGreen(line[x]));
+                *out++ = static_cast<uchar>(qRed(line[x]));
+            }
+        }
+        if (device->write(data) != data.size()) {
+            return false;
+        }
+    }
+    return true;
+}
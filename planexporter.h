@@ -0,0 +1,44 @@
+#ifndef PLANEXPORTER_H
+#define PLANEXPORTER_H
+
+#include <QImage>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+
+class QGraphicsScene;
+class QIODevice;
+
+// Exports a scene region as an image of up to print size. The image is
+// rendered in horizontal bands of a few megabytes each. PNG, JPEG and BMP
+// are written band by band, so only the bands in flight are ever in memory.
+// PNG bands are filtered and deflated in parallel on the global thread
+// pool. Other formats are assembled in memory and saved by QImage, which
+// is refused for large exports.
+//
+// The scene itself is only touched on the calling thread; QGraphicsScene
+// cannot be painted from several threads at once.
+class PlanExporter
+{
+public:
+    PlanExporter(QGraphicsScene *scene, const QRectF &sourceRect, const QSize &size);
+
+    // The format follows path's suffix.
+    bool write(const QString &path, QString *errorMessage = nullptr) const;
+
+private:
+    int bandHeight() const;
+    QImage renderBand(int top, int rows) const;
+    bool writePng(QIODevice *device) const;
+    bool writeJpeg(QIODevice *device) const;
+    bool writeBmp(QIODevice *device) const;
+
+    QGraphicsScene *m_scene;
+    QRectF m_sourceRect;
+    QSize m_size;
+    // Scene units to pixels, as QGraphicsScene::render picks it for
+    // Qt::KeepAspectRatio.
+    qreal m_scale;
+};
+
+#endif // PLANEXPORTER_H
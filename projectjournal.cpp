@@ -0,0 +1,340 @@
+#include "projectjournal.h"
+
+#include "blueprintitem.h"
+#include "designscene.h"
+#include "furnitureitem.h"
+#include "openingitem.h"
+#include "wallitem.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QUuid>
+#include <QVector>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+const char kSettingsTable[] = "settings";
+const char kWallsTable[] = "walls";
+const char kOpeningsTable[] = "openings";
+const char kFurnitureTable[] = "furniture";
+constexpr int kJournalVersion = 1;
+
+// QFile::flush() only reaches the OS cache; the record is not safe from a
+// power cut until the descriptor is synced.
+bool syncFile(QFile &file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+// Rows of one project array, keyed by their "id" so records can replace or
+// drop them in place without reordering the rest.
+class RecordTable
+{
+public:
+    void load(const QJsonArray &array)
+    {
+        for (const QJsonValue &value : array) {
+            if (value.isObject()) {
+                put(value.toObject());
+            }
+        }
+    }
+
+    void put(const QJsonObject &row)
+    {
+        const QString id = row.value("id").toString();
+        if (!id.isEmpty()) {
+            const auto it = m_index.constFind(id);
+            if (it != m_index.constEnd()) {
+                m_rows[it.value()] = row;
+                return;
+            }
+            m_index.insert(id, m_rows.size());
+        }
+        m_rows.append(row);
+    }
+
+    void remove(const QString &id)
+    {
+        const auto it = m_index.find(id);
+        if (it == m_index.end()) {
+            return;
+        }
+        m_rows[it.value()] = QJsonObject();
+        m_index.erase(it);
+    }
+
+    QJsonArray toArray() const
+    {
+        QJsonArray array;
+        for (const QJsonObject &row : m_rows) {
+            if (!row.isEmpty()) {
+                array.append(row);
+            }
+        }
+        return array;
+    }
+
+private:
+    QVector<QJsonObject> m_rows;
+    QHash<QString, int> m_index;
+};
+} // namespace
+
+ProjectJournal::ProjectJournal(QThreadPool *pool)
+    : m_pool(pool)
+    , m_path()
+    , m_session()
+    , m_sequence(0)
+    , m_pendingBytes(0)
+    , m_hasBase(false)
+    , m_buffer()
+    , m_keys()
+{
+}
+
+void ProjectJournal::start(const QString &path, const DesignScene *scene)
+{
+    m_path = path;
+    m_session = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    m_sequence = 0;
+    m_pendingBytes = 0;
+    m_hasBase = false;
+    m_buffer.clear();
+    m_keys.clear();
+
+    if (!scene) {
+        return;
+    }
+    for (WallItem *wall : scene->walls()) {
+        m_keys.insert(wall, RecordKey{kWallsTable, wall->id()});
+    }
+    for (OpeningItem *opening : scene->openings()) {
+        m_keys.insert(opening, RecordKey{kOpeningsTable, opening->id()});
+    }
+    for (FurnitureItem *item : scene->furniture()) {
+        m_keys.insert(item, RecordKey{kFurnitureTable, item->id()});
+    }
+}
+
+QString ProjectJournal::path() const
+{
+    return m_path;
+}
+
+bool ProjectJournal::hasBase() const
+{
+    return m_hasBase;
+}
+
+qint64 ProjectJournal::pendingBytes() const
+{
+    return m_pendingBytes;
+}
+
+void ProjectJournal::record(const SceneChangeSet &changes, const DesignScene *scene)
+{
+    // Blueprint edits arrive either scene-wide or on the blueprint item;
+    // both end up in the settings.
+    bool settingsChanged = changes.sceneWide;
+    for (auto it = changes.items.constBegin(); it != changes.items.constEnd(); ++it) {
+        QGraphicsItem *item = it.key();
+        if (it.value().testFlag(SceneChange_Removed)) {
+            const auto key = m_keys.find(item);
+            if (key != m_keys.end()) {
+                remove(key.value());
+                m_keys.erase(key);
+            }
+            continue;
+        }
+
+        if (item->type() == BlueprintItem::Type) {
+            settingsChanged = true;
+        } else if (auto *wall = qgraphicsitem_cast<WallItem *>(item)) {
+            put(item, kWallsTable, wall->id(), ProjectSnapshot::toJson(wall->snapshot()));
+        } else if (auto *opening = qgraphicsitem_cast<OpeningItem *>(item)) {
+            put(item, kOpeningsTable, opening->id(),
+                ProjectSnapshot::toJson(opening->snapshot()));
+        } else if (auto *furniture = qgraphicsitem_cast<FurnitureItem *>(item)) {
+            put(item, kFurnitureTable, furniture->id(),
+                ProjectSnapshot::toJson(furniture->snapshot()));
+        }
+    }
+
+    if (settingsChanged && scene) {
+        QJsonObject record;
+        record["op"] = QStringLiteral("put");
+        record["table"] = QString::fromLatin1(kSettingsTable);
+        record["data"] = ProjectSnapshot::toJson(scene->settingsSnapshot());
+        append(record);
+    }
+}
+
+void ProjectJournal::flush()
+{
+    if (m_buffer.isEmpty() || m_path.isEmpty()) {
+        return;
+    }
+
+    const QString path = m_path;
+    const QByteArray data = m_buffer;
+    m_buffer.clear();
+    m_pool->start([path, data]() {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            return;
+        }
+        if (file.write(data) == data.size()) {
+            syncFile(file);
+        }
+    });
+}
+
+QJsonObject ProjectJournal::beginCompaction()
+{
+    // Records still buffered here must reach the file before the task that
+    // truncates it.
+    flush();
+
+    QJsonObject marker;
+    marker["session"] = m_session;
+    marker["seq"] = m_sequence;
+    m_hasBase = true;
+    m_pendingBytes = 0;
+    return marker;
+}
+
+void ProjectJournal::abortCompaction()
+{
+    m_hasBase = false;
+}
+
+QByteArray ProjectJournal::header() const
+{
+    QJsonObject header;
+    header["version"] = kJournalVersion;
+    header["session"] = m_session;
+    return QJsonDocument(header).toJson(QJsonDocument::Compact) + '\n';
+}
+
+bool ProjectJournal::truncate(const QString &path, const QByteArray &header)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    if (file.write(header) == -1) {
+        return false;
+    }
+    return file.commit();
+}
+
+void ProjectJournal::replay(const QByteArray &data, QJsonObject *root)
+{
+    const QJsonObject marker = root->value("journal").toObject();
+    root->remove("journal");
+
+    const QList<QByteArray> lines = data.split('\n');
+    const QJsonObject header = QJsonDocument::fromJson(lines.first()).object();
+    const QString session = header.value("session").toString();
+    if (session.isEmpty() || session != marker.value("session").toString()) {
+        // Left over from another session; the base already holds more.
+        return;
+    }
+    const qint64 baseSequence = marker.value("seq").toInteger();
+
+    const char *const tableNames[] = {kWallsTable, kOpeningsTable, kFurnitureTable};
+    QHash<QString, RecordTable> tables;
+    for (const char *name : tableNames) {
+        tables[QString::fromLatin1(name)].load(root->value(name).toArray());
+    }
+
+    for (int i = 1; i < lines.size(); ++i) {
+        if (lines.at(i).isEmpty()) {
+            continue;
+        }
+        QJsonParseError parseError{};
+        const QJsonDocument doc = QJsonDocument::fromJson(lines.at(i), &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+            // A torn write can only be the last line.
+            break;
+        }
+
+        const QJsonObject record = doc.object();
+        if (record.value("seq").toInteger() <= baseSequence) {
+            continue;
+        }
+        const QString table = record.value("table").toString();
+        if (table == QLatin1String(kSettingsTable)) {
+            root->insert(table, record.value("data"));
+            continue;
+        }
+        const auto it = tables.find(table);
+        if (it == tables.end()) {
+            continue;
+        }
+        if (record.value("op").toString() == QLatin1String("remove")) {
+            it->remove(record.value("id").toString());
+        } else {
+            it->put(record.value("data").toObject());
+        }
+    }
+
+    for (auto it = tables.constBegin(); it != tables.constEnd(); ++it) {
+        root->insert(it.key(), it->toArray());
+    }
+}
+
+void ProjectJournal::put(QGraphicsItem *item,
+                         const QString &table,
+                         const QString &id,
+                         const QJsonObject &data)
+{
+    const auto it = m_keys.constFind(item);
+    if (it != m_keys.constEnd() && (it->table != table || it->id != id)) {
+        // A new item got a deleted one's address within the same change
+        // set, so the removal was merged away.
+        remove(it.value());
+    }
+    m_keys.insert(item, RecordKey{table, id});
+
+    QJsonObject record;
+    record["op"] = QStringLiteral("put");
+    record["table"] = table;
+    record["data"] = data;
+    append(record);
+}
+
+void ProjectJournal::remove(const RecordKey &key)
+{
+    QJsonObject record;
+    record["op"] = QStringLiteral("remove");
+    record["table"] = key.table;
+    record["id"] = key.id;
+    append(record);
+}
+
+void ProjectJournal::append(QJsonObject record)
+{
+    record["seq"] = ++m_sequence;
+    const QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n';
+    m_buffer += line;
+    m_pendingBytes += line.size();
+}
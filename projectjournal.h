@@ -0,0 +1,82 @@
+#ifndef PROJECTJOURNAL_H
+#define PROJECTJOURNAL_H
+
+#include "scenechange.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+class DesignScene;
+class QGraphicsItem;
+class QJsonObject;
+class QThreadPool;
+
+// Write-ahead log of the edits made since the autosave base was written.
+// Every change set becomes a few JSON lines (one per touched wall, opening
+// or furniture item) that are buffered here and appended and synced in
+// batches on the autosave thread, so the I/O follows the size of the edit
+// rather than the size of the project.
+//
+// The journal starts with a header naming its session. A base written for
+// the same session records the last sequence number it already contains;
+// replay() applies only the records after it and ignores a journal left
+// over from another session.
+class ProjectJournal
+{
+public:
+    explicit ProjectJournal(QThreadPool *pool);
+
+    // Begins a new session on path. Nothing is written until the first
+    // record, which also needs a new base.
+    void start(const QString &path, const DesignScene *scene);
+
+    QString path() const;
+    bool hasBase() const;
+    // Bytes recorded since the base was written.
+    qint64 pendingBytes() const;
+
+    void record(const SceneChangeSet &changes, const DesignScene *scene);
+
+    // Hands buffered records to the autosave thread.
+    void flush();
+
+    // Marks everything recorded so far as part of a new base. The returned
+    // marker goes into the base file; once that is written, truncate()
+    // drops the records it covers.
+    QJsonObject beginCompaction();
+    // The base for the last beginCompaction() could not be written, so the
+    // next record asks for a new one.
+    void abortCompaction();
+    QByteArray header() const;
+    static bool truncate(const QString &path, const QByteArray &header);
+
+    // Applies the journal in data to root, the base it was written against.
+    static void replay(const QByteArray &data, QJsonObject *root);
+
+private:
+    struct RecordKey {
+        QString table;
+        QString id;
+    };
+
+    void put(QGraphicsItem *item,
+             const QString &table,
+             const QString &id,
+             const QJsonObject &data);
+    void remove(const RecordKey &key);
+    void append(QJsonObject record);
+
+    QThreadPool *m_pool;
+    QString m_path;
+    QString m_session;
+    qint64 m_sequence;
+    qint64 m_pendingBytes;
+    bool m_hasBase;
+    QByteArray m_buffer;
+    // Removed items may already be deleted, so their records are found by
+    // pointer.
+    QHash<const QGraphicsItem *, RecordKey> m_keys;
+};
+
+#endif // PROJECTJOURNAL_H
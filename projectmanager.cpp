@@ -2,6 +2,8 @@
 
 #include "designscene.h"
 
+#include <QCborMap>
+#include <QCborValue>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
@@ -17,6 +19,20 @@ const char kSettingsOrg[] = "QtPlanArchitect";
 const char kSettingsApp[] = "QtPlanArchitect";
 const char kRecentFilesKey[] = "recentFiles";
 const char kLastProjectKey[] = "lastProjectPath";
+const char kBinarySuffix[] = ".qplanb";
+// CBOR self-describe tag; every binary project starts with these bytes.
+const char kCborSignature[] = "\xd9\xd9\xf7";
+// Records are synced at most this often, so a burst of edits such as a
+// drag costs one fsync.
+constexpr int kJournalFlushMs = 1000;
+// Past this size the journal is folded into a new base, which keeps replay
+// short.
+constexpr qint64 kJournalCompactBytes = 4 * 1024 * 1024;
+
+bool isBinaryProjectPath(const QString &path)
+{
+    return path.endsWith(QLatin1String(kBinarySuffix), Qt::CaseInsensitive);
+}
 } // namespace
 
 ProjectManager *ProjectManager::instance()
@@ -33,7 +49,14 @@ ProjectManager::ProjectManager(QObject *parent)
     , m_recentFiles()
     , m_dirty(false)
     , m_loading(false)
+    , m_journal(&m_autosavePool)
 {
+    m_autosavePool.setMaxThreadCount(1);
+    m_journalTimer.setSingleShot(true);
+    m_journalTimer.setInterval(kJournalFlushMs);
+    connect(&m_journalTimer, &QTimer::timeout, this, [this]() {
+        m_journal.flush();
+    });
     loadRecentFiles();
 }
 
@@ -50,13 +73,17 @@ void ProjectManager::setScene(DesignScene *scene)
     m_scene = scene;
 
     if (m_scene) {
-        connect(m_scene, &DesignScene::sceneContentChanged, this, [this]() {
+        // Change sets never carry helper items, so any delivery is an edit.
+        connect(m_scene, &DesignScene::contentChanged, this,
+                [this](const SceneChangeSet &changes) {
             if (m_loading) {
                 return;
             }
             setDirty(true);
+            recordChanges(changes);
         });
     }
+    m_journal.start(journalPath(), m_scene);
 }
 
 DesignScene *ProjectManager::scene() const
@@ -100,12 +127,13 @@ bool ProjectManager::saveToPath(const QString &path, QString *errorMessage)
     }
 
     QString targetPath = normalizedPath(path);
-    if (!targetPath.endsWith(".qplan", Qt::CaseInsensitive)) {
+    if (!targetPath.endsWith(".qplan", Qt::CaseInsensitive)
+        && !isBinaryProjectPath(targetPath)) {
         targetPath += ".qplan";
     }
 
     const QJsonObject root = m_scene->toJson();
-    if (!writeJson(targetPath, root, errorMessage)) {
+    if (!writeProject(targetPath, root, errorMessage)) {
         return false;
     }
 
@@ -133,37 +161,21 @@ bool ProjectManager::loadFromPath(const QString &path, QString *errorMessage)
         return false;
     }
 
-    QFile file(info.absoluteFilePath());
-    if (!file.open(QIODevice::ReadOnly)) {
-        if (errorMessage) {
-            *errorMessage = QStringLiteral("无法读取文件: %1").arg(info.absoluteFilePath());
-        }
-        return false;
-    }
-
-    QJsonParseError parseError{};
-    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
-    if (parseError.error != QJsonParseError::NoError) {
-        if (errorMessage) {
-            *errorMessage = QStringLiteral("JSON 解析失败: %1").arg(parseError.errorString());
-        }
-        return false;
-    }
-    if (!doc.isObject()) {
-        if (errorMessage) {
-            *errorMessage = QStringLiteral("JSON 格式错误: 根节点需为对象");
-        }
+    QJsonObject root;
+    if (!readProject(info.absoluteFilePath(), &root, errorMessage)) {
         return false;
     }
 
     m_loading = true;
-    m_scene->fromJson(doc.object());
+    m_scene->fromJson(root);
     m_loading = false;
 
     setCurrentPath(info.absoluteFilePath());
     setDirty(false);
     addRecentFile(info.absoluteFilePath());
     setLastProjectPath(info.absoluteFilePath());
+    m_journalTimer.stop();
+    m_journal.start(journalPath(), m_scene);
     return true;
 }
 
@@ -177,31 +189,20 @@ bool ProjectManager::loadAutosave(QString *errorMessage)
         return false;
     }
 
-    QFile file(path);
-    if (!file.open(QIODevice::ReadOnly)) {
-        if (errorMessage) {
-            *errorMessage = QStringLiteral("无法读取自动保存文件: %1").arg(path);
-        }
+    QJsonObject root;
+    if (!readProject(path, &root, errorMessage)) {
         return false;
     }
 
-    QJsonParseError parseError{};
-    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
-    if (parseError.error != QJsonParseError::NoError) {
-        if (errorMessage) {
-            *errorMessage = QStringLiteral("自动保存解析失败: %1").arg(parseError.errorString());
-        }
-        return false;
-    }
-    if (!doc.isObject()) {
-        if (errorMessage) {
-            *errorMessage = QStringLiteral("自动保存格式错误: 根节点需为对象");
-        }
-        return false;
+    // Edits made after the base was written are only in the journal.
+    QFile journal(journalPath());
+    if (journal.open(QIODevice::ReadOnly)) {
+        ProjectJournal::replay(journal.readAll(), &root);
+        journal.close();
     }
 
     m_loading = true;
-    m_scene->fromJson(doc.object());
+    m_scene->fromJson(root);
     m_loading = false;
 
     if (!m_lastProjectPath.isEmpty()) {
@@ -210,9 +211,26 @@ bool ProjectManager::loadAutosave(QString *errorMessage)
         setCurrentPath(QString());
     }
     setDirty(true);
+
+    // Fold the recovered state into a fresh base right away, so the next
+    // crash does not depend on the old journal.
+    m_journalTimer.stop();
+    m_journal.start(journalPath(), m_scene);
+    saveAutosave();
     return true;
 }
 
+bool ProjectManager::convertProject(const QString &sourcePath,
+                                    const QString &targetPath,
+                                    QString *errorMessage) const
+{
+    QJsonObject root;
+    if (!readProject(sourcePath, &root, errorMessage)) {
+        return false;
+    }
+    return writeProject(normalizedPath(targetPath), root, errorMessage);
+}
+
 void ProjectManager::clearCurrentProject()
 {
     setCurrentPath(QString());
@@ -249,11 +267,20 @@ QString ProjectManager::autosavePath() const
     return dir.filePath("untitled.autosave.qplan");
 }
 
+QString ProjectManager::journalPath() const
+{
+    QFileInfo info(autosavePath());
+    return info.dir().filePath(info.completeBaseName() + ".journal");
+}
+
 bool ProjectManager::saveAutosave(QString *errorMessage)
 {
     if (!m_scene || !m_dirty) {
         return false;
     }
+    if (m_journal.hasBase() && m_journal.pendingBytes() == 0) {
+        return false;
+    }
 
     const QString path = autosavePath();
     if (path.isEmpty()) {
@@ -271,8 +298,34 @@ bool ProjectManager::saveAutosave(QString *errorMessage)
         return false;
     }
 
-    const QJsonObject root = m_scene->toJson();
-    return writeJson(path, root, errorMessage);
+    // Only the value copy happens here; building the JSON tree, formatting
+    // and writing it stay off the GUI thread. QSaveFile renames into place,
+    // so a reader never sees a half-written file. The journal is emptied
+    // only once the base holding its records is on disk; until then the
+    // marker makes replay skip them.
+    m_journalTimer.stop();
+    const QJsonObject marker = m_journal.beginCompaction();
+    const QString journal = m_journal.path();
+    const QByteArray header = m_journal.header();
+    const ProjectSnapshot snapshot = m_scene->snapshot();
+    m_autosavePool.start([this, snapshot, path, marker, journal, header]() {
+        QJsonObject root = snapshot.toJson();
+        root["journal"] = marker;
+        QString error;
+        const bool saved = writeJson(path, root, &error);
+        if (saved) {
+            ProjectJournal::truncate(journal, header);
+        }
+        QMetaObject::invokeMethod(this, [this, saved, error]() {
+            // The journal still holds every record, but replay only applies
+            // them to a base of the same session.
+            if (!saved) {
+                m_journal.abortCompaction();
+            }
+            emit autosaveFinished(saved, error);
+        }, Qt::QueuedConnection);
+    });
+    return true;
 }
 
 bool ProjectManager::hasAutosave() const
@@ -283,10 +336,15 @@ bool ProjectManager::hasAutosave() const
 
 void ProjectManager::removeAutosave()
 {
+    // A save still in flight would otherwise recreate the file.
+    m_journalTimer.stop();
+    m_autosavePool.waitForDone();
     const QString path = autosavePath();
     if (!path.isEmpty()) {
         QFile::remove(path);
+        QFile::remove(journalPath());
     }
+    m_journal.start(journalPath(), m_scene);
 }
 
 QStringList ProjectManager::recentFiles() const
@@ -356,6 +414,23 @@ void ProjectManager::saveRecentFiles() const
     settings.setValue(kRecentFilesKey, m_recentFiles);
 }
 
+void ProjectManager::recordChanges(const SceneChangeSet &changes)
+{
+    if (changes.reset) {
+        // A cleared scene starts over; the next edit writes a new base.
+        m_journalTimer.stop();
+        m_journal.start(journalPath(), m_scene);
+        return;
+    }
+
+    m_journal.record(changes, m_scene);
+    if (!m_journal.hasBase() || m_journal.pendingBytes() >= kJournalCompactBytes) {
+        saveAutosave();
+    } else if (!m_journalTimer.isActive()) {
+        m_journalTimer.start();
+    }
+}
+
 void ProjectManager::setLastProjectPath(const QString &path)
 {
     m_lastProjectPath = normalizedPath(path);
@@ -374,9 +449,71 @@ QString ProjectManager::normalizedPath(const QString &path) const
     return info.absoluteFilePath();
 }
 
+bool ProjectManager::readProject(const QString &path,
+                                 QJsonObject *root,
+                                 QString *errorMessage)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMessage) {
+            *errorMessage = QStringLiteral("无法读取文件: %1").arg(path);
+        }
+        return false;
+    }
+
+    // The format is sniffed from the content, so a renamed file still opens.
+    const QByteArray data = file.readAll();
+    if (data.startsWith(kCborSignature)) {
+        QCborParserError parseError;
+        const QCborValue value = QCborValue::fromCbor(data, &parseError);
+        if (parseError.error != QCborError::NoError) {
+            if (errorMessage) {
+                *errorMessage = QStringLiteral("CBOR 解析失败: %1").arg(parseError.errorString());
+            }
+            return false;
+        }
+        const QCborValue content = value.isTag() ? value.taggedValue() : value;
+        if (!content.isMap()) {
+            if (errorMessage) {
+                *errorMessage = QStringLiteral("CBOR 格式错误: 根节点需为映射");
+            }
+            return false;
+        }
+        *root = content.toMap().toJsonObject();
+        return true;
+    }
+
+    QJsonParseError parseError{};
+    const QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
+    if (parseError.error != QJsonParseError::NoError) {
+        if (errorMessage) {
+            *errorMessage = QStringLiteral("JSON 解析失败: %1").arg(parseError.errorString());
+        }
+        return false;
+    }
+    if (!doc.isObject()) {
+        if (errorMessage) {
+            *errorMessage = QStringLiteral("JSON 格式错误: 根节点需为对象");
+        }
+        return false;
+    }
+    *root = doc.object();
+    return true;
+}
+
+bool ProjectManager::writeProject(const QString &path,
+                                  const QJsonObject &root,
+                                  QString *errorMessage)
+{
+    if (isBinaryProjectPath(path)) {
+        return writeCbor(path, root, errorMessage);
+    }
+    return writeJson(path, root, errorMessage);
+}
+
 bool ProjectManager::writeJson(const QString &path,
                                const QJsonObject &root,
-                               QString *errorMessage) const
+                               QString *errorMessage)
 {
     QSaveFile file(path);
     if (!file.open(QIODevice::WriteOnly)) {
@@ -403,3 +540,36 @@ bool ProjectManager::writeJson(const QString &path,
 
     return true;
 }
+
+bool ProjectManager::writeCbor(const QString &path,
+                               const QJsonObject &root,
+                               QString *errorMessage)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorMessage) {
+            *errorMessage = QStringLiteral("无法写入文件: %1").arg(path);
+        }
+        return false;
+    }
+
+    // Same tree as the JSON format, so the two convert into each other
+    // without loss. Numbers are narrowed only where that is exact.
+    const QCborValue value(QCborKnownTags::Signature, QCborMap::fromJsonObject(root));
+    const QByteArray data = value.toCbor(QCborValue::UseFloat16 | QCborValue::UseIntegers);
+    if (file.write(data) == -1) {
+        if (errorMessage) {
+            *errorMessage = QStringLiteral("写入失败: %1").arg(path);
+        }
+        return false;
+    }
+
+    if (!file.commit()) {
+        if (errorMessage) {
+            *errorMessage = QStringLiteral("保存失败: %1").arg(path);
+        }
+        return false;
+    }
+
+    return true;
+}
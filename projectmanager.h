@@ -1,9 +1,13 @@
 #ifndef PROJECTMANAGER_H
 #define PROJECTMANAGER_H
 
+#include "projectjournal.h"
+
 #include <QObject>
 #include <QString>
 #include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
 
 class DesignScene;
 class QJsonObject;
@@ -27,14 +31,35 @@ public:
     bool loadFromPath(const QString &path, QString *errorMessage = nullptr);
     bool loadAutosave(QString *errorMessage = nullptr);
 
+    // Rewrites a project in the format named by targetPath's suffix:
+    // .qplanb for binary CBOR, anything else for JSON.
+    bool convertProject(const QString &sourcePath,
+                        const QString &targetPath,
+                        QString *errorMessage = nullptr) const;
+
     void clearCurrentProject();
     void setDirty(bool dirty);
 
+    // Edits are journaled to journalPath() as they happen; the autosave
+    // file is the base the journal is replayed onto.
     QString autosavePath() const;
+    QString journalPath() const;
+    // Compacts the journal: snapshots the scene here, writes it as the new
+    // base on a background thread and then empties the journal. Returns
+    // whether a save was started; autosaveFinished() reports how it went.
     bool saveAutosave(QString *errorMessage = nullptr);
     bool hasAutosave() const;
     void removeAutosave();
 
+    // A project file of either format, sniffed from its content, and
+    // written in the format named by path's suffix.
+    static bool readProject(const QString &path,
+                            QJsonObject *root,
+                            QString *errorMessage);
+    static bool writeProject(const QString &path,
+                             const QJsonObject &root,
+                             QString *errorMessage);
+
     QStringList recentFiles() const;
     void addRecentFile(const QString &path);
     void removeRecentFile(const QString &path);
@@ -43,6 +68,8 @@ signals:
     void dirtyChanged(bool dirty);
     void currentPathChanged(const QString &path);
     void recentFilesChanged(const QStringList &files);
+    // A save started by saveAutosave() is done. Emitted on the GUI thread.
+    void autosaveFinished(bool saved, const QString &errorMessage);
 
 private:
     explicit ProjectManager(QObject *parent = nullptr);
@@ -51,10 +78,14 @@ private:
     void loadRecentFiles();
     void saveRecentFiles() const;
     void setLastProjectPath(const QString &path);
+    void recordChanges(const SceneChangeSet &changes);
     QString normalizedPath(const QString &path) const;
-    bool writeJson(const QString &path,
-                   const QJsonObject &root,
-                   QString *errorMessage) const;
+    static bool writeJson(const QString &path,
+                          const QJsonObject &root,
+                          QString *errorMessage);
+    static bool writeCbor(const QString &path,
+                          const QJsonObject &root,
+                          QString *errorMessage);
 
     DesignScene *m_scene;
     QString m_currentPath;
@@ -62,6 +93,11 @@ private:
     QStringList m_recentFiles;
     bool m_dirty;
     bool m_loading;
+    // One thread, so autosaves and journal writes land in the order they
+    // were taken.
+    QThreadPool m_autosavePool;
+    ProjectJournal m_journal;
+    QTimer m_journalTimer;
 };
 
 #endif // PROJECTMANAGER_H
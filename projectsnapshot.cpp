@@ -0,0 +1,85 @@
+#include "projectsnapshot.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+
+QJsonObject ProjectSnapshot::toJson() const
+{
+    QJsonObject root;
+    QJsonObject info;
+    info["version"] = QStringLiteral("1.0");
+    info["created_at"] = createdAt;
+    root["project_info"] = info;
+
+    root["settings"] = toJson(settings);
+
+    QJsonArray wallsArray;
+    for (const Wall &wall : walls) {
+        wallsArray.append(toJson(wall));
+    }
+    root["walls"] = wallsArray;
+
+    QJsonArray openingsArray;
+    for (const Opening &opening : openings) {
+        openingsArray.append(toJson(opening));
+    }
+    root["openings"] = openingsArray;
+
+    QJsonArray furnitureArray;
+    for (const Furniture &item : furniture) {
+        furnitureArray.append(toJson(item));
+    }
+    root["furniture"] = furnitureArray;
+
+    return root;
+}
+
+QJsonObject ProjectSnapshot::toJson(const Settings &settings)
+{
+    QJsonObject obj;
+    obj["background_image"] = settings.backgroundImage;
+    obj["pixel_ratio"] = settings.pixelRatio;
+    obj["opacity"] = settings.opacity;
+    obj["rotation"] = settings.rotation;
+    return obj;
+}
+
+QJsonObject ProjectSnapshot::toJson(const Wall &wall)
+{
+    QJsonObject obj;
+    obj["id"] = wall.id;
+    obj["start"] = QJsonArray{wall.start.x(), wall.start.y()};
+    obj["end"] = QJsonArray{wall.end.x(), wall.end.y()};
+    obj["thickness"] = wall.thickness;
+    obj["height"] = wall.height;
+    return obj;
+}
+
+QJsonObject ProjectSnapshot::toJson(const Opening &opening)
+{
+    QJsonObject obj;
+    obj["id"] = opening.id;
+    obj["type"] = opening.type;
+    obj["style"] = opening.style;
+    obj["wall_id"] = opening.wallId;
+    obj["distance_from_start"] = opening.distanceFromStart;
+    obj["width"] = opening.width;
+    obj["height"] = opening.height;
+    obj["sill_height"] = opening.sillHeight;
+    obj["flipped"] = opening.flipped;
+    return obj;
+}
+
+QJsonObject ProjectSnapshot::toJson(const Furniture &furniture)
+{
+    QJsonObject obj;
+    obj["id"] = furniture.id;
+    obj["model_id"] = furniture.modelId;
+    obj["pos"] = QJsonArray{furniture.pos.x(), furniture.pos.y()};
+    obj["rotate"] = furniture.rotation;
+    obj["scale"] = QJsonArray{furniture.scale.x(), furniture.scale.y(), furniture.scale.z()};
+    obj["elevation"] = furniture.elevation;
+    obj["size"] = QJsonArray{furniture.size.width(), furniture.size.height()};
+    obj["height"] = furniture.height;
+    return obj;
+}
@@ -0,0 +1,66 @@
+#ifndef PROJECTSNAPSHOT_H
+#define PROJECTSNAPSHOT_H
+
+#include <QPointF>
+#include <QSizeF>
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+
+class QJsonObject;
+
+// Plain copy of everything a project file stores. Taking one only copies
+// values on the GUI thread; toJson() can then run on any thread.
+struct ProjectSnapshot {
+    struct Wall {
+        QString id;
+        QPointF start;
+        QPointF end;
+        qreal thickness = 0.0;
+        qreal height = 0.0;
+    };
+
+    struct Opening {
+        QString id;
+        QString type;
+        QString style;
+        QString wallId;
+        qreal distanceFromStart = 0.0;
+        qreal width = 0.0;
+        qreal height = 0.0;
+        qreal sillHeight = 0.0;
+        bool flipped = false;
+    };
+
+    struct Furniture {
+        QString id;
+        QString modelId;
+        QPointF pos;
+        qreal rotation = 0.0;
+        QVector3D scale;
+        qreal elevation = 0.0;
+        QSizeF size;
+        qreal height = 0.0;
+    };
+
+    struct Settings {
+        QString backgroundImage;
+        qreal pixelRatio = 1.0;
+        qreal opacity = 1.0;
+        qreal rotation = 0.0;
+    };
+
+    QString createdAt;
+    Settings settings;
+    QVector<Wall> walls;
+    QVector<Opening> openings;
+    QVector<Furniture> furniture;
+
+    QJsonObject toJson() const;
+    static QJsonObject toJson(const Settings &settings);
+    static QJsonObject toJson(const Wall &wall);
+    static QJsonObject toJson(const Opening &opening);
+    static QJsonObject toJson(const Furniture &furniture);
+};
+
+#endif // PROJECTSNAPSHOT_H
@@ -0,0 +1,41 @@
+#ifndef SCENECHANGE_H
+#define SCENECHANGE_H
+
+#include <QFlags>
+#include <QHash>
+
+class QGraphicsItem;
+
+// What happened to an item since the last change set was delivered.
+enum SceneChangeFlag {
+    SceneChange_Geometry = 0x1,
+    SceneChange_Property = 0x2,
+    SceneChange_Added = 0x4,
+    SceneChange_Removed = 0x8
+};
+Q_DECLARE_FLAGS(SceneChangeFlags, SceneChangeFlag)
+Q_DECLARE_OPERATORS_FOR_FLAGS(SceneChangeFlags)
+
+// Model changes collected over one event-loop turn. Helper items (snap and
+// length indicators, calibration line, drag previews) never show up here.
+// Removed items may already be deleted, so only use them as keys.
+struct SceneChangeSet {
+    QHash<QGraphicsItem *, SceneChangeFlags> items;
+    // The scene was cleared or reloaded; items is empty and everything
+    // should be resynced.
+    bool reset = false;
+    // Something changed that no single item owns.
+    bool sceneWide = false;
+
+    bool isEmpty() const
+    {
+        return items.isEmpty() && !reset && !sceneWide;
+    }
+
+    bool touches(QGraphicsItem *item) const
+    {
+        return reset || items.contains(item);
+    }
+};
+
+#endif // SCENECHANGE_H
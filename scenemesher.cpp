@@ -0,0 +1,826 @@
+#include "scenemesher.h"
+
+#include "wallitem.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QLineF>
+#include <QPoint>
+#include <QVector2D>
+#include <QtGlobal>
+#include <QtMath>
+
+namespace {
+// Tolerance for considering two points as the same junction
+constexpr qreal kJunctionTolerance = 1.0;
+// Maximum miter extension factor to prevent extremely long spikes at sharp angles
+constexpr qreal kMaxMiterFactor = 3.0;
+
+// Calculate the perpendicular offset for a wall (half thickness on each side)
+QPointF wallPerpOffset(const SceneMesher::WallSnapshot &wall)
+{
+    QPointF dir = wall.end - wall.start;
+    QVector2D v(dir);
+    if (v.lengthSquared() < 0.0001f) {
+        return QPointF(0, wall.thickness / 2.0);
+    }
+    v.normalize();
+    // Perpendicular (rotate 90 degrees counterclockwise)
+    QVector2D perp(-v.y(), v.x());
+    return QPointF(perp.x() * wall.thickness / 2.0, perp.y() * wall.thickness / 2.0);
+}
+
+// Find the intersection point of two lines defined by point+direction
+// Returns true if an intersection exists (lines are not parallel)
+bool lineIntersection(const QPointF &p1, const QPointF &d1,
+                      const QPointF &p2, const QPointF &d2,
+                      QPointF &intersection)
+{
+    // Solve: p1 + t*d1 = p2 + s*d2
+    // Using cross-product method
+    qreal cross = d1.x() * d2.y() - d1.y() * d2.x();
+    if (qAbs(cross) < 0.0001) {
+        return false;  // Lines are parallel
+    }
+    
+    QPointF delta = p2 - p1;
+    qreal t = (delta.x() * d2.y() - delta.y() * d2.x()) / cross;
+    intersection = p1 + d1 * t;
+    return true;
+}
+
+// Calculate mitered corner points for a wall endpoint connected to another wall
+// This finds where the wall edges would intersect if extended
+// Returns the two corner points for this end of the wall
+void calculateMiterCorners(const SceneMesher::WallSnapshot &wall, bool atStart,
+                           const SceneMesher::WallSnapshot &adjacentWall,
+                           QPointF &corner1, QPointF &corner2)
+{
+    QPointF wallOffset = wallPerpOffset(wall);
+    QPointF adjOffset = wallPerpOffset(adjacentWall);
+    
+    QPointF wallDir = wall.end - wall.start;
+    QPointF adjDir = adjacentWall.end - adjacentWall.start;
+    
+    // The junction point (center of the corner)
+    QPointF junctionPt = atStart ? wall.start : wall.end;
+    
+    // Wall edge points (on each side of the wall, at junction)
+    QPointF wall_edge_plus = junctionPt + wallOffset;
+    QPointF wall_edge_minus = junctionPt - wallOffset;
+    
+    // Adjacent wall edge points
+    QPointF adj_edge_plus = junctionPt + adjOffset;
+    QPointF adj_edge_minus = junctionPt - adjOffset;
+    
+    // For each side of the wall (+offset and -offset), find where it intersects
+    // with the corresponding side of the adjacent wall
+    
+    // Try ++, +-, -+, -- combinations and pick the correct matches
+    QPointF int_pp, int_pm, int_mp, int_mm;
+    bool has_pp = lineIntersection(wall_edge_plus, wallDir, adj_edge_plus, adjDir, int_pp);
+    bool has_pm = lineIntersection(wall_edge_plus, wallDir, adj_edge_minus, adjDir, int_pm);
+    bool has_mp = lineIntersection(wall_edge_minus, wallDir, adj_edge_plus, adjDir, int_mp);
+    bool has_mm = lineIntersection(wall_edge_minus, wallDir, adj_edge_minus, adjDir, int_mm);
+    
+    qreal maxExtend = wall.thickness * kMaxMiterFactor;
+    
+    // For the +offset side of the wall, find the valid intersection
+    // The valid one should be relatively close to the junction
+    bool found1 = false;
+    if (has_pp) {
+        qreal dist = QVector2D(int_pp - junctionPt).length();
+        if (dist < maxExtend) {
+            corner1 = int_pp;
+            found1 = true;
+        }
+    }
+    if (!found1 && has_pm) {
+        qreal dist = QVector2D(int_pm - junctionPt).length();
+        if (dist < maxExtend) {
+            corner1 = int_pm;
+            found1 = true;
+        }
+    }
+    if (!found1) {
+        corner1 = wall_edge_plus;
+    }
+    
+    // For the -offset side of the wall
+    bool found2 = false;
+    if (has_mm) {
+        qreal dist = QVector2D(int_mm - junctionPt).length();
+        if (dist < maxExtend) {
+            corner2 = int_mm;
+            found2 = true;
+        }
+    }
+    if (!found2 && has_mp) {
+        qreal dist = QVector2D(int_mp - junctionPt).length();
+        if (dist < maxExtend) {
+            corner2 = int_mp;
+            found2 = true;
+        }
+    }
+    if (!found2) {
+        corner2 = wall_edge_minus;
+    }
+}
+
+
+
+bool wallTouchesPoint(const SceneMesher::WallSnapshot &wall, const QPointF &point)
+{
+    return QVector2D(wall.start - point).length() < kJunctionTolerance
+        || QVector2D(wall.end - point).length() < kJunctionTolerance;
+}
+
+// Counter-clockwise angle from a to b, in [0, 2*pi).
+qreal ccwAngle(const QPointF &a, const QPointF &b)
+{
+    const qreal angle = std::atan2(a.x() * b.y() - a.y() * b.x(),
+                                   a.x() * b.x() + a.y() * b.y());
+    return angle < 0.0 ? angle + 2.0 * M_PI : angle;
+}
+
+// Corner points of one end of a wall. With several walls meeting there
+// (T- and X-junctions), each edge miters against the neighbour on its own
+// side: the +offset edge turns towards the nearest wall counter-clockwise of
+// the outgoing direction at the start, clockwise of it at the end.
+void junctionCorners(const SceneMesher::WallSnapshot &wall, bool atStart,
+                     const QVector<const SceneMesher::WallSnapshot *> &neighbours,
+                     QPointF &corner1, QPointF &corner2)
+{
+    const QPointF junction = atStart ? wall.start : wall.end;
+    if (neighbours.isEmpty()) {
+        const QPointF perpOffset = wallPerpOffset(wall);
+        corner1 = junction + perpOffset;
+        corner2 = junction - perpOffset;
+        return;
+    }
+
+    const QPointF outward = atStart ? wall.end - wall.start : wall.start - wall.end;
+    const SceneMesher::WallSnapshot *ccwNearest = neighbours.first();
+    const SceneMesher::WallSnapshot *cwNearest = neighbours.first();
+    qreal minAngle = 2.0 * M_PI;
+    qreal maxAngle = -1.0;
+    for (const SceneMesher::WallSnapshot *neighbour : neighbours) {
+        const bool neighbourAtStart =
+            QVector2D(neighbour->start - junction).lengthSquared()
+            <= QVector2D(neighbour->end - junction).lengthSquared();
+        const QPointF neighbourOutward = neighbourAtStart
+            ? neighbour->end - neighbour->start
+            : neighbour->start - neighbour->end;
+        const qreal angle = ccwAngle(outward, neighbourOutward);
+        if (angle < minAngle) {
+            minAngle = angle;
+            ccwNearest = neighbour;
+        }
+        if (angle > maxAngle) {
+            maxAngle = angle;
+            cwNearest = neighbour;
+        }
+    }
+
+    const SceneMesher::WallSnapshot *plusSide = atStart ? ccwNearest : cwNearest;
+    const SceneMesher::WallSnapshot *minusSide = atStart ? cwNearest : ccwNearest;
+    QPointF unused;
+    calculateMiterCorners(wall, atStart, *plusSide, corner1, unused);
+    calculateMiterCorners(wall, atStart, *minusSide, unused, corner2);
+}
+
+void appendBoxFromQuad(const QPointF &p1,
+                       const QPointF &p2,
+                       const QPointF &p3,
+                       const QPointF &p4,
+                       qreal baseY,
+                       qreal height,
+                       QVector<MeshVertex> &vertices)
+{
+    auto to3d = [baseY](const QPointF &p) {
+        return QVector3D(p.x(), static_cast<float>(baseY), -p.y());
+    };
+
+    const QVector3D b1 = to3d(p1);
+    const QVector3D b2 = to3d(p2);
+    const QVector3D b3 = to3d(p3);
+    const QVector3D b4 = to3d(p4);
+
+    const QVector3D topOffset(0.0f, static_cast<float>(height), 0.0f);
+    const QVector3D t1 = b1 + topOffset;
+    const QVector3D t2 = b2 + topOffset;
+    const QVector3D t3 = b3 + topOffset;
+    const QVector3D t4 = b4 + topOffset;
+
+    const auto appendTriangle = [&vertices](const QVector3D &a, const QVector3D &b,
+                                            const QVector3D &c, quint32 normal) {
+        vertices << MeshVertex(a, normal) << MeshVertex(b, normal) << MeshVertex(c, normal);
+    };
+
+    const quint32 up = MeshVertex::packNormal(QVector3D(0.0f, 1.0f, 0.0f));
+    const quint32 down = MeshVertex::packNormal(QVector3D(0.0f, -1.0f, 0.0f));
+    appendTriangle(t1, t2, t3, up);
+    appendTriangle(t1, t3, t4, up);
+    appendTriangle(b1, b3, b2, down);
+    appendTriangle(b1, b4, b3, down);
+
+    // The quad may wind either way, so each side's normal is turned away
+    // from the box's centre.
+    const QVector3D centre = (b1 + b2 + b3 + b4) / 4.0f;
+    const auto appendSide = [&](const QVector3D &a, const QVector3D &b,
+                                const QVector3D &topA, const QVector3D &topB) {
+        const QVector3D edge = b - a;
+        QVector3D normal(edge.z(), 0.0f, -edge.x());
+        if (QVector3D::dotProduct(normal, (a + b) / 2.0f - centre) < 0.0f) {
+            normal = -normal;
+        }
+        const quint32 packed = MeshVertex::packNormal(normal);
+        appendTriangle(a, b, topB, packed);
+        appendTriangle(a, topB, topA, packed);
+    };
+    appendSide(b1, b2, t1, t2);
+    appendSide(b2, b3, t2, t3);
+    appendSide(b3, b4, t3, t4);
+    appendSide(b4, b1, t4, t1);
+}
+
+void updateBounds(SceneMesher::WallMesh &mesh)
+{
+    bool first = true;
+    for (const QVector<MeshVertex> &part : mesh.parts) {
+        for (const MeshVertex &vertex : part) {
+            const QVector3D pos = vertex.pos();
+            if (first) {
+                mesh.minBounds = pos;
+                mesh.maxBounds = pos;
+                first = false;
+                continue;
+            }
+            for (int axis = 0; axis < 3; ++axis) {
+                mesh.minBounds[axis] = qMin(mesh.minBounds[axis], pos[axis]);
+                mesh.maxBounds[axis] = qMax(mesh.maxBounds[axis], pos[axis]);
+            }
+        }
+    }
+}
+}
+
+// Wall ends bucketed on a grid with kJunctionTolerance cells, so finding the
+// walls that meet at a point only looks at the 3x3 cells around it.
+class SceneMesher::JunctionIndex
+{
+public:
+    explicit JunctionIndex(const QVector<WallSnapshot> &walls)
+        : m_walls(walls)
+    {
+        m_cells.reserve(walls.size() * 2);
+        for (int i = 0; i < walls.size(); ++i) {
+            m_cells[cellOf(walls[i].start)].append(i);
+            m_cells[cellOf(walls[i].end)].append(i);
+        }
+    }
+
+    // All walls with an end at point, other than exclude.
+    QVector<const WallSnapshot *> wallsAt(const QPointF &point,
+                                          const WallItem *exclude = nullptr) const
+    {
+        QVector<const WallSnapshot *> found;
+        const QPoint center = cellOf(point);
+        for (int dx = -1; dx <= 1; ++dx) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                const auto it = m_cells.constFind(center + QPoint(dx, dy));
+                if (it == m_cells.constEnd()) {
+                    continue;
+                }
+                for (int index : it.value()) {
+                    const WallSnapshot *wall = &m_walls[index];
+                    if (wall->key == exclude || found.contains(wall)
+                        || !wallTouchesPoint(*wall, point)) {
+                        continue;
+                    }
+                    found.append(wall);
+                }
+            }
+        }
+        return found;
+    }
+
+private:
+    static QPoint cellOf(const QPointF &point)
+    {
+        return QPoint(qFloor(point.x() / kJunctionTolerance),
+                      qFloor(point.y() / kJunctionTolerance));
+    }
+
+    const QVector<WallSnapshot> &m_walls;
+    QHash<QPoint, QVector<int>> m_cells;
+};
+
+SceneMesher::WallSnapshot SceneMesher::snapshotWall(const WallItem *wall)
+{
+    WallSnapshot snapshot;
+    snapshot.key = wall;
+    snapshot.start = wall->startPos();
+    snapshot.end = wall->endPos();
+    snapshot.thickness = wall->thickness();
+    snapshot.height = wall->height();
+
+    const QList<OpeningItem *> openings = wall->openings();
+    snapshot.revisions.reserve(openings.size() + 1);
+    snapshot.revisions.append(wall->meshRevision());
+    snapshot.openings.reserve(openings.size());
+    for (const OpeningItem *opening : openings) {
+        if (!opening) {
+            snapshot.revisions.append(0);
+            continue;
+        }
+        snapshot.revisions.append(opening->meshRevision());
+
+        OpeningSnapshot copy;
+        copy.kind = opening->kind();
+        copy.style = opening->style();
+        copy.distanceFromStart = opening->distanceFromStart();
+        copy.width = opening->width();
+        copy.height = opening->height();
+        copy.sillHeight = opening->sillHeight();
+        copy.flipped = opening->isFlipped();
+        snapshot.openings.append(copy);
+    }
+    return snapshot;
+}
+
+SceneMesher::Result SceneMesher::build(const Request &request,
+                                       const QAtomicInteger<quint64> *latestGeneration)
+{
+    Result result;
+    result.generation = request.generation;
+
+    const JunctionIndex junctions(request.walls);
+    result.alive.reserve(request.walls.size());
+    for (const WallSnapshot &wall : request.walls) {
+        result.alive.insert(wall.key);
+    }
+
+    // Walls meeting a changed wall, at its old or new ends, re-miter against it.
+    QSet<const WallItem *> dirty = request.changed;
+    for (const QPointF &junction : request.touchedJunctions) {
+        for (const WallSnapshot *wall : junctions.wallsAt(junction)) {
+            dirty.insert(wall->key);
+        }
+    }
+
+    for (const WallSnapshot &wall : request.walls) {
+        if (!dirty.contains(wall.key)) {
+            continue;
+        }
+        if (latestGeneration && latestGeneration->loadRelaxed() != request.generation) {
+            result.cancelled = true;
+            result.meshes.clear();
+            return result;
+        }
+
+        WallMesh &mesh = result.meshes[wall.key];
+        mesh.revisions = wall.revisions;
+        mesh.start = wall.start;
+        mesh.end = wall.end;
+        appendWallMesh(wall, junctions, mesh);
+        updateBounds(mesh);
+    }
+    return result;
+}
+
+void SceneMesher::appendWallMesh(const WallSnapshot &wall,
+                                 const JunctionIndex &junctions,
+                                 WallMesh &mesh)
+{
+    const QLineF line(wall.start, wall.end);
+    const qreal totalLength = line.length();
+    if (totalLength < 0.1) {
+        return;
+    }
+
+    QVector<MeshVertex> &vertices = mesh.parts[Category_Wall];
+    const qreal wallHeight = wall.height;
+    QPointF perpOffset = wallPerpOffset(wall);
+    
+    // Miter each end against the walls meeting it there
+    QPointF startCorner1, startCorner2;
+    junctionCorners(wall, true, junctions.wallsAt(wall.start, wall.key),
+                    startCorner1, startCorner2);
+
+    QPointF endCorner1, endCorner2;
+    junctionCorners(wall, false, junctions.wallsAt(wall.end, wall.key),
+                    endCorner1, endCorner2);
+    
+    QVector<OpeningSnapshot> openings = wall.openings;
+    if (openings.isEmpty()) {
+        // No openings - render full wall with mitered corners
+        appendBoxFromQuad(startCorner1, endCorner1, endCorner2, startCorner2, 
+                          0.0, wallHeight, vertices);
+        return;
+    }
+
+
+    // For walls with openings, use simple perpendicular offsets for all segments
+    std::sort(openings.begin(), openings.end(),
+              [](const OpeningSnapshot &a, const OpeningSnapshot &b) {
+                  return a.distanceFromStart < b.distanceFromStart;
+              });
+
+    const QPointF wallStart = wall.start;
+    const QPointF wallEnd = wall.end;
+    const QPointF dir = (wallEnd - wallStart) / totalLength;
+
+    qreal cursor = 0.0;
+    bool isFirstSegment = true;
+    
+    for (const OpeningSnapshot &opening : qAsConst(openings)) {
+        qreal start = qBound(0.0, opening.distanceFromStart, totalLength);
+        qreal end = qBound(0.0, start + opening.width, totalLength);
+        
+        if (start > cursor) {
+            // Wall segment before this opening
+            const QPointF segStart = wallStart + dir * cursor;
+            const QPointF segEnd = wallStart + dir * start;
+            
+            QPointF p1, p4;
+            if (isFirstSegment && cursor < 0.1) {
+                // First segment - use start corners
+                p1 = startCorner1;
+                p4 = startCorner2;
+            } else {
+                p1 = segStart + perpOffset;
+                p4 = segStart - perpOffset;
+            }
+            
+            QPointF p2 = segEnd + perpOffset;
+            QPointF p3 = segEnd - perpOffset;
+            
+            appendBoxFromQuad(p1, p2, p3, p4, 0.0, wallHeight, vertices);
+            isFirstSegment = false;
+        }
+        
+        cursor = qMax(cursor, end);
+        
+        // Handle opening geometry (doors/windows)
+        if (opening.kind == OpeningItem::Kind::Window) {
+            switch (opening.style) {
+            case OpeningItem::Style::SlidingWindow:
+                appendOpeningMesh(wall, opening, mesh.parts[Category_Opening],
+                                  mesh.parts[Category_GlassSliding]);
+                break;
+            case OpeningItem::Style::BayWindow:
+                appendOpeningMesh(wall, opening, mesh.parts[Category_Opening],
+                                  mesh.parts[Category_GlassBay]);
+                break;
+            case OpeningItem::Style::CasementWindow:
+            default:
+                appendOpeningMesh(wall, opening, mesh.parts[Category_Opening],
+                                  mesh.parts[Category_GlassCasement]);
+                break;
+            }
+        } else {
+            switch (opening.style) {
+            case OpeningItem::Style::SlidingDoor:
+                appendOpeningMesh(wall, opening, mesh.parts[Category_DoorSliding],
+                                  mesh.parts[Category_GlassCasement]);
+                break;
+            case OpeningItem::Style::DoubleDoor:
+                appendOpeningMesh(wall, opening, mesh.parts[Category_DoorDouble],
+                                  mesh.parts[Category_GlassCasement]);
+                break;
+            case OpeningItem::Style::SingleDoor:
+            default:
+                appendOpeningMesh(wall, opening, mesh.parts[Category_DoorSingle],
+                                  mesh.parts[Category_GlassCasement]);
+                break;
+            }
+        }
+
+        // Wall segments above/below openings
+        qreal openingBase =
+            opening.kind == OpeningItem::Kind::Door
+                ? 0.0
+                : opening.sillHeight;
+        openingBase = qBound(0.0, openingBase, wallHeight);
+        qreal openingTop = openingBase + opening.height;
+        openingTop = qBound(openingBase, openingTop, wallHeight);
+
+        if (openingBase > 0.1) {
+            appendWallSegment(wall, start, end, 0.0, openingBase, vertices);
+        }
+        if (openingTop + 0.1 < wallHeight) {
+            appendWallSegment(wall, start, end,
+                              openingTop,
+                              wallHeight - openingTop,
+                              vertices);
+        }
+    }
+
+    // Final segment after last opening
+    if (cursor < totalLength) {
+        const QPointF segStart = wallStart + dir * cursor;
+        
+        QPointF p1, p4;
+        if (isFirstSegment && cursor < 0.1) {
+            p1 = startCorner1;
+            p4 = startCorner2;
+        } else {
+            p1 = segStart + perpOffset;
+            p4 = segStart - perpOffset;
+        }
+        
+        // Last segment - use end corners
+        appendBoxFromQuad(p1, endCorner1, endCorner2, p4, 0.0, wallHeight, vertices);
+    }
+}
+
+void SceneMesher::appendWallSegment(const WallSnapshot &wall,
+                                    qreal startDistance,
+                                    qreal endDistance,
+                                    qreal baseY,
+                                    qreal height,
+                                    QVector<MeshVertex> &vertices)
+{
+    if (endDistance - startDistance < 0.1 || height < 0.1) {
+        return;
+    }
+
+    const QLineF line(wall.start, wall.end);
+    const qreal length = line.length();
+    if (length < 0.1) {
+        return;
+    }
+
+    const QPointF dir = (line.p2() - line.p1()) / length;
+    const QPointF segStart = line.p1() + dir * startDistance;
+    const QPointF segEnd = line.p1() + dir * endDistance;
+
+    QLineF segLine(segStart, segEnd);
+    QLineF normal = segLine.normalVector();
+    normal.setLength(wall.thickness / 2.0);
+    const QPointF offset = normal.p2() - normal.p1();
+
+    const QPointF p1 = segStart + offset;
+    const QPointF p2 = segEnd + offset;
+    const QPointF p3 = segEnd - offset;
+    const QPointF p4 = segStart - offset;
+
+    appendBoxFromQuad(p1, p2, p3, p4, baseY, height, vertices);
+}
+
+void SceneMesher::appendOpeningMesh(const WallSnapshot &wall,
+                                    const OpeningSnapshot &opening,
+                                    QVector<MeshVertex> &solidVertices,
+                                    QVector<MeshVertex> &glassVertices)
+{
+    const QLineF line(wall.start, wall.end);
+    const qreal length = line.length();
+    if (length < 0.1) {
+        return;
+    }
+
+    qreal start = qBound(0.0, opening.distanceFromStart, length);
+    qreal end = qBound(0.0, start + opening.width, length);
+    if (end - start < 0.1) {
+        return;
+    }
+
+    const QPointF wallDir = (line.p2() - line.p1()) / length;
+    const QPointF segStart = line.p1() + wallDir * start;
+    const QPointF segEnd = line.p1() + wallDir * end;
+
+    QLineF segLine(segStart, segEnd);
+    const qreal baseHeight =
+        opening.kind == OpeningItem::Kind::Door ? 0.0 : opening.sillHeight;
+
+    const auto buildQuadOnLine = [](const QLineF &line,
+                                    const QPointF &a,
+                                    const QPointF &b,
+                                    qreal thickness,
+                                    const QPointF &shift,
+                                    QPointF &o1,
+                                    QPointF &o2,
+                                    QPointF &o3,
+                                    QPointF &o4) {
+        QLineF normal = line.normalVector();
+        normal.setLength(thickness / 2.0);
+        const QPointF offset = normal.p2() - normal.p1();
+        o1 = a + offset + shift;
+        o2 = b + offset + shift;
+        o3 = b - offset + shift;
+        o4 = a - offset + shift;
+    };
+
+    if (opening.kind == OpeningItem::Kind::Door) {
+        const qreal panelThickness = qMin(36.0, wall.thickness * 0.6);
+        const qreal openOffset = qMax(12.0, wall.thickness * 0.6);
+        QLineF doorNormal = segLine.normalVector();
+        doorNormal.setLength(openOffset);
+        QVector2D outwardDir(doorNormal.p2() - doorNormal.p1());
+        if (outwardDir.lengthSquared() > 0.0001f) {
+            outwardDir.normalize();
+        }
+        QPointF outwardUnit(outwardDir.x(), outwardDir.y());
+        QPointF outward = outwardUnit * openOffset;
+        if (opening.flipped) {
+            outward = -outward;
+        }
+
+        if (opening.style == OpeningItem::Style::SlidingDoor) {
+            const qreal segmentLength = QLineF(segStart, segEnd).length();
+            if (segmentLength < 0.1) {
+                return;
+            }
+            const qreal panelWidth = segmentLength * 0.62;
+            const QPointF segDir = (segEnd - segStart) / segmentLength;
+            const QPointF leftStart = segStart;
+            const QPointF leftEnd = segStart + segDir * panelWidth;
+            const QPointF rightEnd = segEnd;
+            const QPointF rightStart = segEnd - segDir * panelWidth;
+            const qreal layerDepth = qMax(4.0, panelThickness * 0.25);
+            QPointF layerOffset = outwardUnit * layerDepth;
+            if (opening.flipped) {
+                layerOffset = -layerOffset;
+            }
+
+            QPointF l1, l2, l3, l4;
+            buildQuadOnLine(segLine,
+                            leftStart,
+                            leftEnd,
+                            panelThickness,
+                            layerOffset,
+                            l1, l2, l3, l4);
+            appendBoxFromQuad(l1, l2, l3, l4, baseHeight, opening.height,
+                              solidVertices);
+
+            QPointF r1, r2, r3, r4;
+            buildQuadOnLine(segLine,
+                            rightStart,
+                            rightEnd,
+                            panelThickness,
+                            -layerOffset,
+                            r1, r2, r3, r4);
+            appendBoxFromQuad(r1, r2, r3, r4, baseHeight, opening.height,
+                              solidVertices);
+        } else if (opening.style == OpeningItem::Style::DoubleDoor) {
+            const qreal segmentLength = QLineF(segStart, segEnd).length();
+            if (segmentLength < 0.1) {
+                return;
+            }
+            const QPointF segDir = (segEnd - segStart) / segmentLength;
+            const QPointF center = (segStart + segEnd) * 0.5;
+            const qreal gap = qMax(6.0, panelThickness * 0.4);
+            const QPointF leftEnd = center - segDir * gap * 0.5;
+            const QPointF rightStart = center + segDir * gap * 0.5;
+
+            const QLineF leftLine(segStart, leftEnd + outward);
+            const QLineF rightLine(segEnd, rightStart + outward);
+
+            QPointF l1, l2, l3, l4;
+            buildQuadOnLine(leftLine,
+                            segStart,
+                            leftEnd + outward,
+                            panelThickness,
+                            QPointF(),
+                            l1, l2, l3, l4);
+            appendBoxFromQuad(l1, l2, l3, l4, baseHeight, opening.height,
+                              solidVertices);
+
+            QPointF r1, r2, r3, r4;
+            buildQuadOnLine(rightLine,
+                            segEnd,
+                            rightStart + outward,
+                            panelThickness,
+                            QPointF(),
+                            r1, r2, r3, r4);
+            appendBoxFromQuad(r1, r2, r3, r4, baseHeight, opening.height,
+                              solidVertices);
+        } else {
+            const QLineF doorLine(segStart, segEnd + outward);
+            QPointF p1, p2, p3, p4;
+            buildQuadOnLine(doorLine,
+                            segStart,
+                            segEnd + outward,
+                            panelThickness,
+                            QPointF(),
+                            p1, p2, p3, p4);
+            appendBoxFromQuad(p1, p2, p3, p4, baseHeight, opening.height,
+                              solidVertices);
+        }
+        return;
+    }
+
+    const qreal frameThickness = qMin(24.0, wall.thickness * 0.5);
+    QLineF frameNormal = segLine.normalVector();
+    frameNormal.setLength(frameThickness / 2.0);
+    const QPointF frameOffset = frameNormal.p2() - frameNormal.p1();
+    QVector2D outwardVec(frameOffset);
+    if (outwardVec.lengthSquared() > 0.0001f) {
+        outwardVec.normalize();
+    }
+    const QPointF outward(outwardVec.x(), outwardVec.y());
+
+    QPointF f1, f2, f3, f4;
+    QPointF glassShift;
+    qreal glassThickness = qMax(3.0, frameThickness * 0.25);
+
+    if (opening.style == OpeningItem::Style::BayWindow) {
+        const qreal bayDepth = qMax(25.0, wall.thickness * 1.2);
+        const qreal bayThickness = frameThickness + bayDepth;
+        const QPointF bayShift = outward * (bayDepth * 0.5);
+        buildQuadOnLine(segLine, segStart, segEnd, bayThickness, bayShift, f1,
+                        f2, f3, f4);
+        appendBoxFromQuad(f1, f2, f3, f4, baseHeight, opening.height,
+                          solidVertices);
+        glassShift = outward * (bayDepth * 0.75);
+    } else {
+        buildQuadOnLine(segLine, segStart, segEnd, frameThickness, QPointF(),
+                        f1, f2, f3, f4);
+        appendBoxFromQuad(f1, f2, f3, f4, baseHeight, opening.height,
+                          solidVertices);
+        glassShift = QPointF();
+    }
+
+    const qreal segmentLength = QLineF(segStart, segEnd).length();
+    if (segmentLength < 0.1) {
+        return;
+    }
+    const qreal insetAlong = qMax(4.0, segmentLength * 0.08);
+    const QPointF segDir = (segEnd - segStart) / segmentLength;
+    const qreal safeInset = qMin(insetAlong, segmentLength * 0.25);
+
+    if (opening.style == OpeningItem::Style::SlidingWindow) {
+        const qreal panelWidth = segmentLength * 0.55;
+        const QPointF leftStart = segStart;
+        const QPointF leftEnd = segStart + segDir * panelWidth;
+        const QPointF rightEnd = segEnd;
+        const QPointF rightStart = segEnd - segDir * panelWidth;
+        const qreal layerDepth = qMax(8.0, frameThickness * 0.8);
+        const QPointF layerShift = outward * layerDepth;
+
+        QPointF l1, l2, l3, l4;
+        buildQuadOnLine(segLine,
+                        leftStart + segDir * safeInset,
+                        leftEnd - segDir * safeInset,
+                        glassThickness,
+                        glassShift + layerShift,
+                        l1, l2, l3, l4);
+        appendBoxFromQuad(l1, l2, l3, l4, baseHeight, opening.height,
+                          glassVertices);
+
+        QPointF r1, r2, r3, r4;
+        buildQuadOnLine(segLine,
+                        rightStart + segDir * safeInset,
+                        rightEnd - segDir * safeInset,
+                        glassThickness,
+                        glassShift - layerShift,
+                        r1, r2, r3, r4);
+        appendBoxFromQuad(r1, r2, r3, r4, baseHeight, opening.height,
+                          glassVertices);
+        return;
+    }
+
+    QPointF g1, g2, g3, g4;
+    if (opening.style == OpeningItem::Style::CasementWindow) {
+        const qreal hingeOffset = qMax(2.0, frameThickness * 0.2);
+        const qreal openOffset = qMax(10.0, frameThickness * 1.1);
+        const QPointF gStart =
+            segStart + segDir * safeInset + outward * hingeOffset;
+        const QPointF gEnd =
+            segEnd - segDir * safeInset + outward * openOffset;
+        const QLineF glassLine(gStart, gEnd);
+        buildQuadOnLine(glassLine,
+                        gStart,
+                        gEnd,
+                        glassThickness,
+                        glassShift,
+                        g1, g2, g3, g4);
+    } else {
+        buildQuadOnLine(segLine,
+                        segStart + segDir * safeInset,
+                        segEnd - segDir * safeInset,
+                        glassThickness,
+                        glassShift,
+                        g1, g2, g3, g4);
+    }
+    appendBoxFromQuad(g1, g2, g3, g4, baseHeight, opening.height,
+                      glassVertices);
+
+    if (opening.style == OpeningItem::Style::CasementWindow) {
+        const qreal barWidth = qMax(4.0, opening.width * 0.08);
+        const qreal barStartOffset = opening.width * 0.22;
+        const QPointF barStart = segStart + segDir * barStartOffset;
+        const QPointF barEnd = barStart + segDir * barWidth;
+        QPointF b1, b2, b3, b4;
+        buildQuadOnLine(segLine,
+                        barStart,
+                        barEnd,
+                        frameThickness * 0.35,
+                        QPointF(),
+                        b1, b2, b3, b4);
+        appendBoxFromQuad(b1, b2, b3, b4, baseHeight, opening.height,
+                          solidVertices);
+    }
+}
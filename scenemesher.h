@@ -0,0 +1,109 @@
+#ifndef SCENEMESHER_H
+#define SCENEMESHER_H
+
+#include "meshvertex.h"
+#include "openingitem.h"
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QPointF>
+#include <QSet>
+#include <QVector>
+#include <QVector3D>
+
+class WallItem;
+
+// Builds wall, door and window meshes for the 3D view from plain copies of
+// the scene. Snapshots are taken on the GUI thread; build() only reads them
+// and may run on a worker thread.
+class SceneMesher
+{
+public:
+    enum Category {
+        Category_Wall,
+        Category_DoorSingle,
+        Category_DoorDouble,
+        Category_DoorSliding,
+        Category_Opening,
+        Category_GlassCasement,
+        Category_GlassSliding,
+        Category_GlassBay,
+        CategoryCount
+    };
+
+    struct OpeningSnapshot {
+        OpeningItem::Kind kind = OpeningItem::Kind::Window;
+        OpeningItem::Style style = OpeningItem::Style::CasementWindow;
+        qreal distanceFromStart = 0.0;
+        qreal width = 0.0;
+        qreal height = 0.0;
+        qreal sillHeight = 0.0;
+        bool flipped = false;
+    };
+
+    // The key identifies the wall only; it is never dereferenced off the
+    // GUI thread.
+    struct WallSnapshot {
+        const WallItem *key = nullptr;
+        QPointF start;
+        QPointF end;
+        qreal thickness = 0.0;
+        qreal height = 0.0;
+        QVector<quint64> revisions;
+        QVector<OpeningSnapshot> openings;
+    };
+
+    // Mesh of one wall, including the frames and glass of its openings.
+    // start/end remember the junctions it was mitered at; the bounds cover
+    // every part and are empty (min > max) when there are no vertices.
+    struct WallMesh {
+        QVector<quint64> revisions;
+        QPointF start;
+        QPointF end;
+        QVector<MeshVertex> parts[CategoryCount];
+        QVector3D minBounds{1.0f, 1.0f, 1.0f};
+        QVector3D maxBounds{-1.0f, -1.0f, -1.0f};
+    };
+
+    struct Request {
+        quint64 generation = 0;
+        QVector<WallSnapshot> walls;
+        QSet<const WallItem *> changed;
+        // Old and new ends of changed or removed walls; walls meeting there
+        // are re-mitered too.
+        QVector<QPointF> touchedJunctions;
+    };
+
+    struct Result {
+        quint64 generation = 0;
+        bool cancelled = false;
+        QSet<const WallItem *> alive;
+        QHash<const WallItem *, WallMesh> meshes;
+    };
+
+    static WallSnapshot snapshotWall(const WallItem *wall);
+
+    // Stops early, with cancelled set, once latestGeneration moves past the
+    // request's generation.
+    static Result build(const Request &request,
+                        const QAtomicInteger<quint64> *latestGeneration);
+
+private:
+    class JunctionIndex;
+
+    static void appendWallMesh(const WallSnapshot &wall,
+                               const JunctionIndex &junctions,
+                               WallMesh &mesh);
+    static void appendWallSegment(const WallSnapshot &wall,
+                                  qreal startDistance,
+                                  qreal endDistance,
+                                  qreal baseY,
+                                  qreal height,
+                                  QVector<MeshVertex> &vertices);
+    static void appendOpeningMesh(const WallSnapshot &wall,
+                                  const OpeningSnapshot &opening,
+                                  QVector<MeshVertex> &solidVertices,
+                                  QVector<MeshVertex> &glassVertices);
+};
+
+#endif // SCENEMESHER_H
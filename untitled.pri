@@ -0,0 +1,87 @@
+# Sources shared by the application and the benchmark.
+
+QT       += core gui opengl openglwidgets svg svgwidgets concurrent
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += c++17
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/assetmanager.cpp \
+    $$PWD/componentlistwidget.cpp \
+    $$PWD/blueprintitem.cpp \
+    $$PWD/boundinghierarchy.cpp \
+    $$PWD/blueprinttiles.cpp \
+    $$PWD/designscene.cpp \
+    $$PWD/dooritem.cpp \
+    $$PWD/furnitureitem.cpp \
+    $$PWD/imagebandreader.cpp \
+    $$PWD/meshsimplifier.cpp \
+    $$PWD/planexporter.cpp \
+    $$PWD/projectjournal.cpp \
+    $$PWD/projectmanager.cpp \
+    $$PWD/projectsnapshot.cpp \
+    $$PWD/wallindex.cpp \
+    $$PWD/scenemesher.cpp \
+    $$PWD/modelcache.cpp \
+    $$PWD/openingitem.cpp \
+    $$PWD/view3dwidget.cpp \
+    $$PWD/walldetector.cpp \
+    $$PWD/view2dwidget.cpp \
+    $$PWD/windowitem.cpp \
+    $$PWD/wallitem.cpp
+
+HEADERS += \
+    $$PWD/assetmanager.h \
+    $$PWD/componentlistwidget.h \
+    $$PWD/blueprintitem.h \
+    $$PWD/boundinghierarchy.h \
+    $$PWD/blueprinttiles.h \
+    $$PWD/designscene.h \
+    $$PWD/dooritem.h \
+    $$PWD/furnitureitem.h \
+    $$PWD/imagebandreader.h \
+    $$PWD/levelofdetail.h \
+    $$PWD/meshrevision.h \
+    $$PWD/meshsimplifier.h \
+    $$PWD/meshvertex.h \
+    $$PWD/planexporter.h \
+    $$PWD/projectjournal.h \
+    $$PWD/projectmanager.h \
+    $$PWD/projectsnapshot.h \
+    $$PWD/wallindex.h \
+    $$PWD/scenechange.h \
+    $$PWD/scenemesher.h \
+    $$PWD/modelcache.h \
+    $$PWD/openingitem.h \
+    $$PWD/view3dwidget.h \
+    $$PWD/walldetector.h \
+    $$PWD/view2dwidget.h \
+    $$PWD/windowitem.h \
+    $$PWD/wallitem.h
+
+# Assimp (vcpkg)
+# zlib is installed with Assimp's dependencies; the plan export writes PNG
+# through it directly. libjpeg (vcpkg libjpeg-turbo) writes JPEG exports by
+# rows. Blueprint scans are read by rows through both libraries.
+win32-g++ {
+    # MinGW dynamic
+    ASSIMP_DIR = C:/Users/18438/vcpkg/installed/x64-mingw-dynamic
+    INCLUDEPATH += $$ASSIMP_DIR/include
+    LIBS += -L$$ASSIMP_DIR/lib -lassimp -lzlib -ljpeg
+} else: win32 {
+    # MSVC 使用 x64-windows
+    ASSIMP_DIR = C:/Users/18438/vcpkg/installed/x64-windows
+    INCLUDEPATH += $$ASSIMP_DIR/include
+    LIBS += -L$$ASSIMP_DIR/lib -lassimp-vc143-mt -lzlib -ljpeg
+} else: unix {
+    # System packages
+    CONFIG += link_pkgconfig
+    PKGCONFIG += assimp zlib libjpeg
+}
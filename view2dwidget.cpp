@@ -14,6 +14,9 @@ namespace {
 constexpr qreal kMinScale = 0.05;
 constexpr qreal kMaxScale = 50.0;
 constexpr qreal kScaleStep = 1.15;
+// Grid lines closer than this on screen are thinned out tenfold, which
+// bounds the line count at any zoom.
+constexpr qreal kMinGridPixels = 8.0;
 }
 
 View2DWidget::View2DWidget(QWidget *parent)
@@ -32,6 +35,9 @@ View2DWidget::View2DWidget(QWidget *parent)
     setFocusPolicy(Qt::StrongFocus);
     setAcceptDrops(true);
     viewport()->setAcceptDrops(true);
+    // The grid only depends on the view transform. Panning scrolls the
+    // cached background and paints just the newly exposed strip.
+    setCacheMode(QGraphicsView::CacheBackground);
 }
 
 void View2DWidget::drawBackground(QPainter *painter, const QRectF &rect)
@@ -41,35 +47,46 @@ void View2DWidget::drawBackground(QPainter *painter, const QRectF &rect)
 
     painter->fillRect(rect, QColor(233, 238, 242));
 
-    const qreal left = std::floor(rect.left() / m_smallGrid) * m_smallGrid;
-    const qreal right = std::ceil(rect.right() / m_smallGrid) * m_smallGrid;
-    const qreal top = std::floor(rect.top() / m_smallGrid) * m_smallGrid;
-    const qreal bottom = std::ceil(rect.bottom() / m_smallGrid) * m_smallGrid;
-
-    QVector<QLineF> minorLines;
-    QVector<QLineF> majorLines;
+    // Zoomed out, every level steps both spacings up tenfold, so the old
+    // major lines become the new minor ones.
+    const qreal pixelsPerUnit = painter->worldTransform().map(QLineF(0.0, 0.0, 1.0, 0.0)).length();
+    const int ratio = qMax(2, qRound(m_largeGrid / m_smallGrid));
+    qreal step = m_smallGrid;
+    while (step * pixelsPerUnit < kMinGridPixels && step < 1.0e9) {
+        step *= ratio;
+    }
 
-    for (qreal x = left; x <= right; x += m_smallGrid) {
-        if (std::fmod(std::abs(x), m_largeGrid) < 0.001) {
-            majorLines.append(QLineF(x, top, x, bottom));
-        } else {
-            minorLines.append(QLineF(x, top, x, bottom));
-        }
+    // Lines are indexed on an integer lattice, so positions do not drift and
+    // majors are found without floating-point remainders.
+    const qint64 firstColumn = static_cast<qint64>(std::floor(rect.left() / step));
+    const qint64 lastColumn = static_cast<qint64>(std::ceil(rect.right() / step));
+    const qint64 firstRow = static_cast<qint64>(std::floor(rect.top() / step));
+    const qint64 lastRow = static_cast<qint64>(std::ceil(rect.bottom() / step));
+    const qreal left = firstColumn * step;
+    const qreal right = lastColumn * step;
+    const qreal top = firstRow * step;
+    const qreal bottom = lastRow * step;
+
+    m_minorLines.clear();
+    m_majorLines.clear();
+
+    for (qint64 column = firstColumn; column <= lastColumn; ++column) {
+        const qreal x = column * step;
+        QVector<QLineF> &lines = column % ratio == 0 ? m_majorLines : m_minorLines;
+        lines.append(QLineF(x, top, x, bottom));
     }
 
-    for (qreal y = top; y <= bottom; y += m_smallGrid) {
-        if (std::fmod(std::abs(y), m_largeGrid) < 0.001) {
-            majorLines.append(QLineF(left, y, right, y));
-        } else {
-            minorLines.append(QLineF(left, y, right, y));
-        }
+    for (qint64 row = firstRow; row <= lastRow; ++row) {
+        const qreal y = row * step;
+        QVector<QLineF> &lines = row % ratio == 0 ? m_majorLines : m_minorLines;
+        lines.append(QLineF(left, y, right, y));
     }
 
     painter->setPen(QPen(QColor(212, 220, 228), 0));
-    painter->drawLines(minorLines);
+    painter->drawLines(m_minorLines);
 
     painter->setPen(QPen(QColor(184, 195, 206), 0));
-    painter->drawLines(majorLines);
+    painter->drawLines(m_majorLines);
 
     painter->restore();
 }
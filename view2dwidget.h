@@ -2,6 +2,8 @@
 #define VIEW2DWIDGET_H
 
 #include <QGraphicsView>
+#include <QLineF>
+#include <QVector>
 
 class View2DWidget : public QGraphicsView
 {
@@ -31,6 +33,9 @@ private:
     QPoint m_lastMousePos;
     qreal m_smallGrid;
     qreal m_largeGrid;
+    // Reused between paints so panning does not reallocate them.
+    QVector<QLineF> m_minorLines;
+    QVector<QLineF> m_majorLines;
 };
 
 #endif // VIEW2DWIDGET_H
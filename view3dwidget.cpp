@@ -3,23 +3,22 @@
 #include "designscene.h"
 #include "furnitureitem.h"
 #include "modelcache.h"
-#include "openingitem.h"
 #include "wallitem.h"
 
-#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <iterator>
 
+#include <QGenericMatrix>
 #include <QGraphicsItem>
 #include <QHash>
-#include <QLineF>
-#include <QMap>
-#include <QPair>
 #include <QSet>
 #include <QMatrix4x4>
 #include <QMouseEvent>
+#include <QOpenGLContext>
 #include <QOpenGLShader>
-#include <QVector2D>
 #include <QWheelEvent>
+#include <QtConcurrent>
 #include <QtGlobal>
 #include <QtMath>
 
@@ -31,6 +30,133 @@ constexpr float kPanSpeedFactor = 0.002f;
 constexpr float kZoomStep = 0.9f;
 constexpr float kFurnitureTintMix = 0.35f;
 constexpr float kAmbientStrength = 0.35f;
+constexpr int kMinBufferVertices = 4096;
+// Model matrix, colour, normal matrix.
+constexpr int kInstanceFloats = 16 + 3 + 9;
+// Room left around the plan when the packed-vertex grid is chosen, so walls
+// drawn next to it do not force a re-layout.
+constexpr float kQuantizationMargin = 5000.0f;
+// Coarsest grid walls are packed on; keeps plans up to about 130 m across
+// compact.
+constexpr float kMaxQuantizationStep = 2.0f;
+// Furniture whose bounding sphere projects to a smaller radius, in
+// pixels, is too small to see and is not drawn.
+constexpr float kMinFurniturePixels = 1.0f;
+// Projected radius, in pixels, below which furniture drops to each
+// coarser detail level of its model.
+constexpr float kLevelPixels[] = {150.0f, 40.0f};
+
+// Size of the Materials block's array, and the uniform buffer binding it
+// is read from.
+constexpr int kMaxMaterials = 16;
+constexpr GLuint kMaterialBinding = 0;
+
+// Lighting is a single directional light, so it is evaluated per vertex
+// and the fragment shader only writes the interpolated colour. Positions
+// are either floats, with origin 0 and step 1, or 16-bit steps of a
+// VertexQuantization grid. Each vertex picks its colour and opacity from
+// the material table by index.
+const char *const kVertexShaderSource =
+    "#version 330 core\n"
+    "layout(location = 0) in vec3 a_pos;\n"
+    "layout(location = 1) in vec4 a_normal;\n"
+    "layout(location = 7) in int a_material;\n"
+    "layout(std140) uniform Materials {\n"
+    "    vec4 u_materials[16];\n"
+    "};\n"
+    "uniform mat4 u_mvp;\n"
+    "uniform vec3 u_positionOrigin;\n"
+    "uniform float u_positionStep;\n"
+    "uniform vec3 u_lightDir;\n"
+    "uniform vec3 u_lightColor;\n"
+    "uniform float u_ambient;\n"
+    "out vec3 v_color;\n"
+    "out float v_alpha;\n"
+    "void main() {\n"
+    "    vec4 material = u_materials[a_material];\n"
+    "    float diff = max(dot(normalize(a_normal.xyz), -u_lightDir), 0.0);\n"
+    "    v_color = material.rgb * (u_ambient + u_lightColor * diff);\n"
+    "    v_alpha = material.a;\n"
+    "    vec3 pos = u_positionOrigin + a_pos * u_positionStep;\n"
+    "    gl_Position = u_mvp * vec4(pos, 1.0);\n"
+    "}\n";
+
+// Furniture: model-space vertices plus a per-instance model matrix, colour
+// and normal matrix. Items are scaled unevenly, so normals take the inverse
+// transpose; it is worked out once per instance on upload. Location 7 is
+// the walls' material, which the model buffers also carry.
+const char *const kInstancedVertexShaderSource =
+    "#version 330 core\n"
+    "layout(location = 0) in vec3 a_pos;\n"
+    "layout(location = 1) in vec4 a_normal;\n"
+    "layout(location = 2) in mat4 a_model;\n"
+    "layout(location = 6) in vec3 a_color;\n"
+    "layout(location = 8) in mat3 a_normalMatrix;\n"
+    "uniform mat4 u_mvp;\n"
+    "uniform vec3 u_positionOrigin;\n"
+    "uniform float u_positionStep;\n"
+    "uniform vec3 u_lightDir;\n"
+    "uniform vec3 u_lightColor;\n"
+    "uniform float u_ambient;\n"
+    "out vec3 v_color;\n"
+    "out float v_alpha;\n"
+    "void main() {\n"
+    "    vec3 normal = a_normalMatrix * a_normal.xyz;\n"
+    "    float diff = max(dot(normalize(normal), -u_lightDir), 0.0);\n"
+    "    v_color = a_color * (u_ambient + u_lightColor * diff);\n"
+    "    v_alpha = 1.0;\n"
+    "    vec3 pos = u_positionOrigin + a_pos * u_positionStep;\n"
+    "    gl_Position = u_mvp * (a_model * vec4(pos, 1.0));\n"
+    "}\n";
+
+const char *const kFragmentShaderSource =
+    "#version 330 core\n"
+    "in vec3 v_color;\n"
+    "in float v_alpha;\n"
+    "out vec4 FragColor;\n"
+    "void main() {\n"
+    "    FragColor = vec4(v_color, v_alpha);\n"
+    "}\n";
+
+// Colour and opacity per mesh category, in SceneMesher::Category order;
+// uploaded as the material table, indexed by category. Categories that
+// are not fully opaque are drawn in the blended pass. A new category only
+// needs its row here.
+const struct {
+    float r;
+    float g;
+    float b;
+    float alpha;
+} kCategoryStyles[] = {
+    {0.62f, 0.68f, 0.75f, 1.0f},  // wall
+    {0.56f, 0.60f, 0.64f, 1.0f},  // single door
+    {0.50f, 0.55f, 0.60f, 1.0f},  // double door
+    {0.44f, 0.49f, 0.54f, 1.0f},  // sliding door
+    {0.45f, 0.50f, 0.56f, 1.0f},  // window frame
+    {0.55f, 0.75f, 0.86f, 0.36f}, // casement glass
+    {0.42f, 0.62f, 0.74f, 0.28f}, // sliding glass
+    {0.62f, 0.82f, 0.88f, 0.32f}  // bay glass
+};
+
+static_assert(std::size(kCategoryStyles) == SceneMesher::CategoryCount,
+              "every mesh category needs a style");
+static_assert(SceneMesher::CategoryCount <= kMaxMaterials,
+              "the Materials block holds one entry per category");
+
+bool isTransparent(int category)
+{
+    return kCategoryStyles[category].alpha < 1.0f;
+}
+
+// Slot size reserved in the VBO for a chunk. The slack lets small edits
+// (a moved endpoint, a resized opening) be rewritten in place.
+int slotCapacityFor(int vertexCount)
+{
+    if (vertexCount <= 0) {
+        return 0;
+    }
+    return vertexCount + vertexCount / 4 + 36;
+}
 
 QVector3D mixColor(const QVector3D &a, const QVector3D &b, float t)
 {
@@ -79,266 +205,38 @@ QVector3D furnitureColorFor(const QString &material, const QString &key)
     return mixColor(base, tint, kFurnitureTintMix);
 }
 
-// Tolerance for considering two points as the same junction
-constexpr qreal kJunctionTolerance = 1.0;
-// Maximum miter extension factor to prevent extremely long spikes at sharp angles
-constexpr qreal kMaxMiterFactor = 3.0;
-
-// Calculate the perpendicular offset for a wall (half thickness on each side)
-QPointF wallPerpOffset(const WallItem *wall)
-{
-    QPointF dir = wall->endPos() - wall->startPos();
-    QVector2D v(dir);
-    if (v.lengthSquared() < 0.0001f) {
-        return QPointF(0, wall->thickness() / 2.0);
-    }
-    v.normalize();
-    // Perpendicular (rotate 90 degrees counterclockwise)
-    QVector2D perp(-v.y(), v.x());
-    return QPointF(perp.x() * wall->thickness() / 2.0, perp.y() * wall->thickness() / 2.0);
-}
-
-// Find the intersection point of two lines defined by point+direction
-// Returns true if an intersection exists (lines are not parallel)
-bool lineIntersection(const QPointF &p1, const QPointF &d1,
-                      const QPointF &p2, const QPointF &d2,
-                      QPointF &intersection)
+QString furnitureBucketKey(const AssetManager::Asset &asset)
 {
-    // Solve: p1 + t*d1 = p2 + s*d2
-    // Using cross-product method
-    qreal cross = d1.x() * d2.y() - d1.y() * d2.x();
-    if (qAbs(cross) < 0.0001) {
-        return false;  // Lines are parallel
-    }
-    
-    QPointF delta = p2 - p1;
-    qreal t = (delta.x() * d2.y() - delta.y() * d2.x()) / cross;
-    intersection = p1 + d1 * t;
-    return true;
-}
-
-// Calculate mitered corner points for a wall endpoint connected to another wall
-// This finds where the wall edges would intersect if extended
-// Returns the two corner points for this end of the wall
-void calculateMiterCorners(const WallItem *wall, bool atStart,
-                           const WallItem *adjacentWall,
-                           QPointF &corner1, QPointF &corner2)
-{
-    QPointF wallOffset = wallPerpOffset(wall);
-    QPointF adjOffset = wallPerpOffset(adjacentWall);
-    
-    QPointF wallDir = wall->endPos() - wall->startPos();
-    QPointF adjDir = adjacentWall->endPos() - adjacentWall->startPos();
-    
-    // The junction point (center of the corner)
-    QPointF junctionPt = atStart ? wall->startPos() : wall->endPos();
-    
-    // Wall edge points (on each side of the wall, at junction)
-    QPointF wall_edge_plus = junctionPt + wallOffset;
-    QPointF wall_edge_minus = junctionPt - wallOffset;
-    
-    // Adjacent wall edge points
-    QPointF adj_edge_plus = junctionPt + adjOffset;
-    QPointF adj_edge_minus = junctionPt - adjOffset;
-    
-    // For each side of the wall (+offset and -offset), find where it intersects
-    // with the corresponding side of the adjacent wall
-    
-    // Try ++, +-, -+, -- combinations and pick the correct matches
-    QPointF int_pp, int_pm, int_mp, int_mm;
-    bool has_pp = lineIntersection(wall_edge_plus, wallDir, adj_edge_plus, adjDir, int_pp);
-    bool has_pm = lineIntersection(wall_edge_plus, wallDir, adj_edge_minus, adjDir, int_pm);
-    bool has_mp = lineIntersection(wall_edge_minus, wallDir, adj_edge_plus, adjDir, int_mp);
-    bool has_mm = lineIntersection(wall_edge_minus, wallDir, adj_edge_minus, adjDir, int_mm);
-    
-    qreal maxExtend = wall->thickness() * kMaxMiterFactor;
-    
-    // For the +offset side of the wall, find the valid intersection
-    // The valid one should be relatively close to the junction
-    bool found1 = false;
-    if (has_pp) {
-        qreal dist = QVector2D(int_pp - junctionPt).length();
-        if (dist < maxExtend) {
-            corner1 = int_pp;
-            found1 = true;
-        }
+    QString key = asset.id.trimmed();
+    if (key.isEmpty()) {
+        key = asset.category.trimmed();
     }
-    if (!found1 && has_pm) {
-        qreal dist = QVector2D(int_pm - junctionPt).length();
-        if (dist < maxExtend) {
-            corner1 = int_pm;
-            found1 = true;
-        }
-    }
-    if (!found1) {
-        corner1 = wall_edge_plus;
-    }
-    
-    // For the -offset side of the wall
-    bool found2 = false;
-    if (has_mm) {
-        qreal dist = QVector2D(int_mm - junctionPt).length();
-        if (dist < maxExtend) {
-            corner2 = int_mm;
-            found2 = true;
-        }
-    }
-    if (!found2 && has_mp) {
-        qreal dist = QVector2D(int_mp - junctionPt).length();
-        if (dist < maxExtend) {
-            corner2 = int_mp;
-            found2 = true;
-        }
-    }
-    if (!found2) {
-        corner2 = wall_edge_minus;
-    }
-}
-
-
-
-// Find an adjacent wall at a junction point
-const WallItem* findAdjacentWall(const QPointF &point,
-                                  const WallItem *currentWall,
-                                  const QList<WallItem *> &allWalls)
-{
-    for (const WallItem *other : allWalls) {
-        if (other == currentWall) {
-            continue;
-        }
-        if (QVector2D(other->startPos() - point).length() < kJunctionTolerance) {
-            return other;
-        }
-        if (QVector2D(other->endPos() - point).length() < kJunctionTolerance) {
-            return other;
-        }
-    }
-    return nullptr;
-}
-
-
-// Add a triangular prism to fill the gap at a corner junction
-void appendCornerFill(const QPointF &junctionPt, 
-                      const WallItem *wall1, const WallItem *wall2,
-                      QVector<QVector3D> &vertices)
-{
-    if (!wall1 || !wall2) return;
-    
-    QPointF offset1 = wallPerpOffset(wall1);
-    QPointF offset2 = wallPerpOffset(wall2);
-    
-    // Get wall directions (pointing away from junction)
-    QPointF dir1 = wall1->endPos() - wall1->startPos();
-    QPointF dir2 = wall2->endPos() - wall2->startPos();
-    
-    bool wall1AtStart = QVector2D(wall1->startPos() - junctionPt).length() < kJunctionTolerance;
-    bool wall2AtStart = QVector2D(wall2->startPos() - junctionPt).length() < kJunctionTolerance;
-    
-    // Flip direction if junction is at end
-    if (!wall1AtStart) dir1 = -dir1;
-    if (!wall2AtStart) dir2 = -dir2;
-    
-    QVector2D d1(dir1), d2(dir2);
-    if (d1.lengthSquared() > 0.0001f) d1.normalize();
-    if (d2.lengthSquared() > 0.0001f) d2.normalize();
-    
-    // Cross product determines corner type
-    float cross = d1.x() * d2.y() - d1.y() * d2.x();
-    
-    // Get the 4 potential corner points
-    QPointF w1_plus = junctionPt + offset1;
-    QPointF w1_minus = junctionPt - offset1;
-    QPointF w2_plus = junctionPt + offset2;
-    QPointF w2_minus = junctionPt - offset2;
-    
-    // Choose the three points that form the corner gap
-    QPointF corner1, corner2;
-    
-    if (cross > 0) {
-        // Right turn - gap is on the "minus" side
-        corner1 = w1_minus;
-        corner2 = w2_minus;
-    } else {
-        // Left turn - gap is on the "plus" side
-        corner1 = w1_plus;
-        corner2 = w2_plus;
-    }
-    
-    // Only add fill if the corners are different (there's actually a gap)
-    if (QVector2D(corner1 - corner2).length() < 0.5) {
-        return;
+    if (key.isEmpty()) {
+        key = QStringLiteral("furniture");
     }
-    
-    qreal height = qMin(wall1->height(), wall2->height());
-    
-    // Create a triangular prism to fill the gap
-    auto to3d = [](const QPointF &p, qreal y) {
-        return QVector3D(p.x(), static_cast<float>(y), -p.y());
-    };
-    
-    QVector3D b0 = to3d(junctionPt, 0);
-    QVector3D b1 = to3d(corner1, 0);
-    QVector3D b2 = to3d(corner2, 0);
-    QVector3D t0 = to3d(junctionPt, height);
-    QVector3D t1 = to3d(corner1, height);
-    QVector3D t2 = to3d(corner2, height);
-    
-    // Top and bottom triangles
-    vertices << t0 << t1 << t2;
-    vertices << b0 << b2 << b1;
-    
-    // Side faces
-    vertices << b0 << b1 << t1;
-    vertices << b0 << t1 << t0;
-    vertices << b0 << t0 << t2;
-    vertices << b0 << t2 << b2;
-    vertices << b1 << b2 << t2;
-    vertices << b1 << t2 << t1;
+    return key.toLower();
 }
 
-
-void appendBoxFromQuad(const QPointF &p1,
-                       const QPointF &p2,
-                       const QPointF &p3,
-                       const QPointF &p4,
-                       qreal baseY,
-                       qreal height,
-                       QVector<QVector3D> &vertices)
-{
-    auto to3d = [baseY](const QPointF &p) {
-        return QVector3D(p.x(), static_cast<float>(baseY), -p.y());
-    };
-
-    const QVector3D b1 = to3d(p1);
-    const QVector3D b2 = to3d(p2);
-    const QVector3D b3 = to3d(p3);
-    const QVector3D b4 = to3d(p4);
-
-    const QVector3D topOffset(0.0f, static_cast<float>(height), 0.0f);
-    const QVector3D t1 = b1 + topOffset;
-    const QVector3D t2 = b2 + topOffset;
-    const QVector3D t3 = b3 + topOffset;
-    const QVector3D t4 = b4 + topOffset;
-
-    vertices << t1 << t2 << t3;
-    vertices << t1 << t3 << t4;
-    vertices << b1 << b3 << b2;
-    vertices << b1 << b4 << b3;
-    vertices << b1 << b2 << t2;
-    vertices << b1 << t2 << t1;
-    vertices << b2 << b3 << t3;
-    vertices << b2 << t3 << t2;
-    vertices << b3 << b4 << t4;
-    vertices << b3 << t4 << t3;
-    vertices << b4 << b1 << t1;
-    vertices << b4 << t1 << t4;
-}
 }
 
 View3DWidget::View3DWidget(QWidget *parent)
     : QOpenGLWidget(parent)
     , m_scene(nullptr)
+    , m_program(nullptr)
+    , m_instanceProgram(nullptr)
     , m_vbo(QOpenGLBuffer::VertexBuffer)
+    , m_chunksRemoved(false)
+    , m_meshGeneration(0)
+    , m_meshBuildQueued(false)
+    , m_materialBuffer(0)
+    , m_furnitureTriangles(0)
+    , m_furnitureHierarchyDirty(false)
+    , m_vboCapacity(0)
+    , m_vboUsed(0)
+    , m_vboWaste(0)
+    , m_packedVertices(false)
+    , m_quantization()
+    , m_uploadedVertexBytes(0)
     , m_geometryDirty(true)
     , m_vertexCount(0)
     , m_distance(8000.0f)
@@ -353,6 +251,27 @@ View3DWidget::View3DWidget(QWidget *parent)
     fmt.setDepthBufferSize(24);
     setFormat(fmt);
     setFocusPolicy(Qt::StrongFocus);
+
+    connect(&m_meshWatcher, &QFutureWatcher<SceneMesher::Result>::finished,
+            this, &View3DWidget::onMeshBuildFinished);
+    connect(ModelCache::instance(), &ModelCache::modelReady,
+            this, &View3DWidget::onModelReady);
+}
+
+View3DWidget::~View3DWidget()
+{
+    m_meshGeneration.fetchAndAddRelaxed(1);
+    m_meshWatcher.waitForFinished();
+    cleanupGL();
+}
+
+int View3DWidget::MeshChunk::vertexCount() const
+{
+    int count = 0;
+    for (const QVector<MeshVertex> &part : mesh.parts) {
+        count += static_cast<int>(part.size());
+    }
+    return count;
 }
 
 void View3DWidget::setScene(DesignScene *scene)
@@ -366,17 +285,47 @@ void View3DWidget::setScene(DesignScene *scene)
     }
 
     m_scene = scene;
+    releaseChunks();
 
     if (m_scene) {
-        connect(m_scene, &DesignScene::sceneContentChanged,
-                this, &View3DWidget::scheduleSync);
+        connect(m_scene, &DesignScene::contentChanged,
+                this, &View3DWidget::applySceneChanges);
         connect(m_scene, &QObject::destroyed, this, [this]() {
             m_scene = nullptr;
-            scheduleSync();
+            releaseChunks();
+            resyncScene();
         });
     }
 
-    scheduleSync();
+    resyncScene();
+}
+
+View3DWidget::CullStatistics View3DWidget::cullStatistics() const
+{
+    return m_cullStatistics;
+}
+
+QString View3DWidget::bufferReport() const
+{
+    QString report;
+    report += m_packedVertices
+        ? QStringLiteral("墙体顶点: 16 位定点, 步长 %1, %2 字节\n")
+              .arg(m_quantization.step).arg(sizeof(PackedMeshVertex))
+        : QStringLiteral("墙体顶点: 浮点, %1 字节\n").arg(sizeof(FloatMeshVertex));
+    report += QStringLiteral("墙体缓冲: %1 顶点, 已占 %2 / %3 字节, 空洞 %4 字节\n")
+                  .arg(m_vertexCount)
+                  .arg(qint64(m_vboUsed) * vertexStride())
+                  .arg(qint64(m_vboCapacity) * vertexStride())
+                  .arg(qint64(m_vboWaste) * vertexStride());
+    qint64 modelBytes = 0;
+    for (const ModelBatch *batch : qAsConst(m_models)) {
+        modelBytes += batch->mesh->vertices.size() * qint64(sizeof(PackedMeshVertex));
+    }
+    report += QStringLiteral("家具模型: %1 个, 顶点 %2 字节\n")
+                  .arg(m_models.size())
+                  .arg(modelBytes);
+    report += QStringLiteral("累计上传顶点: %1 字节\n").arg(m_uploadedVertexBytes);
+    return report;
 }
 
 void View3DWidget::initializeGL()
@@ -389,38 +338,33 @@ void View3DWidget::initializeGL()
     glDisable(GL_CULL_FACE);
     glClearColor(0.12f, 0.15f, 0.18f, 1.0f);
 
-    m_program.addShaderFromSourceCode(
-        QOpenGLShader::Vertex,
-        "#version 330 core\n"
-        "layout(location = 0) in vec3 a_pos;\n"
-        "uniform mat4 u_mvp;\n"
-        "out vec3 v_worldPos;\n"
-        "void main() {\n"
-        "    v_worldPos = a_pos;\n"
-        "    gl_Position = u_mvp * vec4(a_pos, 1.0);\n"
-        "}\n");
-
-    m_program.addShaderFromSourceCode(
-        QOpenGLShader::Fragment,
-        "#version 330 core\n"
-        "in vec3 v_worldPos;\n"
-        "out vec4 FragColor;\n"
-        "uniform vec3 u_color;\n"
-        "uniform float u_alpha;\n"
-        "uniform vec3 u_lightDir;\n"
-        "uniform vec3 u_lightColor;\n"
-        "uniform float u_ambient;\n"
-        "void main() {\n"
-        "    vec3 dx = dFdx(v_worldPos);\n"
-        "    vec3 dy = dFdy(v_worldPos);\n"
-        "    vec3 normal = normalize(cross(dx, dy));\n"
-        "    float diff = max(dot(normal, normalize(-u_lightDir)), 0.0);\n"
-        "    vec3 ambient = u_color * u_ambient;\n"
-        "    vec3 diffuse = u_color * u_lightColor * diff;\n"
-        "    FragColor = vec4(ambient + diffuse, u_alpha);\n"
-        "}\n");
-
-    m_program.link();
+    connect(context(), &QOpenGLContext::aboutToBeDestroyed,
+            this, &View3DWidget::cleanupGL, Qt::UniqueConnection);
+
+    // A program belongs to the context it was linked in, so every context
+    // gets new ones. Without both the view only clears.
+    m_program = new QOpenGLShaderProgram;
+    m_instanceProgram = new QOpenGLShaderProgram;
+    const bool linked =
+        m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, kVertexShaderSource)
+        && m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, kFragmentShaderSource)
+        && m_program->link()
+        && m_instanceProgram->addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                                      kInstancedVertexShaderSource)
+        && m_instanceProgram->addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                                      kFragmentShaderSource)
+        && m_instanceProgram->link();
+    if (!linked) {
+        delete m_program;
+        m_program = nullptr;
+        delete m_instanceProgram;
+        m_instanceProgram = nullptr;
+        return;
+    }
+    glUniformBlockBinding(m_program->programId(),
+                          glGetUniformBlockIndex(m_program->programId(), "Materials"),
+                          kMaterialBinding);
+    uploadMaterials();
 
     m_vao.create();
     QOpenGLVertexArrayObject::Binder vaoBinder(&m_vao);
@@ -430,11 +374,68 @@ void View3DWidget::initializeGL()
     m_vbo.bind();
     m_vbo.allocate(nullptr, 0);
 
-    m_program.bind();
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), nullptr);
-    m_program.release();
+    m_program->bind();
+    setVertexLayout(m_packedVertices);
+    m_program->release();
     m_vbo.release();
+
+    // A new context starts with an empty buffer; cached chunks are re-uploaded
+    // on the next paint without being re-meshed.
+    m_vboCapacity = 0;
+    m_vboUsed = 0;
+    m_vboWaste = 0;
+    m_geometryDirty = true;
+}
+
+// Attributes 0, 1 and 7 of the bound vertex array read PackedMeshVertex,
+// or FloatMeshVertex, data from the bound array buffer. Furniture shaders
+// take their colour per instance and ignore the material.
+void View3DWidget::setVertexLayout(bool packed)
+{
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(7);
+    if (packed) {
+        const GLsizei stride = sizeof(PackedMeshVertex);
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, stride,
+                              reinterpret_cast<const void *>(offsetof(PackedMeshVertex, position)));
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+                              reinterpret_cast<const void *>(offsetof(PackedMeshVertex, normal)));
+        glVertexAttribIPointer(7, 1, GL_SHORT, stride,
+                               reinterpret_cast<const void *>(offsetof(PackedMeshVertex, material)));
+        return;
+    }
+    const GLsizei stride = sizeof(FloatMeshVertex);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<const void *>(offsetof(FloatMeshVertex, position)));
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+                          reinterpret_cast<const void *>(offsetof(FloatMeshVertex, normal)));
+    glVertexAttribIPointer(7, 1, GL_INT, stride,
+                           reinterpret_cast<const void *>(offsetof(FloatMeshVertex, material)));
+}
+
+int View3DWidget::vertexStride() const
+{
+    return static_cast<int>(m_packedVertices ? sizeof(PackedMeshVertex) : sizeof(FloatMeshVertex));
+}
+
+void View3DWidget::uploadMaterials()
+{
+    // std140 lays the vec4 array out tightly, one colour and alpha each.
+    float table[kMaxMaterials * 4] = {};
+    for (int category = 0; category < SceneMesher::CategoryCount; ++category) {
+        table[category * 4] = kCategoryStyles[category].r;
+        table[category * 4 + 1] = kCategoryStyles[category].g;
+        table[category * 4 + 2] = kCategoryStyles[category].b;
+        table[category * 4 + 3] = kCategoryStyles[category].alpha;
+    }
+
+    if (m_materialBuffer == 0) {
+        glGenBuffers(1, &m_materialBuffer);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, m_materialBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(table), table, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
 void View3DWidget::resizeGL(int w, int h)
@@ -448,101 +449,94 @@ void View3DWidget::paintGL()
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    if (!m_program) {
+        return;
+    }
+
     if (m_geometryDirty) {
-        rebuildGeometry();
+        uploadGeometry();
     }
 
-    if (m_vertexCount == 0) {
+    if (m_vertexCount == 0 && m_models.isEmpty()) {
         return;
     }
 
-    m_program.bind();
+    const QVector3D lightDir = QVector3D(-0.35f, -1.0f, -0.25f).normalized();
+    const QVector3D lightColor(0.95f, 0.97f, 1.0f);
     const QMatrix4x4 mvp = m_projection * viewMatrix();
-    m_program.setUniformValue("u_mvp", mvp);
-    m_program.setUniformValue("u_lightDir",
-                              QVector3D(-0.35f, -1.0f, -0.25f).normalized());
-    m_program.setUniformValue("u_lightColor", QVector3D(0.95f, 0.97f, 1.0f));
-    m_program.setUniformValue("u_ambient", kAmbientStrength);
 
-    QOpenGLVertexArrayObject::Binder vaoBinder(&m_vao);
-    if (m_ranges.wallCount > 0) {
-        m_program.setUniformValue("u_color", QVector3D(0.62f, 0.68f, 0.75f));
-        m_program.setUniformValue("u_alpha", 1.0f);
-        glDrawArrays(GL_TRIANGLES, m_ranges.wallStart, m_ranges.wallCount);
+    m_cullStatistics = CullStatistics();
+    const ViewFrustum frustum(mvp);
+    cullWalls(frustum);
+    cullFurniture(frustum, eyePosition());
+
+    if (!m_models.isEmpty()) {
+        m_instanceProgram->bind();
+        m_instanceProgram->setUniformValue("u_mvp", mvp);
+        m_instanceProgram->setUniformValue("u_lightDir", lightDir);
+        m_instanceProgram->setUniformValue("u_lightColor", lightColor);
+        m_instanceProgram->setUniformValue("u_ambient", kAmbientStrength);
+        for (ModelBatch *batch : qAsConst(m_models)) {
+            if (batch->drawnItems.isEmpty()) {
+                continue;
+            }
+            m_instanceProgram->setUniformValue("u_positionOrigin", batch->quantization.origin);
+            m_instanceProgram->setUniformValue("u_positionStep", batch->quantization.step);
+            QOpenGLVertexArrayObject::Binder modelBinder(&batch->vao);
+            batch->instanceBuffer.bind();
+            const int indexSize = batch->indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+            int firstInstance = 0;
+            for (int level = 0; level < batch->levelInstances.size(); ++level) {
+                const int count = batch->levelInstances.at(level);
+                if (count == 0) {
+                    continue;
+                }
+                // GL 3.3 has no base instance, so the instance attributes
+                // are pointed at the level's first instance instead.
+                const MeshData::Level &range = batch->mesh->levels.at(level);
+                setInstanceLayout(firstInstance);
+                glDrawElementsInstanced(GL_TRIANGLES, range.indexCount, batch->indexType,
+                                        reinterpret_cast<const void *>(
+                                            qintptr(range.firstIndex) * indexSize),
+                                        count);
+                firstInstance += count;
+            }
+            batch->instanceBuffer.release();
+        }
+        m_instanceProgram->release();
     }
 
-    if (m_ranges.doorSingleCount > 0) {
-        m_program.setUniformValue("u_color", QVector3D(0.56f, 0.60f, 0.64f));
-        m_program.setUniformValue("u_alpha", 1.0f);
-        glDrawArrays(GL_TRIANGLES,
-                     m_ranges.doorSingleStart,
-                     m_ranges.doorSingleCount);
+    if (m_vertexCount == 0) {
+        return;
     }
 
-    if (m_ranges.doorDoubleCount > 0) {
-        m_program.setUniformValue("u_color", QVector3D(0.50f, 0.55f, 0.60f));
-        m_program.setUniformValue("u_alpha", 1.0f);
-        glDrawArrays(GL_TRIANGLES,
-                     m_ranges.doorDoubleStart,
-                     m_ranges.doorDoubleCount);
-    }
+    m_program->bind();
+    m_program->setUniformValue("u_mvp", mvp);
+    m_program->setUniformValue("u_lightDir", lightDir);
+    m_program->setUniformValue("u_lightColor", lightColor);
+    m_program->setUniformValue("u_ambient", kAmbientStrength);
+    m_program->setUniformValue("u_positionOrigin", m_quantization.origin);
+    m_program->setUniformValue("u_positionStep", m_quantization.step);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kMaterialBinding, m_materialBuffer);
 
-    if (m_ranges.doorSlidingCount > 0) {
-        m_program.setUniformValue("u_color", QVector3D(0.44f, 0.49f, 0.54f));
-        m_program.setUniformValue("u_alpha", 1.0f);
-        glDrawArrays(GL_TRIANGLES,
-                     m_ranges.doorSlidingStart,
-                     m_ranges.doorSlidingCount);
-    }
+    QOpenGLVertexArrayObject::Binder vaoBinder(&m_vao);
+    const auto drawBatch = [this](const DrawBatch &batch) {
+        glMultiDrawArrays(GL_TRIANGLES,
+                          batch.firsts.constData(),
+                          batch.counts.constData(),
+                          static_cast<GLsizei>(batch.firsts.size()));
+    };
 
-    if (m_ranges.openingCount > 0) {
-        m_program.setUniformValue("u_color", QVector3D(0.45f, 0.50f, 0.56f));
-        m_program.setUniformValue("u_alpha", 1.0f);
-        glDrawArrays(GL_TRIANGLES, m_ranges.openingStart, m_ranges.openingCount);
+    if (!m_passes[Pass_Opaque].firsts.isEmpty()) {
+        drawBatch(m_passes[Pass_Opaque]);
     }
-
-    if (m_ranges.glassCasementCount > 0 ||
-        m_ranges.glassSlidingCount > 0 ||
-        m_ranges.glassBayCount > 0) {
+    if (!m_passes[Pass_Transparent].firsts.isEmpty()) {
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-        if (m_ranges.glassCasementCount > 0) {
-            m_program.setUniformValue("u_color", QVector3D(0.55f, 0.75f, 0.86f));
-            m_program.setUniformValue("u_alpha", 0.36f);
-            glDrawArrays(GL_TRIANGLES,
-                         m_ranges.glassCasementStart,
-                         m_ranges.glassCasementCount);
-        }
-
-        if (m_ranges.glassSlidingCount > 0) {
-            m_program.setUniformValue("u_color", QVector3D(0.42f, 0.62f, 0.74f));
-            m_program.setUniformValue("u_alpha", 0.28f);
-            glDrawArrays(GL_TRIANGLES,
-                         m_ranges.glassSlidingStart,
-                         m_ranges.glassSlidingCount);
-        }
-
-        if (m_ranges.glassBayCount > 0) {
-            m_program.setUniformValue("u_color", QVector3D(0.62f, 0.82f, 0.88f));
-            m_program.setUniformValue("u_alpha", 0.32f);
-            glDrawArrays(GL_TRIANGLES,
-                         m_ranges.glassBayStart,
-                         m_ranges.glassBayCount);
-        }
-
+        drawBatch(m_passes[Pass_Transparent]);
         glDisable(GL_BLEND);
     }
-
-    for (const ColorRange &range : qAsConst(m_furnitureRanges)) {
-        if (range.count <= 0) {
-            continue;
-        }
-        m_program.setUniformValue("u_color", range.color);
-        m_program.setUniformValue("u_alpha", range.alpha);
-        glDrawArrays(GL_TRIANGLES, range.start, range.count);
-    }
-    m_program.release();
+    m_program->release();
 }
 
 void View3DWidget::mousePressEvent(QMouseEvent *event)
@@ -606,636 +600,795 @@ void View3DWidget::wheelEvent(QWheelEvent *event)
     event->accept();
 }
 
-void View3DWidget::scheduleSync()
+void View3DWidget::applySceneChanges(const SceneChangeSet &changes)
 {
+    if (changes.reset) {
+        resyncScene();
+        return;
+    }
+
+    bool wallsChanged = false;
+    bool furnitureChanged = false;
+    for (auto it = changes.items.cbegin(); it != changes.items.cend(); ++it) {
+        QGraphicsItem *item = it.key();
+        if (it.value() & SceneChange_Removed) {
+            wallsChanged |= removeWallSnapshot(item);
+            furnitureChanged |= removeFurnitureInstance(item);
+            continue;
+        }
+        // A new item may have got a deleted one's address within the same
+        // change set, so the removal was merged away. Whatever the old item
+        // left under the key is dropped if it was of another kind.
+        auto *wall = qgraphicsitem_cast<WallItem *>(item);
+        auto *furniture = qgraphicsitem_cast<FurnitureItem *>(item);
+        if (!wall) {
+            wallsChanged |= removeWallSnapshot(item);
+        }
+        if (!furniture) {
+            furnitureChanged |= removeFurnitureInstance(item);
+        }
+        if (wall) {
+            updateWallSnapshot(wall);
+            wallsChanged = true;
+        } else if (furniture) {
+            updateFurnitureInstance(furniture);
+            furnitureChanged = true;
+        }
+    }
+
+    if (wallsChanged) {
+        startMeshBuild();
+    }
+    if (wallsChanged || furnitureChanged) {
+        m_geometryDirty = true;
+        update();
+    }
+}
+
+void View3DWidget::resyncScene()
+{
+    for (const SceneMesher::WallSnapshot &wall : qAsConst(m_wallSnapshots)) {
+        m_removedWalls.insert(wall.key);
+    }
+    m_wallSnapshots.clear();
+    m_snapshotSlots.clear();
+    m_staleWalls.clear();
+
+    for (const FurnitureInstance &instance : qAsConst(m_furniture)) {
+        m_touchedModels.insert(instance.mesh.data());
+    }
+    m_furniture.clear();
+
+    if (m_scene) {
+        const QList<QGraphicsItem *> items = m_scene->items();
+        for (QGraphicsItem *item : items) {
+            if (auto *wall = qgraphicsitem_cast<WallItem *>(item)) {
+                updateWallSnapshot(wall);
+            } else if (auto *furniture = qgraphicsitem_cast<FurnitureItem *>(item)) {
+                if (!furniture->isPreview()) {
+                    updateFurnitureInstance(furniture);
+                }
+            }
+        }
+    }
+
+    startMeshBuild();
     m_geometryDirty = true;
     update();
 }
 
-void View3DWidget::rebuildGeometry()
+void View3DWidget::updateWallSnapshot(WallItem *wall)
+{
+    const auto slot = m_snapshotSlots.constFind(wall);
+    if (slot != m_snapshotSlots.constEnd()) {
+        m_wallSnapshots[slot.value()] = SceneMesher::snapshotWall(wall);
+    } else {
+        m_snapshotSlots.insert(wall, static_cast<int>(m_wallSnapshots.size()));
+        m_wallSnapshots.append(SceneMesher::snapshotWall(wall));
+    }
+    m_staleWalls.insert(wall);
+    m_removedWalls.remove(wall);
+}
+
+bool View3DWidget::removeWallSnapshot(const QGraphicsItem *item)
+{
+    const auto slot = m_snapshotSlots.find(item);
+    if (slot == m_snapshotSlots.end()) {
+        return false;
+    }
+
+    const int index = slot.value();
+    const WallItem *key = m_wallSnapshots.at(index).key;
+    m_snapshotSlots.erase(slot);
+
+    // Keep the vector dense by moving the last snapshot into the hole.
+    const int last = static_cast<int>(m_wallSnapshots.size()) - 1;
+    if (index != last) {
+        m_wallSnapshots[index] = m_wallSnapshots.at(last);
+        m_snapshotSlots[m_wallSnapshots.at(index).key] = index;
+    }
+    m_wallSnapshots.removeLast();
+
+    m_staleWalls.remove(key);
+    m_removedWalls.insert(key);
+    return true;
+}
+
+void View3DWidget::updateFurnitureInstance(FurnitureItem *furniture)
+{
+    auto it = m_furniture.find(furniture);
+    if (it != m_furniture.end() && it->revision == furniture->meshRevision()) {
+        return;
+    }
+    if (it != m_furniture.end()) {
+        m_touchedModels.insert(it->mesh.data());
+    } else {
+        it = m_furniture.insert(furniture, FurnitureInstance());
+    }
+
+    FurnitureInstance &instance = it.value();
+    instance.item = furniture;
+    instance.revision = furniture->meshRevision();
+    instance.mesh.reset();
+
+    // Until the model is parsed this is the placeholder cube, fitted to the
+    // item's size; onModelReady() swaps the real mesh in.
+    const AssetManager::Asset asset = furniture->asset();
+    instance.modelPath = asset.modelPath;
+    QSharedPointer<MeshData> mesh = ModelCache::instance()->requestModel(asset.modelPath);
+    if (!mesh || mesh->indexCount() == 0) {
+        return;
+    }
+
+    const QVector3D scale = furniture->modelScale(mesh->size());
+    instance.transform = furniture->transformMatrix();
+    instance.transform.scale(scale.x(), scale.y(), scale.z());
+    instance.transform.translate(mesh->pivotOffset());
+    instance.color = furnitureColorFor(asset.material, furnitureBucketKey(asset));
+    instance.mesh = mesh;
+    m_touchedModels.insert(mesh.data());
+}
+
+bool View3DWidget::removeFurnitureInstance(const QGraphicsItem *item)
+{
+    const auto it = m_furniture.find(item);
+    if (it == m_furniture.end()) {
+        return false;
+    }
+    m_touchedModels.insert(it->mesh.data());
+    m_furniture.erase(it);
+    return true;
+}
+
+void View3DWidget::onMeshBuildFinished()
 {
-    m_vertices.clear();
-    m_wallVertices.clear();
-    m_doorSingleVertices.clear();
-    m_doorDoubleVertices.clear();
-    m_doorSlidingVertices.clear();
-    m_openingVertices.clear();
-    m_glassCasementVertices.clear();
-    m_glassSlidingVertices.clear();
-    m_glassBayVertices.clear();
-    m_furnitureRanges.clear();
+    const SceneMesher::Result result = m_meshWatcher.result();
+    if (!result.cancelled && result.generation == m_meshGeneration.loadRelaxed()) {
+        applyMeshBuild(result);
+    }
+    if (m_meshBuildQueued) {
+        startMeshBuild();
+    }
+}
 
+void View3DWidget::onModelReady(const QString &path)
+{
     if (!m_scene) {
-        m_vertexCount = 0;
-        m_ranges = {};
-        m_geometryDirty = false;
         return;
     }
 
-    QMap<QString, QVector<QVector3D>> furnitureBuckets;
-    QHash<QString, QVector3D> furnitureColors;
+    // Deliver pending removals first so every remaining instance's item is
+    // still alive.
+    m_scene->flushChanges();
 
-    const QList<QGraphicsItem *> items = m_scene->items();
-    
-    // First pass: collect all walls for junction detection
-    QList<WallItem *> allWalls;
-    for (QGraphicsItem *item : items) {
-        if (auto *wall = qgraphicsitem_cast<WallItem *>(item)) {
-            allWalls.append(wall);
+    QVector<FurnitureItem *> waiting;
+    for (FurnitureInstance &instance : m_furniture) {
+        if (instance.modelPath == path) {
+            instance.revision = 0;
+            waiting.append(instance.item);
         }
     }
-    
-    // Second pass: generate geometry with junction information
-    for (QGraphicsItem *item : items) {
-        if (auto *wall = qgraphicsitem_cast<WallItem *>(item)) {
-            appendWallMesh(wall, allWalls, m_wallVertices);
-            continue;
-        }
-        if (auto *furniture = qgraphicsitem_cast<FurnitureItem *>(item)) {      
-            const AssetManager::Asset asset = furniture->asset();
-            QString key = asset.id.trimmed();
-            if (key.isEmpty()) {
-                key = asset.category.trimmed();
-            }
-            if (key.isEmpty()) {
-                key = QStringLiteral("furniture");
-            }
-            key = key.toLower();
-            QVector<QVector3D> &bucket = furnitureBuckets[key];
-            appendFurnitureMesh(furniture, bucket);
-            if (!furnitureColors.contains(key)) {
-                furnitureColors.insert(key,
-                                       furnitureColorFor(asset.material, key));
+    if (waiting.isEmpty()) {
+        return;
+    }
+
+    for (FurnitureItem *furniture : qAsConst(waiting)) {
+        updateFurnitureInstance(furniture);
+    }
+    m_geometryDirty = true;
+    update();
+}
+
+void View3DWidget::startMeshBuild()
+{
+    // Bumping the generation tells an in-flight build that it is stale.
+    const quint64 generation = m_meshGeneration.fetchAndAddRelaxed(1) + 1;
+    if (m_meshWatcher.isRunning()) {
+        m_meshBuildQueued = true;
+        return;
+    }
+    m_meshBuildQueued = false;
+
+    SceneMesher::Request request;
+    request.generation = generation;
+    request.walls = m_wallSnapshots;
+
+    // Diff the walls touched since the last applied build against the chunks
+    // already applied, not against in-flight work.
+    for (const WallItem *key : qAsConst(m_staleWalls)) {
+        const SceneMesher::WallSnapshot &wall = m_wallSnapshots.at(m_snapshotSlots.value(key));
+        const auto it = m_chunks.constFind(key);
+        if (it != m_chunks.constEnd()) {
+            if (it->mesh.revisions == wall.revisions) {
+                continue;
             }
+            request.touchedJunctions << it->mesh.start << it->mesh.end;
         }
+        request.touchedJunctions << wall.start << wall.end;
+        request.changed.insert(key);
     }
 
-    m_ranges.wallStart = 0;
-    m_ranges.wallCount = m_wallVertices.size();
-    m_ranges.doorSingleStart = m_ranges.wallStart + m_ranges.wallCount;
-    m_ranges.doorSingleCount = m_doorSingleVertices.size();
-    m_ranges.doorDoubleStart =
-        m_ranges.doorSingleStart + m_ranges.doorSingleCount;
-    m_ranges.doorDoubleCount = m_doorDoubleVertices.size();
-    m_ranges.doorSlidingStart =
-        m_ranges.doorDoubleStart + m_ranges.doorDoubleCount;
-    m_ranges.doorSlidingCount = m_doorSlidingVertices.size();
-    m_ranges.openingStart =
-        m_ranges.doorSlidingStart + m_ranges.doorSlidingCount;
-    m_ranges.openingCount = m_openingVertices.size();
-    m_ranges.glassCasementStart = m_ranges.openingStart + m_ranges.openingCount;
-    m_ranges.glassCasementCount = m_glassCasementVertices.size();
-    m_ranges.glassSlidingStart =
-        m_ranges.glassCasementStart + m_ranges.glassCasementCount;
-    m_ranges.glassSlidingCount = m_glassSlidingVertices.size();
-    m_ranges.glassBayStart =
-        m_ranges.glassSlidingStart + m_ranges.glassSlidingCount;
-    m_ranges.glassBayCount = m_glassBayVertices.size();
-    const int nonFurnitureCount = m_ranges.glassBayStart + m_ranges.glassBayCount;
-    int furnitureVertexTotal = 0;
-    for (auto it = furnitureBuckets.cbegin(); it != furnitureBuckets.cend(); ++it) {
-        furnitureVertexTotal += it.value().size();
-    }
-
-    m_vertices.reserve(nonFurnitureCount + furnitureVertexTotal);
-    m_vertices << m_wallVertices
-               << m_doorSingleVertices
-               << m_doorDoubleVertices
-               << m_doorSlidingVertices
-               << m_openingVertices
-               << m_glassCasementVertices
-               << m_glassSlidingVertices
-               << m_glassBayVertices;
-
-    int cursor = nonFurnitureCount;
-    for (auto it = furnitureBuckets.cbegin(); it != furnitureBuckets.cend(); ++it) {
-        const QVector<QVector3D> &bucket = it.value();
-        if (bucket.isEmpty()) {
+    bool removed = false;
+    for (const WallItem *key : qAsConst(m_removedWalls)) {
+        const auto it = m_chunks.constFind(key);
+        if (it != m_chunks.constEnd()) {
+            request.touchedJunctions << it->mesh.start << it->mesh.end;
+            removed = true;
+        }
+    }
+
+    if (request.changed.isEmpty() && !removed) {
+        m_staleWalls.clear();
+        m_removedWalls.clear();
+        return;
+    }
+
+    const QAtomicInteger<quint64> *latestGeneration = &m_meshGeneration;
+    m_meshWatcher.setFuture(QtConcurrent::run([request, latestGeneration]() {
+        return SceneMesher::build(request, latestGeneration);
+    }));
+}
+
+void View3DWidget::applyMeshBuild(const SceneMesher::Result &result)
+{
+    // Only the latest build is applied, so everything stale is now current.
+    m_staleWalls.clear();
+    m_removedWalls.clear();
+
+    for (auto it = m_chunks.begin(); it != m_chunks.end();) {
+        if (result.alive.contains(it.key())) {
+            ++it;
             continue;
         }
-        ColorRange range;
-        range.start = cursor;
-        range.count = bucket.size();
-        range.color = furnitureColors.value(it.key(),
-                                            QVector3D(0.60f, 0.60f, 0.60f));
-        range.alpha = 1.0f;
-        m_furnitureRanges.append(range);
-        m_vertices << bucket;
-        cursor += range.count;
+        m_vboWaste += it->slotCapacity;
+        m_pendingUploads.remove(it.key());
+        it = m_chunks.erase(it);
+        m_chunksRemoved = true;
+    }
+
+    for (auto it = result.meshes.cbegin(); it != result.meshes.cend(); ++it) {
+        m_chunks[it.key()].mesh = it.value();
+        m_pendingUploads.insert(it.key());
+    }
+
+    m_geometryDirty = true;
+    update();
+}
+
+void View3DWidget::uploadGeometry()
+{
+    m_geometryDirty = false;
+    syncFurniture();
+
+    if (m_pendingUploads.isEmpty() && !m_chunksRemoved && m_vboCapacity > 0) {
+        return;
     }
 
-    m_vertexCount = cursor;
+    // Rewrite only the rebuilt slots unless the buffer is full or too fragmented.
+    bool needRelayout = m_vboCapacity == 0
+        || m_vboWaste > qMax(kMinBufferVertices, m_vboUsed / 2);
+    for (const WallItem *key : qAsConst(m_pendingUploads)) {
+        if (needRelayout) {
+            break;
+        }
+        MeshChunk &chunk = m_chunks[key];
+        needRelayout = !placeChunk(chunk)
+            || (m_packedVertices
+                && chunk.vertexCount() > 0
+                && !m_quantization.contains(chunk.mesh.minBounds, chunk.mesh.maxBounds));
+    }
 
     QOpenGLVertexArrayObject::Binder vaoBinder(&m_vao);
     m_vbo.bind();
-    if (m_vertexCount > 0) {
-        m_vbo.allocate(m_vertices.constData(),
-                       m_vertexCount * static_cast<int>(sizeof(QVector3D)));
+    if (needRelayout) {
+        relayoutBuffer();
     } else {
-        m_vbo.allocate(nullptr, 0);
+        for (const WallItem *key : qAsConst(m_pendingUploads)) {
+            uploadChunk(m_chunks[key]);
+        }
     }
     m_vbo.release();
-    m_geometryDirty = false;
+
+    m_pendingUploads.clear();
+    m_chunksRemoved = false;
+    rebuildDrawBatches();
 }
 
-void View3DWidget::appendWallMesh(const WallItem *wall,
-                                  const QList<WallItem *> &allWalls,
-                                  QVector<QVector3D> &vertices)
+bool View3DWidget::placeChunk(MeshChunk &chunk)
 {
-    if (!wall) {
-        return;
+    const int needed = chunk.vertexCount();
+    if (chunk.slotStart >= 0 && needed <= chunk.slotCapacity) {
+        return true;
     }
 
-    const QLineF line(wall->startPos(), wall->endPos());
-    const qreal totalLength = line.length();
-    if (totalLength < 0.1) {
-        return;
+    if (chunk.slotStart >= 0) {
+        m_vboWaste += chunk.slotCapacity;
+        chunk.slotStart = -1;
+        chunk.slotCapacity = 0;
+    }
+    if (needed == 0) {
+        return true;
     }
 
-    const qreal wallHeight = wall->height();
-    QPointF perpOffset = wallPerpOffset(wall);
-    
-    // Find adjacent walls at each endpoint
-    const WallItem *adjStart = findAdjacentWall(wall->startPos(), wall, allWalls);
-    const WallItem *adjEnd = findAdjacentWall(wall->endPos(), wall, allWalls);
-    
-    // Calculate corner points - use miter if adjacent wall exists
-    QPointF startCorner1, startCorner2;
-    if (adjStart) {
-        calculateMiterCorners(wall, true, adjStart, startCorner1, startCorner2);
-    } else {
-        startCorner1 = wall->startPos() + perpOffset;
-        startCorner2 = wall->startPos() - perpOffset;
+    const int capacity = slotCapacityFor(needed);
+    if (m_vboUsed + capacity > m_vboCapacity) {
+        return false;
     }
-    
-    QPointF endCorner1, endCorner2;
-    if (adjEnd) {
-        calculateMiterCorners(wall, false, adjEnd, endCorner1, endCorner2);
-    } else {
-        endCorner1 = wall->endPos() + perpOffset;
-        endCorner2 = wall->endPos() - perpOffset;
-    }
-    
-    QList<OpeningItem *> openings = wall->openings();
-    if (openings.isEmpty()) {
-        // No openings - render full wall with mitered corners
-        appendBoxFromQuad(startCorner1, endCorner1, endCorner2, startCorner2, 
-                          0.0, wallHeight, vertices);
+    chunk.slotStart = m_vboUsed;
+    chunk.slotCapacity = capacity;
+    m_vboUsed += capacity;
+    return true;
+}
+
+void View3DWidget::uploadChunk(const MeshChunk &chunk)
+{
+    if (chunk.slotStart < 0) {
         return;
     }
 
-
-    // For walls with openings, use simple perpendicular offsets for all segments
-    std::sort(openings.begin(), openings.end(),
-              [](OpeningItem *a, OpeningItem *b) {
-                  if (!a || !b) {
-                      return a && !b;
-                  }
-                  return a->distanceFromStart() < b->distanceFromStart();
-              });
-
-    const QPointF wallStart = wall->startPos();
-    const QPointF wallEnd = wall->endPos();
-    const QPointF dir = (wallEnd - wallStart) / totalLength;
-
-    qreal cursor = 0.0;
-    bool isFirstSegment = true;
-    
-    for (OpeningItem *opening : openings) {
-        if (!opening) {
-            continue;
-        }
-        qreal start = qBound(0.0, opening->distanceFromStart(), totalLength);
-        qreal end = qBound(0.0, start + opening->width(), totalLength);
-        
-        if (start > cursor) {
-            // Wall segment before this opening
-            const QPointF segStart = wallStart + dir * cursor;
-            const QPointF segEnd = wallStart + dir * start;
-            
-            QPointF p1, p4;
-            if (isFirstSegment && cursor < 0.1) {
-                // First segment - use start corners
-                p1 = startCorner1;
-                p4 = startCorner2;
-            } else {
-                p1 = segStart + perpOffset;
-                p4 = segStart - perpOffset;
-            }
-            
-            QPointF p2 = segEnd + perpOffset;
-            QPointF p3 = segEnd - perpOffset;
-            
-            appendBoxFromQuad(p1, p2, p3, p4, 0.0, wallHeight, vertices);
-            isFirstSegment = false;
-        }
-        
-        cursor = qMax(cursor, end);
-        
-        // Handle opening geometry (doors/windows)
-        if (opening->kind() == OpeningItem::Kind::Window) {
-            switch (opening->style()) {
-            case OpeningItem::Style::SlidingWindow:
-                appendOpeningMesh(wall, opening, m_openingVertices,
-                                  m_glassSlidingVertices);
-                break;
-            case OpeningItem::Style::BayWindow:
-                appendOpeningMesh(wall, opening, m_openingVertices,
-                                  m_glassBayVertices);
-                break;
-            case OpeningItem::Style::CasementWindow:
-            default:
-                appendOpeningMesh(wall, opening, m_openingVertices,
-                                  m_glassCasementVertices);
-                break;
+    // The category doubles as the material index.
+    const int stride = vertexStride();
+    int offset = chunk.slotStart;
+    QVector<PackedMeshVertex> packed;
+    QVector<FloatMeshVertex> full;
+    for (int category = 0; category < SceneMesher::CategoryCount; ++category) {
+        const QVector<MeshVertex> &part = chunk.mesh.parts[category];
+        const int count = static_cast<int>(part.size());
+        if (count > 0 && m_packedVertices) {
+            packed.resize(count);
+            for (int i = 0; i < count; ++i) {
+                packed[i] = m_quantization.pack(part.at(i), static_cast<qint16>(category));
             }
-        } else {
-            switch (opening->style()) {
-            case OpeningItem::Style::SlidingDoor:
-                appendOpeningMesh(wall, opening, m_doorSlidingVertices,
-                                  m_glassCasementVertices);
-                break;
-            case OpeningItem::Style::DoubleDoor:
-                appendOpeningMesh(wall, opening, m_doorDoubleVertices,
-                                  m_glassCasementVertices);
-                break;
-            case OpeningItem::Style::SingleDoor:
-            default:
-                appendOpeningMesh(wall, opening, m_doorSingleVertices,
-                                  m_glassCasementVertices);
-                break;
+            m_vbo.write(offset * stride, packed.constData(), count * stride);
+        } else if (count > 0) {
+            full.resize(count);
+            for (int i = 0; i < count; ++i) {
+                full[i] = FloatMeshVertex(part.at(i), category);
             }
+            m_vbo.write(offset * stride, full.constData(), count * stride);
         }
+        m_uploadedVertexBytes += qint64(count) * stride;
+        offset += count;
+    }
+}
 
-        // Wall segments above/below openings
-        qreal openingBase =
-            opening->kind() == OpeningItem::Kind::Door
-                ? 0.0
-                : opening->sillHeight();
-        openingBase = qBound(0.0, openingBase, wallHeight);
-        qreal openingTop = openingBase + opening->height();
-        openingTop = qBound(openingBase, openingTop, wallHeight);
-
-        if (openingBase > 0.1) {
-            appendWallSegment(wall, start, end, 0.0, openingBase, vertices);
+void View3DWidget::chooseVertexFormat()
+{
+    bool empty = true;
+    QVector3D minBounds;
+    QVector3D maxBounds;
+    for (const MeshChunk &chunk : qAsConst(m_chunks)) {
+        if (chunk.vertexCount() == 0) {
+            continue;
         }
-        if (openingTop + 0.1 < wallHeight) {
-            appendWallSegment(wall, start, end,
-                              openingTop,
-                              wallHeight - openingTop,
-                              vertices);
+        if (empty) {
+            minBounds = chunk.mesh.minBounds;
+            maxBounds = chunk.mesh.maxBounds;
+            empty = false;
+            continue;
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            minBounds[axis] = qMin(minBounds[axis], chunk.mesh.minBounds[axis]);
+            maxBounds[axis] = qMax(maxBounds[axis], chunk.mesh.maxBounds[axis]);
         }
     }
 
-    // Final segment after last opening
-    if (cursor < totalLength) {
-        const QPointF segStart = wallStart + dir * cursor;
-        
-        QPointF p1, p4;
-        if (isFirstSegment && cursor < 0.1) {
-            p1 = startCorner1;
-            p4 = startCorner2;
-        } else {
-            p1 = segStart + perpOffset;
-            p4 = segStart - perpOffset;
-        }
-        
-        // Last segment - use end corners
-        appendBoxFromQuad(p1, endCorner1, endCorner2, p4, 0.0, wallHeight, vertices);
+    const QVector3D margin(kQuantizationMargin, kQuantizationMargin, kQuantizationMargin);
+    m_quantization = VertexQuantization::forBounds(minBounds - margin, maxBounds + margin);
+    m_packedVertices = m_quantization.step <= kMaxQuantizationStep;
+    if (!m_packedVertices) {
+        m_quantization = VertexQuantization();
     }
+    setVertexLayout(m_packedVertices);
 }
 
+void View3DWidget::relayoutBuffer()
+{
+    int required = 0;
+    for (const MeshChunk &chunk : qAsConst(m_chunks)) {
+        required += slotCapacityFor(chunk.vertexCount());
+    }
 
+    chooseVertexFormat();
+    m_vboCapacity = qMax(kMinBufferVertices, required + required / 2);
+    m_vboUsed = 0;
+    m_vboWaste = 0;
+    m_vbo.allocate(m_vboCapacity * vertexStride());
+
+    for (MeshChunk &chunk : m_chunks) {
+        chunk.slotStart = -1;
+        chunk.slotCapacity = 0;
+        placeChunk(chunk);
+        uploadChunk(chunk);
+    }
+}
 
-void View3DWidget::appendWallSegment(const WallItem *wall,
-                                     qreal startDistance,
-                                     qreal endDistance,
-                                     qreal baseY,
-                                     qreal height,
-                                     QVector<QVector3D> &vertices) const
+void View3DWidget::rebuildDrawBatches()
 {
-    if (!wall || endDistance - startDistance < 0.1 || height < 0.1) {
-        return;
-    }
+    m_chunkRanges.clear();
+    m_vertexCount = 0;
 
-    const QLineF line(wall->startPos(), wall->endPos());
-    const qreal length = line.length();
-    if (length < 0.1) {
-        return;
+    QVector<BoundingBox> boxes;
+    for (const MeshChunk &chunk : qAsConst(m_chunks)) {
+        if (chunk.slotStart < 0) {
+            continue;
+        }
+
+        ChunkRange range;
+        range.first = chunk.slotStart;
+        for (int category = 0; category < SceneMesher::CategoryCount; ++category) {
+            range.counts[category] = static_cast<GLsizei>(chunk.mesh.parts[category].size());
+            m_vertexCount += range.counts[category];
+        }
+        m_chunkRanges.append(range);
+        boxes.append(BoundingBox(chunk.mesh.minBounds, chunk.mesh.maxBounds));
     }
+    m_chunkHierarchy.build(boxes);
+}
 
-    const QPointF dir = (line.p2() - line.p1()) / length;
-    const QPointF segStart = line.p1() + dir * startDistance;
-    const QPointF segEnd = line.p1() + dir * endDistance;
+void View3DWidget::cullWalls(const ViewFrustum &frustum)
+{
+    for (DrawBatch &batch : m_passes) {
+        batch.firsts.clear();
+        batch.counts.clear();
+    }
 
-    QLineF segLine(segStart, segEnd);
-    QLineF normal = segLine.normalVector();
-    normal.setLength(wall->thickness() / 2.0);
-    const QPointF offset = normal.p2() - normal.p1();
+    QVector<int> visible;
+    m_chunkHierarchy.collectVisible(frustum, &visible);
+    int drawnVertices = 0;
+    for (int index : qAsConst(visible)) {
+        const ChunkRange &range = m_chunkRanges.at(index);
+        GLint offset = range.first;
+        for (int category = 0; category < SceneMesher::CategoryCount; ++category) {
+            const GLsizei count = range.counts[category];
+            if (count == 0) {
+                continue;
+            }
+            // A part right behind the pass's last range extends it. With
+            // opaque categories first, a chunk adds one range per pass.
+            DrawBatch &batch = m_passes[isTransparent(category) ? Pass_Transparent : Pass_Opaque];
+            if (!batch.firsts.isEmpty() && batch.firsts.last() + batch.counts.last() == offset) {
+                batch.counts.last() += count;
+            } else {
+                batch.firsts.append(offset);
+                batch.counts.append(count);
+            }
+            drawnVertices += count;
+            offset += count;
+        }
+    }
 
-    const QPointF p1 = segStart + offset;
-    const QPointF p2 = segEnd + offset;
-    const QPointF p3 = segEnd - offset;
-    const QPointF p4 = segStart - offset;
+    m_cullStatistics.drawnWalls = static_cast<int>(visible.size());
+    m_cullStatistics.culledWalls = static_cast<int>(m_chunkRanges.size() - visible.size());
+    m_cullStatistics.drawnTriangles += drawnVertices / 3;
+    m_cullStatistics.culledTriangles += (m_vertexCount - drawnVertices) / 3;
+}
 
-    appendBoxFromQuad(p1, p2, p3, p4, baseY, height, vertices);
+void View3DWidget::releaseChunks()
+{
+    m_chunks.clear();
+    m_pendingUploads.clear();
+    m_chunksRemoved = true;
+    for (DrawBatch &batch : m_passes) {
+        batch.firsts.clear();
+        batch.counts.clear();
+    }
+    m_chunkRanges.clear();
+    m_chunkHierarchy.clear();
+    m_vertexCount = 0;
+    m_vboUsed = 0;
+    m_vboWaste = 0;
 }
 
-void View3DWidget::appendOpeningMesh(const WallItem *wall,
-                                     const OpeningItem *opening,
-                                     QVector<QVector3D> &solidVertices,
-                                     QVector<QVector3D> &glassVertices) const
+void View3DWidget::syncFurniture()
 {
-    if (!wall || !opening) {
+    if (m_touchedModels.isEmpty()) {
         return;
     }
+    m_furnitureHierarchyDirty = true;
+    m_touchedModels.remove(nullptr);
+
+    // Regroup the instances of every model that gained, lost or moved one.
+    QHash<const MeshData *, QVector<const FurnitureInstance *>> instancesByModel;
+    for (const FurnitureInstance &instance : qAsConst(m_furniture)) {
+        if (m_touchedModels.contains(instance.mesh.data())) {
+            instancesByModel[instance.mesh.data()].append(&instance);
+        }
+    }
 
-    const QLineF line(wall->startPos(), wall->endPos());
-    const qreal length = line.length();
-    if (length < 0.1) {
-        return;
+    for (const MeshData *model : qAsConst(m_touchedModels)) {
+        ModelBatch *batch = m_models.value(model, nullptr);
+        const QVector<const FurnitureInstance *> instances = instancesByModel.value(model);
+        if (instances.isEmpty()) {
+            m_models.remove(model);
+            delete batch;
+            continue;
+        }
+        if (!batch) {
+            batch = createModelBatch(instances.first()->mesh);
+            m_models.insert(model, batch);
+        }
+        batch->instancesDirty = true;
     }
+    m_touchedModels.clear();
+}
 
-    qreal start = qBound(0.0, opening->distanceFromStart(), length);
-    qreal end = qBound(0.0, start + opening->width(), length);
-    if (end - start < 0.1) {
-        return;
+void View3DWidget::rebuildFurnitureHierarchy()
+{
+    m_furnitureHierarchyDirty = false;
+    m_furnitureKeys.clear();
+    m_furnitureBoxes.clear();
+    m_furnitureTriangles = 0;
+
+    for (auto it = m_furniture.cbegin(); it != m_furniture.cend(); ++it) {
+        const FurnitureInstance &instance = it.value();
+        if (!instance.mesh) {
+            continue;
+        }
+        const QVector3D &lo = instance.mesh->minBounds;
+        const QVector3D &hi = instance.mesh->maxBounds;
+        BoundingBox box;
+        for (int corner = 0; corner < 8; ++corner) {
+            box.expand(instance.transform.map(QVector3D(corner & 1 ? hi.x() : lo.x(),
+                                                        corner & 2 ? hi.y() : lo.y(),
+                                                        corner & 4 ? hi.z() : lo.z())));
+        }
+        m_furnitureKeys.append(it.key());
+        m_furnitureBoxes.append(box);
+        m_furnitureTriangles += instance.mesh->levels.first().indexCount / 3;
     }
+    m_furnitureHierarchy.build(m_furnitureBoxes);
+}
 
-    const QPointF wallDir = (line.p2() - line.p1()) / length;
-    const QPointF segStart = line.p1() + wallDir * start;
-    const QPointF segEnd = line.p1() + wallDir * end;
-
-    QLineF segLine(segStart, segEnd);
-    const qreal baseHeight =
-        opening->kind() == OpeningItem::Kind::Door ? 0.0 : opening->sillHeight();
-
-    const auto buildQuadOnLine = [](const QLineF &line,
-                                    const QPointF &a,
-                                    const QPointF &b,
-                                    qreal thickness,
-                                    const QPointF &shift,
-                                    QPointF &o1,
-                                    QPointF &o2,
-                                    QPointF &o3,
-                                    QPointF &o4) {
-        QLineF normal = line.normalVector();
-        normal.setLength(thickness / 2.0);
-        const QPointF offset = normal.p2() - normal.p1();
-        o1 = a + offset + shift;
-        o2 = b + offset + shift;
-        o3 = b - offset + shift;
-        o4 = a - offset + shift;
-    };
+void View3DWidget::cullFurniture(const ViewFrustum &frustum, const QVector3D &eye)
+{
+    if (m_furnitureHierarchyDirty) {
+        rebuildFurnitureHierarchy();
+    }
 
-    if (opening->kind() == OpeningItem::Kind::Door) {
-        const qreal panelThickness = qMin(36.0, wall->thickness() * 0.6);
-        const qreal openOffset = qMax(12.0, wall->thickness() * 0.6);
-        QLineF doorNormal = segLine.normalVector();
-        doorNormal.setLength(openOffset);
-        QVector2D outwardDir(doorNormal.p2() - doorNormal.p1());
-        if (outwardDir.lengthSquared() > 0.0001f) {
-            outwardDir.normalize();
+    // Projected radius in pixels of a sphere of radius 1 at distance 1.
+    const float pixelsPerRadius = m_projection(1, 1) * height() / 2.0f;
+
+    QVector<int> visible;
+    m_furnitureHierarchy.collectVisible(frustum, &visible);
+    QHash<const MeshData *, QVector<QVector<const FurnitureInstance *>>> instancesByModel;
+    for (int index : qAsConst(visible)) {
+        const BoundingBox &box = m_furnitureBoxes.at(index);
+        const float radius = (box.max - box.min).length() / 2.0f;
+        const float distance = qMax((box.centre() - eye).length(), 1.0f);
+        const float pixels = radius / distance * pixelsPerRadius;
+        if (pixels < kMinFurniturePixels) {
+            continue;
         }
-        QPointF outwardUnit(outwardDir.x(), outwardDir.y());
-        QPointF outward = outwardUnit * openOffset;
-        if (opening->isFlipped()) {
-            outward = -outward;
+        // Changes since the hierarchy was built wait for the next one.
+        const auto it = m_furniture.constFind(m_furnitureKeys.at(index));
+        if (it == m_furniture.constEnd() || !it->mesh || !m_models.contains(it->mesh.data())) {
+            continue;
         }
 
-        if (opening->style() == OpeningItem::Style::SlidingDoor) {
-            const qreal segmentLength = QLineF(segStart, segEnd).length();
-            if (segmentLength < 0.1) {
-                return;
-            }
-            const qreal panelWidth = segmentLength * 0.62;
-            const QPointF segDir = (segEnd - segStart) / segmentLength;
-            const QPointF leftStart = segStart;
-            const QPointF leftEnd = segStart + segDir * panelWidth;
-            const QPointF rightEnd = segEnd;
-            const QPointF rightStart = segEnd - segDir * panelWidth;
-            const qreal layerDepth = qMax(4.0, panelThickness * 0.25);
-            QPointF layerOffset = outwardUnit * layerDepth;
-            if (opening->isFlipped()) {
-                layerOffset = -layerOffset;
-            }
+        const int levelCount = static_cast<int>(it->mesh->levels.size());
+        int level = 0;
+        while (level + 1 < levelCount && level < int(std::size(kLevelPixels))
+               && pixels < kLevelPixels[level]) {
+            ++level;
+        }
+        QVector<QVector<const FurnitureInstance *>> &levels = instancesByModel[it->mesh.data()];
+        levels.resize(levelCount);
+        levels[level].append(&it.value());
+    }
 
-            QPointF l1, l2, l3, l4;
-            buildQuadOnLine(segLine,
-                            leftStart,
-                            leftEnd,
-                            panelThickness,
-                            layerOffset,
-                            l1, l2, l3, l4);
-            appendBoxFromQuad(l1, l2, l3, l4, baseHeight, opening->height(),
-                              solidVertices);
-
-            QPointF r1, r2, r3, r4;
-            buildQuadOnLine(segLine,
-                            rightStart,
-                            rightEnd,
-                            panelThickness,
-                            -layerOffset,
-                            r1, r2, r3, r4);
-            appendBoxFromQuad(r1, r2, r3, r4, baseHeight, opening->height(),
-                              solidVertices);
-        } else if (opening->style() == OpeningItem::Style::DoubleDoor) {
-            const qreal segmentLength = QLineF(segStart, segEnd).length();
-            if (segmentLength < 0.1) {
-                return;
+    // Instance buffers are only rewritten when what a model shows changes.
+    qint64 fullTriangles = 0;
+    for (auto it = m_models.cbegin(); it != m_models.cend(); ++it) {
+        ModelBatch *batch = it.value();
+        const QVector<QVector<const FurnitureInstance *>> levels = instancesByModel.value(it.key());
+        QVector<const FurnitureInstance *> instances;
+        QVector<const QGraphicsItem *> items;
+        QVector<int> levelInstances;
+        for (const QVector<const FurnitureInstance *> &level : levels) {
+            for (const FurnitureInstance *instance : level) {
+                instances.append(instance);
+                items.append(instance->item);
             }
-            const QPointF segDir = (segEnd - segStart) / segmentLength;
-            const QPointF center = (segStart + segEnd) * 0.5;
-            const qreal gap = qMax(6.0, panelThickness * 0.4);
-            const QPointF leftEnd = center - segDir * gap * 0.5;
-            const QPointF rightStart = center + segDir * gap * 0.5;
-
-            const QLineF leftLine(segStart, leftEnd + outward);
-            const QLineF rightLine(segEnd, rightStart + outward);
-
-            QPointF l1, l2, l3, l4;
-            buildQuadOnLine(leftLine,
-                            segStart,
-                            leftEnd + outward,
-                            panelThickness,
-                            QPointF(),
-                            l1, l2, l3, l4);
-            appendBoxFromQuad(l1, l2, l3, l4, baseHeight, opening->height(),
-                              solidVertices);
-
-            QPointF r1, r2, r3, r4;
-            buildQuadOnLine(rightLine,
-                            segEnd,
-                            rightStart + outward,
-                            panelThickness,
-                            QPointF(),
-                            r1, r2, r3, r4);
-            appendBoxFromQuad(r1, r2, r3, r4, baseHeight, opening->height(),
-                              solidVertices);
-        } else {
-            const QLineF doorLine(segStart, segEnd + outward);
-            QPointF p1, p2, p3, p4;
-            buildQuadOnLine(doorLine,
-                            segStart,
-                            segEnd + outward,
-                            panelThickness,
-                            QPointF(),
-                            p1, p2, p3, p4);
-            appendBoxFromQuad(p1, p2, p3, p4, baseHeight, opening->height(),
-                              solidVertices);
+            levelInstances.append(static_cast<int>(level.size()));
+        }
+        if (batch->instancesDirty || items != batch->drawnItems
+            || levelInstances != batch->levelInstances) {
+            uploadInstances(batch, instances);
+            batch->drawnItems = items;
+            batch->levelInstances = levelInstances;
+            batch->instancesDirty = false;
+        }
+
+        const QVector<MeshData::Level> &ranges = batch->mesh->levels;
+        for (int level = 0; level < levelInstances.size(); ++level) {
+            const int count = levelInstances.at(level);
+            m_cullStatistics.drawnTriangles += qint64(ranges.at(level).indexCount / 3) * count;
+            m_cullStatistics.reducedTriangles +=
+                qint64(ranges.first().indexCount - ranges.at(level).indexCount) / 3 * count;
+            fullTriangles += qint64(ranges.first().indexCount / 3) * count;
+            m_cullStatistics.drawnFurniture += count;
         }
-        return;
     }
 
-    const qreal frameThickness = qMin(24.0, wall->thickness() * 0.5);
-    QLineF frameNormal = segLine.normalVector();
-    frameNormal.setLength(frameThickness / 2.0);
-    const QPointF frameOffset = frameNormal.p2() - frameNormal.p1();
-    QVector2D outwardVec(frameOffset);
-    if (outwardVec.lengthSquared() > 0.0001f) {
-        outwardVec.normalize();
-    }
-    const QPointF outward(outwardVec.x(), outwardVec.y());
-
-    QPointF f1, f2, f3, f4;
-    QPointF glassShift;
-    qreal glassThickness = qMax(3.0, frameThickness * 0.25);
-
-    if (opening->style() == OpeningItem::Style::BayWindow) {
-        const qreal bayDepth = qMax(25.0, wall->thickness() * 1.2);
-        const qreal bayThickness = frameThickness + bayDepth;
-        const QPointF bayShift = outward * (bayDepth * 0.5);
-        buildQuadOnLine(segLine, segStart, segEnd, bayThickness, bayShift, f1,
-                        f2, f3, f4);
-        appendBoxFromQuad(f1, f2, f3, f4, baseHeight, opening->height(),
-                          solidVertices);
-        glassShift = outward * (bayDepth * 0.75);
+    m_cullStatistics.culledFurniture = static_cast<int>(m_furnitureKeys.size())
+        - m_cullStatistics.drawnFurniture;
+    m_cullStatistics.culledTriangles += m_furnitureTriangles - fullTriangles;
+}
+
+View3DWidget::ModelBatch *View3DWidget::createModelBatch(const QSharedPointer<MeshData> &mesh)
+{
+    auto *batch = new ModelBatch;
+    batch->mesh = mesh;
+
+    batch->vao.create();
+    QOpenGLVertexArrayObject::Binder vaoBinder(&batch->vao);
+
+    // A model always fits the grid over its own bounds finely enough.
+    batch->quantization = VertexQuantization::forBounds(mesh->minBounds, mesh->maxBounds);
+    QVector<PackedMeshVertex> packed;
+    packed.reserve(mesh->vertices.size());
+    for (const MeshVertex &vertex : mesh->vertices) {
+        packed.append(batch->quantization.pack(vertex));
+    }
+
+    batch->vertexBuffer.create();
+    batch->vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    batch->vertexBuffer.bind();
+    batch->vertexBuffer.allocate(packed.constData(),
+                                 static_cast<int>(packed.size() * sizeof(PackedMeshVertex)));
+    m_uploadedVertexBytes += packed.size() * qint64(sizeof(PackedMeshVertex));
+    setVertexLayout(true);
+
+    batch->indexBuffer.create();
+    batch->indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    batch->indexBuffer.bind();
+    if (!mesh->indices16.isEmpty()) {
+        batch->indexType = GL_UNSIGNED_SHORT;
+        batch->indexBuffer.allocate(mesh->indices16.constData(),
+                                    static_cast<int>(mesh->indices16.size() * sizeof(quint16)));
     } else {
-        buildQuadOnLine(segLine, segStart, segEnd, frameThickness, QPointF(),
-                        f1, f2, f3, f4);
-        appendBoxFromQuad(f1, f2, f3, f4, baseHeight, opening->height(),
-                          solidVertices);
-        glassShift = QPointF();
+        batch->indexType = GL_UNSIGNED_INT;
+        batch->indexBuffer.allocate(mesh->indices32.constData(),
+                                    static_cast<int>(mesh->indices32.size() * sizeof(quint32)));
     }
 
-    const qreal segmentLength = QLineF(segStart, segEnd).length();
-    if (segmentLength < 0.1) {
-        return;
+    batch->instanceBuffer.create();
+    batch->instanceBuffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    batch->instanceBuffer.bind();
+    setInstanceLayout(0);
+
+    return batch;
+}
+
+// Per-instance attributes of the bound vertex array, read from the bound
+// array buffer from firstInstance on: four model matrix columns, the colour,
+// then three normal matrix columns.
+void View3DWidget::setInstanceLayout(int firstInstance)
+{
+    const GLsizei stride = kInstanceFloats * sizeof(float);
+    const qintptr base = qintptr(firstInstance) * stride;
+    for (GLuint column = 0; column < 4; ++column) {
+        const GLuint location = 2 + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride,
+                              reinterpret_cast<const void *>(base + column * 4 * sizeof(float)));
+        glVertexAttribDivisor(location, 1);
     }
-    const qreal insetAlong = qMax(4.0, segmentLength * 0.08);
-    const QPointF segDir = (segEnd - segStart) / segmentLength;
-    const qreal safeInset = qMin(insetAlong, segmentLength * 0.25);
-
-    if (opening->style() == OpeningItem::Style::SlidingWindow) {
-        const qreal panelWidth = segmentLength * 0.55;
-        const QPointF leftStart = segStart;
-        const QPointF leftEnd = segStart + segDir * panelWidth;
-        const QPointF rightEnd = segEnd;
-        const QPointF rightStart = segEnd - segDir * panelWidth;
-        const qreal layerDepth = qMax(8.0, frameThickness * 0.8);
-        const QPointF layerShift = outward * layerDepth;
-
-        QPointF l1, l2, l3, l4;
-        buildQuadOnLine(segLine,
-                        leftStart + segDir * safeInset,
-                        leftEnd - segDir * safeInset,
-                        glassThickness,
-                        glassShift + layerShift,
-                        l1, l2, l3, l4);
-        appendBoxFromQuad(l1, l2, l3, l4, baseHeight, opening->height(),
-                          glassVertices);
-
-        QPointF r1, r2, r3, r4;
-        buildQuadOnLine(segLine,
-                        rightStart + segDir * safeInset,
-                        rightEnd - segDir * safeInset,
-                        glassThickness,
-                        glassShift - layerShift,
-                        r1, r2, r3, r4);
-        appendBoxFromQuad(r1, r2, r3, r4, baseHeight, opening->height(),
-                          glassVertices);
-        return;
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<const void *>(base + 16 * sizeof(float)));
+    glVertexAttribDivisor(6, 1);
+    for (GLuint column = 0; column < 3; ++column) {
+        const GLuint location = 8 + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride,
+                              reinterpret_cast<const void *>(base + (19 + column * 3) * sizeof(float)));
+        glVertexAttribDivisor(location, 1);
     }
+}
 
-    QPointF g1, g2, g3, g4;
-    if (opening->style() == OpeningItem::Style::CasementWindow) {
-        const qreal hingeOffset = qMax(2.0, frameThickness * 0.2);
-        const qreal openOffset = qMax(10.0, frameThickness * 1.1);
-        const QPointF gStart =
-            segStart + segDir * safeInset + outward * hingeOffset;
-        const QPointF gEnd =
-            segEnd - segDir * safeInset + outward * openOffset;
-        const QLineF glassLine(gStart, gEnd);
-        buildQuadOnLine(glassLine,
-                        gStart,
-                        gEnd,
-                        glassThickness,
-                        glassShift,
-                        g1, g2, g3, g4);
-    } else {
-        buildQuadOnLine(segLine,
-                        segStart + segDir * safeInset,
-                        segEnd - segDir * safeInset,
-                        glassThickness,
-                        glassShift,
-                        g1, g2, g3, g4);
-    }
-    appendBoxFromQuad(g1, g2, g3, g4, baseHeight, opening->height(),
-                      glassVertices);
-
-    if (opening->style() == OpeningItem::Style::CasementWindow) {
-        const qreal barWidth = qMax(4.0, opening->width() * 0.08);
-        const qreal barStartOffset = opening->width() * 0.22;
-        const QPointF barStart = segStart + segDir * barStartOffset;
-        const QPointF barEnd = barStart + segDir * barWidth;
-        QPointF b1, b2, b3, b4;
-        buildQuadOnLine(segLine,
-                        barStart,
-                        barEnd,
-                        frameThickness * 0.35,
-                        QPointF(),
-                        b1, b2, b3, b4);
-        appendBoxFromQuad(b1, b2, b3, b4, baseHeight, opening->height(),
-                          solidVertices);
+void View3DWidget::uploadInstances(ModelBatch *batch,
+                                   const QVector<const FurnitureInstance *> &instances)
+{
+    QVector<float> data;
+    data.reserve(instances.size() * kInstanceFloats);
+    for (const FurnitureInstance *instance : instances) {
+        const float *matrix = instance->transform.constData();
+        for (int i = 0; i < 16; ++i) {
+            data.append(matrix[i]);
+        }
+        data << instance->color.x() << instance->color.y() << instance->color.z();
+        const QMatrix3x3 normalMatrix = instance->transform.normalMatrix();
+        const float *normal = normalMatrix.constData();
+        for (int i = 0; i < 9; ++i) {
+            data.append(normal[i]);
+        }
     }
+
+    batch->instanceBuffer.bind();
+    batch->instanceBuffer.allocate(data.constData(),
+                                   static_cast<int>(data.size() * sizeof(float)));
+    batch->instanceBuffer.release();
 }
 
-void View3DWidget::appendFurnitureMesh(const FurnitureItem *item,
-                                       QVector<QVector3D> &vertices) const
+void View3DWidget::releaseModels()
 {
-    if (!item) {
-        return;
+    qDeleteAll(m_models);
+    m_models.clear();
+    for (const FurnitureInstance &instance : qAsConst(m_furniture)) {
+        m_touchedModels.insert(instance.mesh.data());
     }
+}
 
-    const AssetManager::Asset asset = item->asset();
-    QSharedPointer<MeshData> mesh = ModelCache::instance()->getModel(asset.modelPath);
-    if (!mesh || mesh->vertices.isEmpty()) {
+void View3DWidget::cleanupGL()
+{
+    if (!m_vao.isCreated() && !m_program && m_models.isEmpty() && m_materialBuffer == 0) {
         return;
     }
 
-    const QVector3D modelSize = mesh->size();
-    const QVector3D scale = item->modelScale(modelSize);
-    QMatrix4x4 transform = item->transformMatrix();
-    transform.scale(scale.x(), scale.y(), scale.z());
-
-    const QVector3D pivot = mesh->pivotOffset();
-    vertices.reserve(vertices.size() + mesh->vertices.size());
-    for (const QVector3D &v : mesh->vertices) {
-        vertices.append(transform * (v + pivot));
+    // Buffers, the vertex array and programs belong to the current context;
+    // drop them while it is still alive. A re-parented widget gets a new
+    // context and initializeGL() builds them again, and the next paint
+    // uploads the geometry again.
+    makeCurrent();
+    releaseModels();
+    if (m_materialBuffer != 0) {
+        glDeleteBuffers(1, &m_materialBuffer);
+        m_materialBuffer = 0;
     }
+    m_vbo.destroy();
+    m_vao.destroy();
+    delete m_program;
+    m_program = nullptr;
+    delete m_instanceProgram;
+    m_instanceProgram = nullptr;
+    doneCurrent();
+    m_vboCapacity = 0;
+    m_vboUsed = 0;
+    m_vboWaste = 0;
+    m_geometryDirty = true;
 }
 
-QMatrix4x4 View3DWidget::viewMatrix() const
+
+
+
+
+
+QVector3D View3DWidget::eyePosition() const
 {
     const float yawRad = qDegreesToRadians(m_yaw);
     const float pitchRad = qDegreesToRadians(m_pitch);
 
-    const QVector3D eye(
+    return QVector3D(
         m_target.x() + m_distance * std::cos(pitchRad) * std::cos(yawRad),
         m_target.y() + m_distance * std::sin(pitchRad),
         m_target.z() + m_distance * std::cos(pitchRad) * std::sin(yawRad));
+}
 
+QMatrix4x4 View3DWidget::viewMatrix() const
+{
     QMatrix4x4 view;
-    view.lookAt(eye, m_target, QVector3D(0.0f, 1.0f, 0.0f));
+    view.lookAt(eyePosition(), m_target, QVector3D(0.0f, 1.0f, 0.0f));
     return view;
 }
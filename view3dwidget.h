@@ -1,6 +1,13 @@
 #ifndef VIEW3DWIDGET_H
 #define VIEW3DWIDGET_H
 
+#include "boundinghierarchy.h"
+#include "scenechange.h"
+#include "scenemesher.h"
+
+#include <QAtomicInteger>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QMatrix4x4>
 #include <QOpenGLBuffer>
 #include <QOpenGLFunctions_3_3_Core>
@@ -8,22 +15,46 @@
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLWidget>
 #include <QPoint>
+#include <QSharedPointer>
+#include <QSet>
+#include <QString>
 #include <QSurfaceFormat>
+#include <QVector>
 #include <QVector3D>
 
 class DesignScene;
 class WallItem;
-class OpeningItem;
 class FurnitureItem;
+class QGraphicsItem;
+struct MeshData;
 
 class View3DWidget : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core
 {
     Q_OBJECT
 
 public:
+    // What the last frame drew and what it culled, in triangles and in
+    // walls and furniture items.
+    struct CullStatistics {
+        qint64 drawnTriangles = 0;
+        qint64 culledTriangles = 0;
+        // Triangles of drawn furniture left out by coarser detail levels.
+        qint64 reducedTriangles = 0;
+        int drawnWalls = 0;
+        int culledWalls = 0;
+        int drawnFurniture = 0;
+        int culledFurniture = 0;
+    };
+
     explicit View3DWidget(QWidget *parent = nullptr);
+    ~View3DWidget() override;
     void setScene(DesignScene *scene);
 
+    CullStatistics cullStatistics() const;
+
+    // Vertex formats, buffer sizes and vertex bytes uploaded so far.
+    QString bufferReport() const;
+
 protected:
     void initializeGL() override;
     void resizeGL(int w, int h) override;
@@ -35,68 +66,145 @@ protected:
     void wheelEvent(QWheelEvent *event) override;
 
 private slots:
-    void scheduleSync();
+    void applySceneChanges(const SceneChangeSet &changes);
+    void onMeshBuildFinished();
+    void onModelReady(const QString &path);
 
 private:
-    void rebuildGeometry();
-    void appendWallMesh(const WallItem *wall, 
-                        const QList<WallItem *> &allWalls,
-                        QVector<QVector3D> &vertices);
-    void appendWallSegment(const WallItem *wall,
-                           qreal startDistance,
-                           qreal endDistance,
-                           qreal baseY,
-                           qreal height,
-                           QVector<QVector3D> &vertices) const;
-    void appendOpeningMesh(const WallItem *wall,
-                           const OpeningItem *opening,
-                           QVector<QVector3D> &solidVertices,
-                           QVector<QVector3D> &glassVertices) const;
-    void appendFurnitureMesh(const FurnitureItem *item,
-                             QVector<QVector3D> &vertices) const;
+    // A finished wall mesh and the VBO slot it occupies.
+    struct MeshChunk {
+        SceneMesher::WallMesh mesh;
+        int slotStart = -1;
+        int slotCapacity = 0;
+
+        int vertexCount() const;
+    };
+
+    // Where an uploaded chunk's parts sit in the VBO, in category order.
+    struct ChunkRange {
+        GLint first = 0;
+        GLsizei counts[SceneMesher::CategoryCount] = {};
+    };
+
+    // Walls, doors and window frames are drawn first; see-through parts
+    // after them, blended.
+    enum DrawPass {
+        Pass_Opaque,
+        Pass_Transparent,
+        PassCount
+    };
+
+    // VBO ranges drawn by one glMultiDrawArrays call. Each vertex names
+    // its material, so ranges of different categories share a call.
+    struct DrawBatch {
+        QVector<GLint> firsts;
+        QVector<GLsizei> counts;
+    };
+
+    // Placement of one furniture item, drawn as an instance of its model.
+    struct FurnitureInstance {
+        FurnitureItem *item = nullptr;
+        quint64 revision = 0;
+        QString modelPath;
+        QSharedPointer<MeshData> mesh;
+        QMatrix4x4 transform;
+        QVector3D color;
+    };
+
+    // A ModelCache mesh uploaded once, plus the transforms and colours of
+    // every furniture item that uses it.
+    struct ModelBatch {
+        QSharedPointer<MeshData> mesh;
+        QOpenGLVertexArrayObject vao;
+        QOpenGLBuffer vertexBuffer;
+        QOpenGLBuffer indexBuffer{QOpenGLBuffer::IndexBuffer};
+        QOpenGLBuffer instanceBuffer;
+        VertexQuantization quantization;
+        GLenum indexType = GL_UNSIGNED_SHORT;
+        // The items in instanceBuffer, grouped by the detail level they are
+        // drawn at, and whether any of them changed since it was written.
+        QVector<const QGraphicsItem *> drawnItems;
+        QVector<int> levelInstances;
+        bool instancesDirty = true;
+    };
+
+    void resyncScene();
+    void updateWallSnapshot(WallItem *wall);
+    bool removeWallSnapshot(const QGraphicsItem *item);
+    void updateFurnitureInstance(FurnitureItem *furniture);
+    bool removeFurnitureInstance(const QGraphicsItem *item);
+    void startMeshBuild();
+    void applyMeshBuild(const SceneMesher::Result &result);
+    void setVertexLayout(bool packed);
+    void uploadMaterials();
+    int vertexStride() const;
+    void chooseVertexFormat();
+    void uploadGeometry();
+    bool placeChunk(MeshChunk &chunk);
+    void uploadChunk(const MeshChunk &chunk);
+    void relayoutBuffer();
+    void rebuildDrawBatches();
+    void cullWalls(const ViewFrustum &frustum);
+    void releaseChunks();
+    void syncFurniture();
+    void rebuildFurnitureHierarchy();
+    void cullFurniture(const ViewFrustum &frustum, const QVector3D &eye);
+    ModelBatch *createModelBatch(const QSharedPointer<MeshData> &mesh);
+    void uploadInstances(ModelBatch *batch,
+                         const QVector<const FurnitureInstance *> &instances);
+    void setInstanceLayout(int firstInstance);
+    void releaseModels();
+    void cleanupGL();
+    QVector3D eyePosition() const;
     QMatrix4x4 viewMatrix() const;
 
     DesignScene *m_scene;
-    QOpenGLShaderProgram m_program;
+    // Built with each context in initializeGL() and deleted with it. Null
+    // without a context, or when the shaders did not link.
+    QOpenGLShaderProgram *m_program;
+    QOpenGLShaderProgram *m_instanceProgram;
     QOpenGLBuffer m_vbo;
     QOpenGLVertexArrayObject m_vao;
-    QVector<QVector3D> m_vertices;
-    QVector<QVector3D> m_wallVertices;
-    QVector<QVector3D> m_doorSingleVertices;
-    QVector<QVector3D> m_doorDoubleVertices;
-    QVector<QVector3D> m_doorSlidingVertices;
-    QVector<QVector3D> m_openingVertices;
-    QVector<QVector3D> m_glassCasementVertices;
-    QVector<QVector3D> m_glassSlidingVertices;
-    QVector<QVector3D> m_glassBayVertices;
-    struct ColorRange {
-        int start = 0;
-        int count = 0;
-        QVector3D color;
-        float alpha = 1.0f;
-    };
-    QVector<ColorRange> m_furnitureRanges;
+    // Latest snapshot of every wall, patched from change sets and handed to
+    // the mesher without copying the walls again.
+    QVector<SceneMesher::WallSnapshot> m_wallSnapshots;
+    QHash<const QGraphicsItem *, int> m_snapshotSlots;
+    QSet<const WallItem *> m_staleWalls;
+    QSet<const WallItem *> m_removedWalls;
+    QHash<const WallItem *, MeshChunk> m_chunks;
+    QSet<const WallItem *> m_pendingUploads;
+    bool m_chunksRemoved;
+    QFutureWatcher<SceneMesher::Result> m_meshWatcher;
+    QAtomicInteger<quint64> m_meshGeneration;
+    bool m_meshBuildQueued;
+    // Every uploaded chunk, culled against the view frustum each frame to
+    // fill m_passes.
+    QVector<ChunkRange> m_chunkRanges;
+    BoundingHierarchy m_chunkHierarchy;
+    DrawBatch m_passes[PassCount];
+    // Uniform buffer with every category's colour and opacity.
+    GLuint m_materialBuffer;
+    QHash<const QGraphicsItem *, FurnitureInstance> m_furniture;
+    // World bounds of every furniture instance with a mesh.
+    QVector<const QGraphicsItem *> m_furnitureKeys;
+    QVector<BoundingBox> m_furnitureBoxes;
+    BoundingHierarchy m_furnitureHierarchy;
+    qint64 m_furnitureTriangles;
+    bool m_furnitureHierarchyDirty;
+    CullStatistics m_cullStatistics;
+    QHash<const MeshData *, ModelBatch *> m_models;
+    QSet<const MeshData *> m_touchedModels;
+    int m_vboCapacity;
+    int m_vboUsed;
+    int m_vboWaste;
+    // Walls are uploaded as PackedMeshVertex on m_quantization's grid
+    // while the whole plan fits it finely enough, else as FloatMeshVertex.
+    bool m_packedVertices;
+    VertexQuantization m_quantization;
+    qint64 m_uploadedVertexBytes;
     bool m_geometryDirty;
     int m_vertexCount;
     QMatrix4x4 m_projection;
-    struct MeshRanges {
-        int wallStart = 0;
-        int wallCount = 0;
-        int doorSingleStart = 0;
-        int doorSingleCount = 0;
-        int doorDoubleStart = 0;
-        int doorDoubleCount = 0;
-        int doorSlidingStart = 0;
-        int doorSlidingCount = 0;
-        int openingStart = 0;
-        int openingCount = 0;
-        int glassCasementStart = 0;
-        int glassCasementCount = 0;
-        int glassSlidingStart = 0;
-        int glassSlidingCount = 0;
-        int glassBayStart = 0;
-        int glassBayCount = 0;
-    } m_ranges;
 
     float m_distance;
     float m_yaw;
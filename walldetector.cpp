@@ -0,0 +1,414 @@
+#include "walldetector.h"
+
+#include "imagebandreader.h"
+
+#include <QImage>
+#include <QPair>
+#include <QtConcurrent>
+#include <QtMath>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Longest side a scan is searched at, which keeps each of the two working
+// copies under 64 MiB. Larger scans are read in bands and every band is
+// shrunk as it arrives, so the full-size scan is never in memory.
+constexpr int kMaxWorkSide = 8192;
+// Scan bytes per band read.
+constexpr qint64 kReadBandBytes = 16 * 1024 * 1024;
+constexpr int kStripRows = 256;
+// Breaks in a wall line up to this long, in millimetres, are scan noise
+// rather than openings.
+constexpr qreal kMergeGap = 50.0;
+// Slack, in work pixels, when lining pieces up or snapping their ends.
+constexpr qreal kTolerance = 2.0;
+
+// Limits in work pixels. Pixels at or below the threshold are dark.
+struct Limits {
+    int threshold = 127;
+    int minThickness = 0;
+    int maxThickness = 0;
+    int minLength = 0;
+};
+
+// A dark band in image rows: the rows [top, top + thickness) are dark over
+// the columns [left, right).
+struct Band {
+    int top = 0;
+    int thickness = 0;
+    int left = 0;
+    int right = 0;
+};
+
+// A wall piece along the searched rows: offset is the row position of its
+// centre line, [from, to] its extent along the row.
+struct Piece {
+    qreal offset = 0.0;
+    qreal from = 0.0;
+    qreal to = 0.0;
+    qreal thickness = 0.0;
+};
+
+struct Strip {
+    int first = 0;
+    int last = 0;
+    QVector<qint64> histogram;
+    QVector<Band> bands;
+};
+
+bool isCancelled(const QAtomicInt *cancelled)
+{
+    return cancelled && cancelled->loadRelaxed() != 0;
+}
+
+QVector<Strip> makeStrips(int rows)
+{
+    QVector<Strip> strips;
+    for (int first = 0; first < rows; first += kStripRows) {
+        Strip strip;
+        strip.first = first;
+        strip.last = qMin(rows, first + kStripRows);
+        strips.append(strip);
+    }
+    return strips;
+}
+
+// Otsu's method: the grey level that best separates the histogram into
+// ink and paper.
+int otsuThreshold(const QVector<qint64> &histogram)
+{
+    qint64 total = 0;
+    double sum = 0.0;
+    for (int level = 0; level < 256; ++level) {
+        total += histogram.at(level);
+        sum += double(level) * histogram.at(level);
+    }
+
+    qint64 dark = 0;
+    double darkSum = 0.0;
+    double best = -1.0;
+    int threshold = 127;
+    for (int level = 0; level < 255; ++level) {
+        dark += histogram.at(level);
+        darkSum += double(level) * histogram.at(level);
+        const qint64 light = total - dark;
+        if (dark == 0 || light == 0) {
+            continue;
+        }
+        const double difference = darkSum / dark - (sum - darkSum) / light;
+        const double between = double(dark) * double(light) * difference * difference;
+        if (between > best) {
+            best = between;
+            threshold = level;
+        }
+    }
+    return threshold;
+}
+
+// Writes source's rows [first, last) as target's columns. Works in blocks
+// so both images are walked a cache line at a time.
+void transposeRows(const QImage &source, uchar *target, qsizetype targetStride,
+                   int first, int last)
+{
+    constexpr int kBlock = 64;
+    for (int x0 = 0; x0 < source.width(); x0 += kBlock) {
+        const int x1 = qMin(source.width(), x0 + kBlock);
+        for (int y = first; y < last; ++y) {
+            const uchar *in = source.constScanLine(y);
+            for (int x = x0; x < x1; ++x) {
+                target[x * targetStride + y] = in[x];
+            }
+        }
+    }
+}
+
+// Collects the bands that start in the strip's rows. The rows around the
+// strip are searched too, so a band crossing a strip edge is measured in
+// full and claimed only by the strip it starts in.
+void findBands(const QImage &image, const Limits &limits, Strip &strip,
+               const QAtomicInt *cancelled)
+{
+    struct OpenBand {
+        int top;
+        int left;
+        int right;
+        bool continued;
+    };
+
+    const int begin = qMax(0, strip.first - limits.maxThickness - 1);
+    const int end = qMin(image.height(), strip.last + limits.maxThickness + 1);
+    const int width = image.width();
+    QVector<OpenBand> open;
+    QVector<OpenBand> next;
+    QVector<QPair<int, int>> runs;
+
+    const auto close = [&](const OpenBand &band, int bottom) {
+        const int thickness = bottom - band.top;
+        if (band.top >= strip.first && band.top < strip.last
+            && thickness >= limits.minThickness && thickness <= limits.maxThickness) {
+            strip.bands.append(Band{band.top, thickness, band.left, band.right});
+        }
+    };
+
+    for (int y = begin; y < end; ++y) {
+        if ((y & 31) == 0 && isCancelled(cancelled)) {
+            return;
+        }
+
+        runs.clear();
+        const uchar *line = image.constScanLine(y);
+        int x = 0;
+        while (x < width) {
+            while (x < width && line[x] > limits.threshold) {
+                ++x;
+            }
+            const int start = x;
+            while (x < width && line[x] <= limits.threshold) {
+                ++x;
+            }
+            if (x - start >= limits.minLength) {
+                runs.append(qMakePair(start, x));
+            }
+        }
+
+        // Each run continues the open band it overlaps most; a band keeps
+        // the columns all of its rows share. Anything too thick is still
+        // followed to its end, so its lower rows do not pass for a wall.
+        next.clear();
+        for (const QPair<int, int> &run : qAsConst(runs)) {
+            OpenBand *best = nullptr;
+            int bestOverlap = 0;
+            for (OpenBand &band : open) {
+                const int overlap = qMin(band.right, run.second) - qMax(band.left, run.first);
+                if (!band.continued && overlap > bestOverlap) {
+                    best = &band;
+                    bestOverlap = overlap;
+                }
+            }
+            if (best && bestOverlap >= limits.minLength) {
+                best->continued = true;
+                next.append(OpenBand{best->top,
+                                     qMax(best->left, run.first),
+                                     qMin(best->right, run.second),
+                                     false});
+            } else {
+                next.append(OpenBand{y, run.first, run.second, false});
+            }
+        }
+        for (const OpenBand &band : qAsConst(open)) {
+            if (!band.continued) {
+                close(band, y);
+            }
+        }
+        open.swap(next);
+    }
+
+    // Bands still open end at the image's edge; anywhere else they have
+    // outgrown any wall.
+    if (end == image.height()) {
+        for (const OpenBand &band : qAsConst(open)) {
+            close(band, end);
+        }
+    }
+}
+
+QVector<Piece> searchRows(const QImage &image, const Limits &limits,
+                          const QAtomicInt *cancelled)
+{
+    QVector<Strip> strips = makeStrips(image.height());
+    QtConcurrent::blockingMap(strips, [&](Strip &strip) {
+        findBands(image, limits, strip, cancelled);
+    });
+
+    QVector<Piece> pieces;
+    for (const Strip &strip : qAsConst(strips)) {
+        for (const Band &band : strip.bands) {
+            pieces.append(Piece{band.top + band.thickness / 2.0,
+                                qreal(band.left),
+                                qreal(band.right),
+                                qreal(band.thickness)});
+        }
+    }
+    return pieces;
+}
+
+// Joins pieces that continue one another along the same line.
+QVector<Piece> mergePieces(QVector<Piece> pieces, qreal gap)
+{
+    std::sort(pieces.begin(), pieces.end(), [](const Piece &a, const Piece &b) {
+        return a.offset < b.offset;
+    });
+
+    QVector<Piece> merged;
+    int first = 0;
+    while (first < pieces.size()) {
+        // Pieces on one line differ in offset by rounding only.
+        int last = first + 1;
+        while (last < pieces.size()
+               && pieces.at(last).offset - pieces.at(last - 1).offset
+                      <= qMax(kTolerance, pieces.at(last - 1).thickness / 4.0)) {
+            ++last;
+        }
+        std::sort(pieces.begin() + first, pieces.begin() + last,
+                  [](const Piece &a, const Piece &b) { return a.from < b.from; });
+
+        Piece current = pieces.at(first);
+        for (int i = first + 1; i < last; ++i) {
+            const Piece &piece = pieces.at(i);
+            if (piece.from - current.to > gap
+                || qAbs(piece.thickness - current.thickness)
+                       > qMax(kTolerance, current.thickness / 4.0)) {
+                merged.append(current);
+                current = piece;
+                continue;
+            }
+            const qreal currentLength = current.to - current.from;
+            const qreal pieceLength = piece.to - piece.from;
+            const qreal total = currentLength + pieceLength;
+            current.offset = (current.offset * currentLength + piece.offset * pieceLength) / total;
+            current.thickness =
+                (current.thickness * currentLength + piece.thickness * pieceLength) / total;
+            current.to = qMax(current.to, piece.to);
+        }
+        merged.append(current);
+        first = last;
+    }
+    return merged;
+}
+
+// A band runs to the far face of a wall it butts into. Such ends are moved
+// onto that wall's centre line, so traced walls meet the way drawn ones do.
+void snapEnds(QVector<Piece> &pieces, const QVector<Piece> &crossing)
+{
+    for (Piece &piece : pieces) {
+        for (const Piece &other : crossing) {
+            if (piece.offset < other.from - kTolerance || piece.offset > other.to + kTolerance) {
+                continue;
+            }
+            const qreal reach = other.thickness / 2.0 + kTolerance;
+            if (qAbs(piece.from - other.offset) <= reach) {
+                piece.from = other.offset;
+            } else if (qAbs(piece.to - other.offset) <= reach) {
+                piece.to = other.offset;
+            }
+        }
+    }
+}
+} // namespace
+
+WallDetector::Result WallDetector::detect(const Request &request, const QAtomicInt *cancelled)
+{
+    Result result;
+    QString error;
+    ImageBandReader reader(request.imagePath);
+    if (request.pixelSize <= 0.0 || !reader.open(&error)) {
+        result.errorMessage = error.isEmpty()
+            ? QStringLiteral("无法读取底图: %1").arg(request.imagePath)
+            : error;
+        return result;
+    }
+    const QSize size = reader.size();
+
+    // Scans are shrunk by a whole factor, so every work pixel averages the
+    // same block of scan pixels and bands join without seams.
+    const int factor = (qMax(size.width(), size.height()) + kMaxWorkSide - 1) / kMaxWorkSide;
+    const qreal scale = 1.0 / factor;
+    QImage image((size.width() + factor - 1) / factor, (size.height() + factor - 1) / factor,
+                 QImage::Format_Grayscale8);
+    const int bandRows = factor * static_cast<int>(qMax<qint64>(
+        1, kReadBandBytes / (static_cast<qint64>(size.width()) * 4 * factor)));
+    for (int top = 0; !reader.atEnd(); ) {
+        if (isCancelled(cancelled)) {
+            result.cancelled = true;
+            return result;
+        }
+        QImage band = reader.read(bandRows, &error);
+        if (band.isNull()) {
+            result.errorMessage = error;
+            return result;
+        }
+        // Smooth scaling works in colour, so grey comes last.
+        if (factor > 1) {
+            band = band.scaled(image.width(), (band.height() + factor - 1) / factor,
+                               Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+        band = band.convertToFormat(QImage::Format_Grayscale8);
+        for (int y = 0; y < band.height(); ++y) {
+            std::memcpy(image.scanLine(top + y), band.constScanLine(y), image.width());
+        }
+        top += band.height();
+    }
+    const qreal scaleX = qreal(image.width()) / size.width();
+    const qreal scaleY = qreal(image.height()) / size.height();
+
+    // A wall's cross-section must never count as a run along another wall,
+    // so the shortest wall is longer than the thickest one.
+    const qreal workPixelSize = request.pixelSize / scale;
+    Limits limits;
+    limits.minThickness = qMax(2, qCeil(request.minThickness / workPixelSize));
+    limits.maxThickness = qFloor(request.maxThickness / workPixelSize);
+    limits.minLength = qMax(limits.maxThickness + 1, qCeil(request.minLength / workPixelSize));
+    if (limits.maxThickness < limits.minThickness) {
+        result.errorMessage = QStringLiteral("底图分辨率过低，无法识别墙体。");
+        return result;
+    }
+
+    QVector<Strip> strips = makeStrips(image.height());
+    QtConcurrent::blockingMap(strips, [&image](Strip &strip) {
+        strip.histogram.fill(0, 256);
+        for (int y = strip.first; y < strip.last; ++y) {
+            const uchar *line = image.constScanLine(y);
+            for (int x = 0; x < image.width(); ++x) {
+                ++strip.histogram[line[x]];
+            }
+        }
+    });
+    QVector<qint64> histogram(256, 0);
+    for (const Strip &strip : qAsConst(strips)) {
+        for (int level = 0; level < 256; ++level) {
+            histogram[level] += strip.histogram.at(level);
+        }
+    }
+    limits.threshold = otsuThreshold(histogram);
+
+    // Vertical walls are found as horizontal ones in the transposed scan.
+    QImage transposed(image.height(), image.width(), QImage::Format_Grayscale8);
+    if (transposed.isNull()) {
+        result.errorMessage = QStringLiteral("内存不足，无法识别墙体。");
+        return result;
+    }
+    uchar *target = transposed.bits();
+    const qsizetype targetStride = transposed.bytesPerLine();
+    QtConcurrent::blockingMap(strips, [&](Strip &strip) {
+        transposeRows(image, target, targetStride, strip.first, strip.last);
+    });
+    if (isCancelled(cancelled)) {
+        result.cancelled = true;
+        return result;
+    }
+
+    const qreal gap = kMergeGap / workPixelSize;
+    QVector<Piece> horizontal = mergePieces(searchRows(image, limits, cancelled), gap);
+    image = QImage();
+    QVector<Piece> vertical = mergePieces(searchRows(transposed, limits, cancelled), gap);
+    if (isCancelled(cancelled)) {
+        result.cancelled = true;
+        return result;
+    }
+
+    snapEnds(horizontal, vertical);
+    snapEnds(vertical, horizontal);
+
+    for (const Piece &piece : qAsConst(horizontal)) {
+        result.walls.append(Wall{QLineF(piece.from / scaleX, piece.offset / scaleY,
+                                        piece.to / scaleX, piece.offset / scaleY),
+                                 piece.thickness / scaleY});
+    }
+    for (const Piece &piece : qAsConst(vertical)) {
+        result.walls.append(Wall{QLineF(piece.offset / scaleX, piece.from / scaleY,
+                                        piece.offset / scaleX, piece.to / scaleY),
+                                 piece.thickness / scaleX});
+    }
+    return result;
+}
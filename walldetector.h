@@ -0,0 +1,45 @@
+#ifndef WALLDETECTOR_H
+#define WALLDETECTOR_H
+
+#include <QAtomicInt>
+#include <QLineF>
+#include <QString>
+#include <QVector>
+
+// Traces walls on a blueprint scan. The scan is binarized at Otsu's
+// threshold and searched for thick dark bands: runs of dark pixels long
+// enough to be a wall, stacked over a plausible wall thickness. Rows and
+// columns are searched in strips on the global thread pool; collinear
+// pieces are then merged and wall ends snapped onto the walls they butt
+// into. Only walls parallel to the scan's edges are found.
+class WallDetector
+{
+public:
+    // Sizes are in millimetres.
+    struct Request {
+        QString imagePath;
+        // Millimetres per image pixel, the blueprint's calibrated scale.
+        qreal pixelSize = 1.0;
+        qreal minThickness = 60.0;
+        qreal maxThickness = 500.0;
+        qreal minLength = 600.0;
+    };
+
+    // In image pixels, relative to the image's top-left corner.
+    struct Wall {
+        QLineF line;
+        qreal thickness = 0.0;
+    };
+
+    struct Result {
+        bool cancelled = false;
+        QString errorMessage;
+        QVector<Wall> walls;
+    };
+
+    // May run on any thread. Stops early, with cancelled set, once
+    // *cancelled becomes non-zero.
+    static Result detect(const Request &request, const QAtomicInt *cancelled);
+};
+
+#endif // WALLDETECTOR_H
@@ -0,0 +1,138 @@
+#include "wallindex.h"
+
+#include "wallitem.h"
+
+#include <QSet>
+#include <QtMath>
+
+WallIndex::WallIndex(qreal cellSize)
+    : m_cellSize(cellSize)
+{
+}
+
+void WallIndex::update(WallItem *wall)
+{
+    if (!wall) {
+        return;
+    }
+
+    Footprint footprint;
+    footprint.start = wall->startPos();
+    footprint.end = wall->endPos();
+    footprint.halfWidth = qMax<qreal>(0.0, wall->thickness() / 2.0);
+
+    const auto it = m_footprints.constFind(wall);
+    if (it != m_footprints.constEnd()) {
+        if (it->start == footprint.start && it->end == footprint.end
+            && it->halfWidth == footprint.halfWidth) {
+            return;
+        }
+        unfileWall(wall, it->cells);
+    }
+
+    footprint.cells = cellsAlong(footprint.start, footprint.end, footprint.halfWidth);
+    fileWall(wall, footprint.cells);
+    m_footprints.insert(wall, footprint);
+}
+
+void WallIndex::remove(WallItem *wall)
+{
+    const auto it = m_footprints.find(wall);
+    if (it == m_footprints.end()) {
+        return;
+    }
+
+    unfileWall(wall, it->cells);
+    m_footprints.erase(it);
+}
+
+void WallIndex::clear()
+{
+    m_cells.clear();
+    m_footprints.clear();
+}
+
+QList<WallItem *> WallIndex::wallsNear(const QPointF &pos, qreal radius) const
+{
+    const QPoint min = cellOf(pos - QPointF(radius, radius));
+    const QPoint max = cellOf(pos + QPointF(radius, radius));
+
+    QList<WallItem *> result;
+    QSet<WallItem *> seen;
+    for (int x = min.x(); x <= max.x(); ++x) {
+        for (int y = min.y(); y <= max.y(); ++y) {
+            const auto it = m_cells.constFind(QPoint(x, y));
+            if (it == m_cells.constEnd()) {
+                continue;
+            }
+            for (WallItem *wall : it.value()) {
+                if (!seen.contains(wall)) {
+                    seen.insert(wall);
+                    result.append(wall);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+QPoint WallIndex::cellOf(const QPointF &pos) const
+{
+    return QPoint(qFloor(pos.x() / m_cellSize), qFloor(pos.y() / m_cellSize));
+}
+
+// Walks the segment through the grid one column at a time. In each column
+// the rows run from the lowest to the highest point of the part of the
+// segment that comes within halfWidth of the column, widened by halfWidth
+// again. That covers every cell within halfWidth of the centre line, and a
+// wall crosses only O(length / cell size) cells at any angle.
+QVector<QPoint> WallIndex::cellsAlong(const QPointF &start,
+                                      const QPointF &end,
+                                      qreal halfWidth) const
+{
+    const qreal minX = qMin(start.x(), end.x());
+    const qreal maxX = qMax(start.x(), end.x());
+    const qreal dx = end.x() - start.x();
+    const qreal dy = end.y() - start.y();
+    const int firstColumn = qFloor((minX - halfWidth) / m_cellSize);
+    const int lastColumn = qFloor((maxX + halfWidth) / m_cellSize);
+
+    QVector<QPoint> cells;
+    for (int column = firstColumn; column <= lastColumn; ++column) {
+        qreal fromY = start.y();
+        qreal toY = end.y();
+        if (dx != 0.0) {
+            const qreal left = qMax(minX, column * m_cellSize - halfWidth);
+            const qreal right = qMin(maxX, (column + 1) * m_cellSize + halfWidth);
+            fromY = start.y() + (left - start.x()) / dx * dy;
+            toY = start.y() + (right - start.x()) / dx * dy;
+        }
+        const int firstRow = qFloor((qMin(fromY, toY) - halfWidth) / m_cellSize);
+        const int lastRow = qFloor((qMax(fromY, toY) + halfWidth) / m_cellSize);
+        for (int row = firstRow; row <= lastRow; ++row) {
+            cells.append(QPoint(column, row));
+        }
+    }
+    return cells;
+}
+
+void WallIndex::fileWall(WallItem *wall, const QVector<QPoint> &cells)
+{
+    for (const QPoint &cell : cells) {
+        m_cells[cell].append(wall);
+    }
+}
+
+void WallIndex::unfileWall(WallItem *wall, const QVector<QPoint> &cells)
+{
+    for (const QPoint &cell : cells) {
+        auto it = m_cells.find(cell);
+        if (it == m_cells.end()) {
+            continue;
+        }
+        it->removeOne(wall);
+        if (it->isEmpty()) {
+            m_cells.erase(it);
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef WALLINDEX_H
+#define WALLINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QPoint>
+#include <QPointF>
+#include <QVector>
+
+class WallItem;
+
+// Uniform grid over walls. A wall is filed under the cells its centre line
+// passes through, widened by half its thickness, so it occupies a number of
+// cells proportional to its length however it is angled. Snapping and
+// hit-testing only look at walls in nearby cells.
+class WallIndex
+{
+public:
+    explicit WallIndex(qreal cellSize = 1000.0);
+
+    void update(WallItem *wall);
+    void remove(WallItem *wall);
+    void clear();
+
+    // Walls that may pass within radius of pos. Callers still measure the
+    // exact distance.
+    QList<WallItem *> wallsNear(const QPointF &pos, qreal radius) const;
+
+private:
+    // Where a wall was filed, and what from.
+    struct Footprint {
+        QPointF start;
+        QPointF end;
+        qreal halfWidth = 0.0;
+        QVector<QPoint> cells;
+    };
+
+    QPoint cellOf(const QPointF &pos) const;
+    QVector<QPoint> cellsAlong(const QPointF &start, const QPointF &end, qreal halfWidth) const;
+    void fileWall(WallItem *wall, const QVector<QPoint> &cells);
+    void unfileWall(WallItem *wall, const QVector<QPoint> &cells);
+
+    qreal m_cellSize;
+    QHash<QPoint, QVector<WallItem *>> m_cells;
+    QHash<WallItem *, Footprint> m_footprints;
+};
+
+#endif // WALLINDEX_H
@@ -1,6 +1,9 @@
 #include "wallitem.h"
 
+#include "designscene.h"
+#include "meshrevision.h"
 #include "openingitem.h"
+#include "wallindex.h"
 
 #include <QBrush>
 #include <QGraphicsScene>
@@ -48,6 +51,11 @@ bool lineIntersection(const QPointF &p1, const QPointF &d1, const QPointF &p2,
   return true;
 }
 
+WallIndex *wallIndexOf(const QGraphicsItem *item) {
+  auto *designScene = qobject_cast<DesignScene *>(item->scene());
+  return designScene ? designScene->wallIndex() : nullptr;
+}
+
 class UpdateGuard {
 public:
   UpdateGuard(QSet<WallItem *> &set, WallItem *item)
@@ -68,7 +76,7 @@ WallItem::WallItem(const QPointF &start, const QPointF &end, qreal thickness,
     : QGraphicsPolygonItem(parent), m_start(start), m_end(end), m_id(),
       m_thickness(thickness), m_height(height), m_openings(),
       m_basePen(QColor(63, 73, 84), 1.2), m_baseBrush(QColor(186, 195, 205)),
-      m_highlighted(false) {
+      m_highlighted(false), m_meshRevision(nextMeshRevision()) {
   ensureId();
   setFlags(QGraphicsItem::ItemIsSelectable);
   setPen(m_basePen);
@@ -76,9 +84,25 @@ WallItem::WallItem(const QPointF &start, const QPointF &end, qreal thickness,
   updateGeometry();
 }
 
-void WallItem::setStartPos(const QPointF &pos) { m_start = pos; }
+WallItem::~WallItem() {
+  // During scene teardown the cast fails and the index is already gone.
+  if (WallIndex *index = wallIndexOf(this)) {
+    index->remove(this);
+  }
+  DesignScene::reportItemChange(this, SceneChange_Removed);
+}
 
-void WallItem::setEndPos(const QPointF &pos) { m_end = pos; }
+void WallItem::setStartPos(const QPointF &pos) {
+  m_start = pos;
+  markMeshChanged(SceneChange_Geometry);
+  updateIndex();
+}
+
+void WallItem::setEndPos(const QPointF &pos) {
+  m_end = pos;
+  markMeshChanged(SceneChange_Geometry);
+  updateIndex();
+}
 
 QPointF WallItem::startPos() const { return m_start; }
 
@@ -86,12 +110,16 @@ QPointF WallItem::endPos() const { return m_end; }
 
 void WallItem::setThickness(qreal thickness) {
   m_thickness = thickness;
+  markMeshChanged(SceneChange_Geometry);
   updateGeometry();
 }
 
 qreal WallItem::thickness() const { return m_thickness; }
 
-void WallItem::setHeight(qreal height) { m_height = height; }
+void WallItem::setHeight(qreal height) {
+  m_height = height;
+  markMeshChanged(SceneChange_Property);
+}
 
 qreal WallItem::height() const { return m_height; }
 
@@ -107,6 +135,8 @@ void WallItem::setAngleDegrees(qreal angle) {
 
   line.setAngle(angle);
   m_end = line.p2();
+  markMeshChanged(SceneChange_Geometry);
+  updateIndex();
   updateGeometry();
 }
 
@@ -116,6 +146,7 @@ void WallItem::updateGeometry() {
     return;
   }
   UpdateGuard guard(s_updating, this);
+  updateIndex();
 
   QLineF centerLine(m_start, m_end);
   if (centerLine.length() < kMinWallLength) {
@@ -132,11 +163,21 @@ void WallItem::updateGeometry() {
       return info;
     }
 
+    QList<WallItem *> candidates;
+    if (WallIndex *index = wallIndexOf(this)) {
+      candidates = index->wallsNear(joint, kJointTolerance);
+    } else {
+      const QList<QGraphicsItem *> sceneItems = scene()->items();
+      for (QGraphicsItem *item : sceneItems) {
+        if (auto *wall = qgraphicsitem_cast<WallItem *>(item)) {
+          candidates.append(wall);
+        }
+      }
+    }
+
     qreal bestDist = kJointTolerance + 1.0;
-    const QList<QGraphicsItem *> sceneItems = scene()->items();
-    for (QGraphicsItem *item : sceneItems) {
-      auto *wall = qgraphicsitem_cast<WallItem *>(item);
-      if (!wall || wall == this) {
+    for (WallItem *wall : qAsConst(candidates)) {
+      if (wall == this) {
         continue;
       }
 
@@ -280,6 +321,7 @@ void WallItem::addOpening(OpeningItem *opening) {
     return;
   }
   m_openings.append(opening);
+  markMeshChanged(SceneChange_Property);
   opening->setWall(this);
   opening->syncWithWall();
 }
@@ -289,6 +331,7 @@ void WallItem::removeOpening(OpeningItem *opening) {
     return;
   }
   m_openings.removeAll(opening);
+  markMeshChanged(SceneChange_Property);
   if (opening->wall() == this) {
     opening->setWall(nullptr);
   }
@@ -303,16 +346,18 @@ void WallItem::setId(const QString &id) {
   ensureId();
 }
 
-QJsonObject WallItem::toJson() const {
-  QJsonObject obj;
-  obj["id"] = m_id;
-  obj["start"] = QJsonArray{m_start.x(), m_start.y()};
-  obj["end"] = QJsonArray{m_end.x(), m_end.y()};
-  obj["thickness"] = m_thickness;
-  obj["height"] = m_height;
-  return obj;
+ProjectSnapshot::Wall WallItem::snapshot() const {
+  ProjectSnapshot::Wall wall;
+  wall.id = m_id;
+  wall.start = m_start;
+  wall.end = m_end;
+  wall.thickness = m_thickness;
+  wall.height = m_height;
+  return wall;
 }
 
+QJsonObject WallItem::toJson() const { return ProjectSnapshot::toJson(snapshot()); }
+
 WallItem *WallItem::fromJson(const QJsonObject &json) {
   const QJsonArray startArray = json.value("start").toArray();
   const QJsonArray endArray = json.value("end").toArray();
@@ -346,6 +391,33 @@ void WallItem::setHighlighted(bool highlighted) {
 
 bool WallItem::isHighlighted() const { return m_highlighted; }
 
+quint64 WallItem::meshRevision() const { return m_meshRevision; }
+
+QVariant WallItem::itemChange(GraphicsItemChange change,
+                              const QVariant &value) {
+  if (change == ItemSceneChange) {
+    if (WallIndex *index = wallIndexOf(this)) {
+      index->remove(this);
+    }
+    DesignScene::reportItemChange(this, SceneChange_Removed);
+  } else if (change == ItemSceneHasChanged) {
+    updateIndex();
+    DesignScene::reportItemChange(this, SceneChange_Added);
+  }
+  return QGraphicsPolygonItem::itemChange(change, value);
+}
+
+void WallItem::updateIndex() {
+  if (WallIndex *index = wallIndexOf(this)) {
+    index->update(this);
+  }
+}
+
+void WallItem::markMeshChanged(SceneChangeFlags flags) {
+  m_meshRevision = nextMeshRevision();
+  DesignScene::reportItemChange(this, flags);
+}
+
 void WallItem::syncOpenings() {
   for (OpeningItem *opening : m_openings) {
     if (opening) {
@@ -1,6 +1,9 @@
 #ifndef WALLITEM_H
 #define WALLITEM_H
 
+#include "projectsnapshot.h"
+#include "scenechange.h"
+
 #include <QBrush>
 #include <QGraphicsPolygonItem>
 #include <QList>
@@ -21,6 +24,7 @@ public:
              qreal thickness = 30.0,
              qreal height = 200.0,
              QGraphicsItem *parent = nullptr);
+    ~WallItem() override;
 
     void setStartPos(const QPointF &pos);
     void setEndPos(const QPointF &pos);
@@ -44,14 +48,23 @@ public:
 
     QString id() const;
     void setId(const QString &id);
+    ProjectSnapshot::Wall snapshot() const;
     QJsonObject toJson() const;
     static WallItem *fromJson(const QJsonObject &json);
 
     void setHighlighted(bool highlighted);
     bool isHighlighted() const;
 
+    quint64 meshRevision() const;
+
+protected:
+    QVariant itemChange(GraphicsItemChange change,
+                        const QVariant &value) override;
+
 private:
     void syncOpenings();
+    void updateIndex();
+    void markMeshChanged(SceneChangeFlags flags);
     void ensureId();
 
     QPointF m_start;
@@ -63,6 +76,7 @@ private:
     QPen m_basePen;
     QBrush m_baseBrush;
     bool m_highlighted;
+    quint64 m_meshRevision;
 };
 
 #endif // WALLITEM_H